@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+
+# Compresses a wordlist into John's block-compressed format (see src/wlz.c),
+# which "john --wordlist" reads directly, seeking and decompressing blocks in
+# parallel.  Each block is a zlib stream of whole lines.
+#
+# Usage: wlz.py [-b BLOCK-KiB] [-l LEVEL] INPUT OUTPUT
+#        wlz.py -d INPUT OUTPUT		(decompress, for checking)
+#
+# Use "-" for stdin or stdout.
+#
+# This software is Copyright (c) 2026 and hereby released to the general
+# public under the following terms: Redistribution and use in source and
+# binary forms, with or without modification, are permitted.
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"JtRwlz\0\1"
+MAGIC_END = b"JtRwlz\0\2"
+BLOCK_MAX = 64 << 20
+
+
+def open_in(name):
+    return sys.stdin.buffer if name == "-" else open(name, "rb")
+
+
+def open_out(name):
+    return sys.stdout.buffer if name == "-" else open(name, "wb")
+
+
+def compress(inp, out, block_size, level):
+    out.write(MAGIC)
+    offset = len(MAGIC)
+    index = []
+    pending = b""
+    eof = False
+
+    while pending or not eof:
+        if not eof and len(pending) < block_size:
+            data = inp.read(block_size)
+            eof = not data
+            pending += data
+            continue
+        cut = pending.rfind(b"\n", 0, block_size) + 1
+        if not cut:
+            # A line longer than a block, so it gets a block of its own
+            cut = pending.find(b"\n", block_size) + 1
+            if not cut and not eof and len(pending) < BLOCK_MAX:
+                data = inp.read(block_size)
+                eof = not data
+                pending += data
+                continue
+        if not cut or cut > BLOCK_MAX:
+            cut = min(len(pending), BLOCK_MAX)
+        block, pending = pending[:cut], pending[cut:]
+        packed = zlib.compress(block, level)
+        out.write(packed)
+        index.append((len(packed), len(block)))
+        offset += len(packed)
+
+    for csize, usize in index:
+        out.write(struct.pack("<QQ", csize, usize))
+    out.write(struct.pack("<QQ", len(index), offset))
+    out.write(MAGIC_END)
+
+
+def decompress(inp, out):
+    data = inp.read()
+    if data[:8] != MAGIC or data[-8:] != MAGIC_END:
+        sys.exit("Not a JtR compressed wordlist")
+    count, offset = struct.unpack("<QQ", data[-24:-8])
+    pos = len(MAGIC)
+    for i in range(count):
+        csize, usize = struct.unpack_from("<QQ", data, offset + 16 * i)
+        block = zlib.decompress(data[pos:pos + csize])
+        if len(block) != usize:
+            sys.exit("Corrupt block %d" % i)
+        out.write(block)
+        pos += csize
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compress a wordlist for John the Ripper")
+    parser.add_argument("-d", action="store_true", help="decompress")
+    parser.add_argument("-b", type=int, default=1024,
+                        help="block size in KiB (default 1024)")
+    parser.add_argument("-l", type=int, default=6,
+                        help="zlib compression level (default 6)")
+    parser.add_argument("input")
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    if not 1 <= args.b <= BLOCK_MAX >> 10:
+        sys.exit("Block size must be 1..%d KiB" % (BLOCK_MAX >> 10))
+
+    with open_in(args.input) as inp, open_out(args.output) as out:
+        if args.d:
+            decompress(inp, out)
+        else:
+            compress(inp, out, args.b << 10, args.l)
+
+
+if __name__ == "__main__":
+    main()
@@ -411,9 +411,9 @@ struct fmt_main fmt_BSDI = {
 		FMT_OMP |
 #endif
 #if DES_BS
-		FMT_CASE | FMT_BS,
+		FMT_CASE | FMT_BS | FMT_FLAT_SALT,
 #else
-		FMT_CASE,
+		FMT_CASE | FMT_FLAT_SALT,
 #endif
 		{
 			"iteration count",
@@ -370,7 +370,7 @@ struct fmt_main fmt_DES = {
 #if DES_BS
 		FMT_BS |
 #endif
-		FMT_TRUNC | FMT_CASE,
+		FMT_TRUNC | FMT_CASE | FMT_FLAT_SALT,
 		{ NULL },
 		{ NULL },
 		tests
@@ -399,7 +399,7 @@ struct fmt_main fmt_MD5 = {
 #if MD5_std_mt || defined(SIMD_PARA_MD5)
 		FMT_OMP |
 #endif
-		FMT_CASE | FMT_8_BIT,
+		FMT_CASE | FMT_8_BIT | FMT_FLAT_SALT,
 		{ NULL },
 		{
 			md5_salt_prefix,
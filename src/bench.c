@@ -146,6 +146,7 @@ struct db_main *ldr_init_test_db(struct fmt_main *format, struct db_main *real)
 				format->params.salt_align);
 			current_salt->index = fmt_dummy_hash;
 			current_salt->bitmap = NULL;
+			current_salt->table = NULL;
 			current_salt->list = NULL;
 			current_salt->hash = &current_salt->list;
 			current_salt->hash_size = -1;
@@ -795,11 +796,9 @@ AGAIN:
 		if ((options.flags & FLG_LOOPTEST_CHK) && john_main_process)
 			printf("#%u ", loop_total);
 #endif
-#if defined(HAVE_OPENCL) || defined(HAVE_ZTEX)
+#ifndef BENCH_BUILD
 		int using_int_mask = (format->params.flags & FMT_MASK) && (options.flags & FLG_MASK_CHK) &&
 			options.req_int_cand_target != 0 && mask_int_cand_target;
-#elif !defined(BENCH_BUILD)
-		int using_int_mask = 0;
 #endif
 
 		if (john_main_process)
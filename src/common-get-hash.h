@@ -21,6 +21,11 @@
 #undef COMMON_GET_HASH_LINK
 #endif
 
+#if defined (COMMON_GET_HASH_BATCH_LINK)
+	common_code_get_hashes
+#undef COMMON_GET_HASH_BATCH_LINK
+#endif
+
 #if defined(COMMON_GET_HASH_VAR)
 #if defined(SIMD_COEF_64) && defined(COMMON_GET_HASH_SIMD64)
 #if defined (COMMON_GET_HASH_SIMD_VAR)
@@ -50,6 +55,28 @@ static int common_code_get_hash_3(int index) { return ((uint32_t*)COMMON_GET_HAS
 static int common_code_get_hash_4(int index) { return ((uint32_t*)COMMON_GET_HASH_VAR)[HASH_IDX] & PH_MASK_4; }
 static int common_code_get_hash_5(int index) { return ((uint32_t*)COMMON_GET_HASH_VAR)[HASH_IDX] & PH_MASK_5; }
 static int common_code_get_hash_6(int index) { return ((uint32_t*)COMMON_GET_HASH_VAR)[HASH_IDX] & PH_MASK_6; }
+#if defined(COMMON_GET_HASH_BATCH)
+// the values for SIMD_COEF_32 consecutive indices are adjacent, so this
+// boils down to masked vector copies
+static void common_code_get_hashes(int size, int count, uint32_t *hashes)
+{
+	static const uint32_t masks[] = {
+		PH_MASK_0, PH_MASK_1, PH_MASK_2, PH_MASK_3, PH_MASK_4, PH_MASK_5, PH_MASK_6
+	};
+	const uint32_t *p = (uint32_t*)COMMON_GET_HASH_VAR;
+	uint32_t mask = masks[size];
+	int index, i;
+
+	for (index = 0; index + SIMD_COEF_32 <= count; index += SIMD_COEF_32) {
+		for (i = 0; i < SIMD_COEF_32; i++)
+			hashes[index + i] = p[i] & mask;
+		p += SIMD_COEF_32 * COMMON_GET_HASH_SIMD32;
+	}
+	for (i = 0; index < count; i++, index++)
+		hashes[index] = p[i] & mask;
+}
+#undef COMMON_GET_HASH_BATCH
+#endif
 #else
 	// this code works for 'all' types.  Deref address of element [index], then casing and getting element 0, works 
 	// properly for types such as:
@@ -76,6 +103,22 @@ static int common_code_get_hash_5(int index) { 	return ((uint32_t *)(&(COMMON_GE
 static int common_code_get_hash_6(int index) { 	return ((uint32_t *)(&(COMMON_GET_HASH_VAR[index])))[0] & PH_MASK_6; }
 #endif
 #endif
+#if defined(COMMON_GET_HASH_BATCH)
+// no interleaved layout to take advantage of, so just make it work
+static void common_code_get_hashes(int size, int count, uint32_t *hashes)
+{
+	static int (*const get_hash[])(int index) = {
+		common_code_get_hash_0, common_code_get_hash_1, common_code_get_hash_2,
+		common_code_get_hash_3, common_code_get_hash_4, common_code_get_hash_5,
+		common_code_get_hash_6
+	};
+	int index;
+
+	for (index = 0; index < count; index++)
+		hashes[index] = get_hash[size](index);
+}
+#undef COMMON_GET_HASH_BATCH
+#endif
 #undef COMMON_GET_HASH_VAR
 #undef COMMON_GET_HASH_SIMD64
 #undef COMMON_GET_HASH_SIMD32
@@ -0,0 +1,263 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ */
+
+/*
+ * This include file is CODE.  It gives a SIMD format with interleaved key
+ * buffers the "internal mask" of mask_ext.h, like the OpenCL formats have:
+ * mask mode then calls set_key() once per base key, and the format itself
+ * writes the mask_int_cand.num_int_cand internal candidates into the key
+ * buffer, a block of NBKEYS keys at a time, hashing the block after each.
+ *
+ * Output of crypt_all() grows to num_int_cand blocks per block of keys.
+ * Candidate j of key index is at output index
+ *
+ *   (index / NBKEYS * num_int_cand + j) * NBKEYS + index % NBKEYS
+ *
+ * so the output for a block of keys and one candidate is just where the
+ * format's get_hash() and cmp_one() expect an ordinary block to be.  For a
+ * last, partial block of r keys, the unused lanes are hashed but their output
+ * is dropped: int_mask_count() packs the r real keys of each candidate, so
+ * candidate j of key index in that block is at
+ *
+ *   (index / NBKEYS * num_int_cand) * NBKEYS + j * r + index % NBKEYS
+ *
+ * and the count returned covers real candidates only.
+ *
+ * Requirements: NBKEYS, PLAINTEXT_LENGTH and GETPOS() for the key buffer
+ * (common-simd-getpos.h), a key buffer of 16 words per key, and output words
+ * interleaved by SIMD_COEF_32 as SIMD*body() writes them.  Optional:
+ *
+ *   INT_MASK_UTF16       The key buffer holds UTF-16, so a candidate at
+ *        position i goes to bytes 2i and 2i+1, converted with
+ *        INT_MASK_TO_UNICODE(c) if defined.
+ *
+ *   INT_MASK_TARGET      Internal candidates wanted per base key.  It's a
+ *        trade-off between saved set_key() calls and the size of crypt_all()
+ *        output, which is processed in one go by the cracker.
+ *
+ * The format sets FMT_MASK and calls int_mask_init() from init(), int_mask_set_key() from
+ * set_key(), int_mask_select() from select_keys() if it has one, and
+ * int_mask_reset() from reset().  crypt_all() gets the number of candidates
+ * from int_mask_begin(), calls int_mask_block() before hashing each block
+ * for each candidate and returns int_mask_count(output, count).  get_key() maps its
+ * index with int_mask_key() and puts the candidate into the key it read back
+ * with int_mask_patch().
+ */
+
+#include "mask_ext.h"
+
+#ifndef INT_MASK_TARGET
+#define INT_MASK_TARGET		100
+#endif
+
+/* Positions of the internal placeholders in each key, 0xff if unused */
+static mask_char4 *int_key_loc, *int_key_loc_set, *int_loc_buf[2];
+/* Internal candidates per key in the last crypt_all(), and output room */
+static int int_mask_cands = 1, int_mask_room = 1;
+/* Key blocks in a crypt_all(), and output words per key */
+static int int_mask_blocks, int_mask_words;
+/* Keys in the last crypt_all() */
+static int int_mask_keys;
+
+static void int_mask_init(struct fmt_main *self)
+{
+	int i;
+
+	if (self->params.flags & FMT_MASK)
+		mask_int_cand_target = INT_MASK_TARGET;
+
+	for (i = 0; i < 2; i++)
+		int_loc_buf[i] = mem_calloc(self->params.max_keys_per_crypt,
+		                            sizeof(mask_char4));
+	int_key_loc = int_key_loc_set = int_loc_buf[0];
+	int_mask_cands = int_mask_room = 1;
+	int_mask_blocks = self->params.max_keys_per_crypt / NBKEYS;
+}
+
+static void int_mask_done(void)
+{
+	MEM_FREE(int_loc_buf[0]);
+	MEM_FREE(int_loc_buf[1]);
+}
+
+static MAYBE_INLINE void int_mask_select(int set_slot, int crypt_slot)
+{
+	int_key_loc_set = int_loc_buf[set_slot];
+	int_key_loc = int_loc_buf[crypt_slot];
+}
+
+/*
+ * Grows crypt_all() output, of size bytes per block of keys, to have room for
+ * a block per internal candidate.  Returns the buffer, which is reallocated
+ * (not preserving contents) as needed.
+ */
+static void *int_mask_reset(void *out, size_t size)
+{
+	int n = mask_int_cand.num_int_cand;
+
+	int_mask_words = size / (NBKEYS * 4);
+	if (n > int_mask_room) {
+		MEM_FREE(out);
+		out = mem_calloc_align((size_t)int_mask_blocks * n, size,
+		                       MEM_ALIGN_SIMD);
+		int_mask_room = n;
+	}
+
+	return out;
+}
+
+static MAYBE_INLINE void int_mask_set_key(const char *key, int index)
+{
+	mask_char4 loc;
+	int i, len;
+
+	if (mask_int_cand.num_int_cand <= 1)
+		return;
+
+	loc.i = 0xffffffff;
+	len = strnlen(key, PLAINTEXT_LENGTH);
+	for (i = 0; i < MASK_FMT_INT_PLHDR && mask_skip_ranges[i] != -1; i++) {
+		int pos = mask_int_cand.int_cpu_mask_ctx->
+			ranges[mask_skip_ranges[i]].pos +
+			mask_int_cand.int_cpu_mask_ctx->
+			ranges[mask_skip_ranges[i]].offset;
+
+		if (pos < len)
+			loc.x[i] = pos;
+	}
+	int_key_loc_set[index] = loc;
+}
+
+/* Writes candidate j of key index into the key buffer */
+static MAYBE_INLINE void int_mask_poke(void *keys, int index, int j)
+{
+	unsigned char *buf = keys;
+	const mask_char4 loc = int_key_loc[index];
+	const mask_char4 cand = mask_int_cand.int_cand[j];
+	int i;
+
+	for (i = 0; i < MASK_FMT_INT_PLHDR; i++) {
+		if (loc.x[i] == 0xff)
+			continue;
+#ifdef INT_MASK_UTF16
+#ifdef INT_MASK_TO_UNICODE
+		unsigned int c = INT_MASK_TO_UNICODE(cand.x[i]);
+#else
+		unsigned int c = cand.x[i];
+#endif
+		buf[GETPOS(2 * loc.x[i], index)] = c;
+		buf[GETPOS(2 * loc.x[i] + 1, index)] = c >> 8;
+#else
+		buf[GETPOS(loc.x[i], index)] = cand.x[i];
+#endif
+	}
+}
+
+/*
+ * Returns the number of internal candidates for crypt_all() of count keys.
+ * Without a reset() since the internal mask changed (as when OpenMP autotune
+ * runs crypt_all()), that's capped to what the output has room for.
+ */
+static int int_mask_begin(int count)
+{
+	int_mask_cands = mask_int_cand.num_int_cand > 1 ?
+		MIN(mask_int_cand.num_int_cand, int_mask_room) : 1;
+	int_mask_keys = count;
+
+	return int_mask_cands;
+}
+
+/* Writes candidate j of all keys in a block into the key buffer */
+static MAYBE_INLINE void int_mask_block(void *keys, int block, int j)
+{
+	int index;
+
+	if (int_mask_cands == 1)
+		return;
+
+	for (index = block * NBKEYS; index < (block + 1) * NBKEYS; index++)
+		int_mask_poke(keys, index, j);
+}
+
+/* Word w of output index in crypt_all() output */
+#define INT_MASK_OUT(index, w) \
+	(((index) / SIMD_COEF_32 * int_mask_words + (w)) * SIMD_COEF_32 + \
+	 (index) % SIMD_COEF_32)
+
+/*
+ * Returns the number of candidates crypt_all() computed for count keys.  The
+ * output of a last, partial block is packed to leave out the unused lanes,
+ * so that they're neither counted nor compared.
+ */
+static int int_mask_count(void *output, int count)
+{
+	uint32_t *out = output;
+	int full, r, base, j, lane, w;
+
+	if (int_mask_cands == 1)
+		return count;
+
+	full = count / NBKEYS;
+	r = count % NBKEYS;
+	base = full * int_mask_cands * NBKEYS;
+
+	/* Ascending, so nothing is overwritten before it's moved */
+	for (j = 1; r && j < int_mask_cands; j++)
+	for (lane = 0; lane < r; lane++)
+	for (w = 0; w < int_mask_words; w++)
+		out[INT_MASK_OUT(base + j * r + lane, w)] =
+			out[INT_MASK_OUT(base + j * NBKEYS + lane, w)];
+
+	return base + r * int_mask_cands;
+}
+
+/*
+ * Maps an output index of crypt_all() to its key index, and the candidate
+ * number to *cand (-1 if there are no internal candidates).
+ */
+static MAYBE_INLINE int int_mask_key(int index, int *cand)
+{
+	int block, base, r;
+
+	if (int_mask_cands == 1) {
+		*cand = -1;
+		return index;
+	}
+
+	base = int_mask_keys / NBKEYS * NBKEYS;
+	r = int_mask_keys - base;
+	if (r && index >= base * int_mask_cands) {
+		index -= base * int_mask_cands;
+		*cand = index / r;
+		return base + index % r;
+	}
+
+	block = index / NBKEYS / int_mask_cands;
+	*cand = index / NBKEYS % int_mask_cands;
+
+	return block * NBKEYS + index % NBKEYS;
+}
+
+/*
+ * Puts candidate cand into key, as read back from the key buffer for key
+ * index.  The key buffer itself is left alone, as crypt_all() might be
+ * running on it.
+ */
+static char *int_mask_patch(char *key, int index, int cand)
+{
+	const mask_char4 loc = int_key_loc[index];
+	int i;
+
+	if (cand < 0)
+		return key;
+
+	for (i = 0; i < MASK_FMT_INT_PLHDR; i++)
+		if (loc.x[i] != 0xff)
+			key[loc.x[i]] = mask_int_cand.int_cand[cand].x[i];
+
+	return key;
+}
@@ -0,0 +1,237 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ */
+
+/*
+ * This include file is CODE.  It adds an opt-in "meet in the middle" to an
+ * unsalted MD4 or MD5 SIMD format with internal mask (common-simd-intmask.h),
+ * for when only a few hashes are loaded.
+ *
+ * The internal candidates of a base key only differ in one or a few words of
+ * the message block, so the last steps of the last round that don't use any
+ * of those words are the same for all of them.  For each base key, those
+ * steps are reversed from each loaded hash, and the SIMD code stops short of
+ * them (SSEi_EARLY_STEPS) and compares the state it got against that.  Then
+ * the (exact) matches get the loaded binary as their output, so get_hash(),
+ * cmp_all() and cmp_one() work unchanged, while others get an intermediate
+ * state that matches as often as any random one would.
+ *
+ * MeetInTheMiddle in john.conf [Mask] is the largest number of hashes to use
+ * it with (0 for never).  Per hash, it costs about as much as it saves, so
+ * the default is to use it with just one.
+ *
+ * Requirements: MITM_MD4 or MITM_MD5, and MITM_UNREVERSE(hash) that turns
+ * a copy of binary() back into the digest.  The output of the SIMD function
+ * is the usual 4 words per key.
+ *
+ * The format calls mitm_init() from init() after int_mask_init(), and
+ * mitm_done() from done().  crypt_all() gets the number of last round steps
+ * to do from mitm_begin() after int_mask_begin(), and if non-zero, calls
+ * mitm_block() for each block of keys and passes SSEi_EARLY_STEPS(steps) to
+ * the SIMD function, then mitm_check() on its output.
+ */
+
+#include "config.h"
+
+#define MITM_MAX_HASHES		16
+#define MITM_DEFAULT_HASHES	1
+
+#ifdef MITM_MD5
+/* Message words used by the steps of the last round */
+static const unsigned char mitm_x[16] =
+	{ 0, 7, 14, 5, 12, 3, 10, 1, 8, 15, 6, 13, 4, 11, 2, 9 };
+static const uint32_t mitm_t[16] = {
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+	0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+#define MITM_S0 6
+#define MITM_S1 10
+#define MITM_S2 15
+#define MITM_S3 21
+/* SSEi_REVERSE_STEPS already skips the last three steps */
+#define MITM_MAX_STEPS		12
+#else
+static const unsigned char mitm_x[16] =
+	{ 0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15 };
+#define MITM_S0 3
+#define MITM_S1 9
+#define MITM_S2 11
+#define MITM_S3 15
+/* SSEi_REVERSE_STEPS already skips four and a half */
+#define MITM_MAX_STEPS		10
+#endif
+
+static const uint32_t mitm_iv[4] =
+	{ 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+
+/* Loaded hashes as state after all steps, and as binary() */
+static uint32_t mitm_state[MITM_MAX_HASHES][4];
+static uint32_t mitm_binary[MITM_MAX_HASHES][4];
+static int mitm_hashes, mitm_max, mitm_steps, mitm_keys;
+/* Per hash, the state each key should have after mitm_steps steps */
+static uint32_t *mitm_target;
+
+static void mitm_init(struct fmt_main *self)
+{
+	mitm_max = cfg_get_int("Mask", NULL, "MeetInTheMiddle");
+	if (mitm_max < 0)
+		mitm_max = MITM_DEFAULT_HASHES;
+	if (!(self->params.flags & FMT_MASK) || !mitm_max) {
+		mitm_max = 0;
+		return;
+	}
+	mitm_max = MIN(mitm_max, MITM_MAX_HASHES);
+	mitm_keys = self->params.max_keys_per_crypt;
+	mitm_target = mem_calloc_align((size_t)mitm_max * mitm_keys * 4,
+	                               sizeof(uint32_t), MEM_ALIGN_SIMD);
+}
+
+static void mitm_done(void)
+{
+	MEM_FREE(mitm_target);
+}
+
+/*
+ * Returns the number of last round steps to do for count keys against
+ * salt's hashes, or 0 for not using meet-in-the-middle.
+ */
+static int mitm_begin(struct db_salt *salt, int count)
+{
+	struct db_password *pw;
+	uint32_t words = 0;
+	int index, i, h;
+
+	mitm_steps = 0;
+	if (!mitm_max || int_mask_cands == 1 || !salt ||
+	    salt->count > mitm_max)
+		return 0;
+
+	count = (count + NBKEYS - 1) / NBKEYS * NBKEYS;
+	for (index = 0; index < count; index++)
+		for (i = 0; i < MASK_FMT_INT_PLHDR; i++)
+			if (int_key_loc[index].x[i] != 0xff)
+#ifdef INT_MASK_UTF16
+				words |= 1U << (int_key_loc[index].x[i] / 2);
+#else
+				words |= 1U << (int_key_loc[index].x[i] / 4);
+#endif
+
+	for (i = 0; i < 16; i++)
+		if (words & (1U << mitm_x[i]))
+			mitm_steps = i + 1;
+	if (!mitm_steps || mitm_steps > MITM_MAX_STEPS) {
+		mitm_steps = 0;
+		return 0;
+	}
+
+	for (pw = salt->list, h = 0; pw; pw = pw->next, h++) {
+		memcpy(mitm_binary[h], pw->binary, sizeof(mitm_binary[h]));
+		memcpy(mitm_state[h], pw->binary, sizeof(mitm_state[h]));
+		MITM_UNREVERSE(mitm_state[h]);
+		for (i = 0; i < 4; i++)
+			mitm_state[h][i] -= mitm_iv[i];
+	}
+	mitm_hashes = h;
+
+	return mitm_steps;
+}
+
+/* Undoes a last round step of a, as done with b, c, d, m and t */
+#ifdef MITM_MD5
+#define MITM_UNSTEP(a, b, c, d, s)	  \
+	a = vsub_epi32(vsub_epi32(vroti_epi32(vsub_epi32(a, b), -(s)), \
+	                          vxor(c, vor(b, vxor(d, ones)))), \
+	               vadd_epi32(m, t))
+#else
+#define MITM_UNSTEP(a, b, c, d, s)	  \
+	a = vsub_epi32(vsub_epi32(vroti_epi32(a, -(s)), \
+	                          vxor(vxor(b, c), d)), \
+	               vadd_epi32(m, t))
+#endif
+
+/* Reverses the steps after mitm_steps for the keys in a block */
+static void mitm_block(void *keys, int block)
+{
+	const vtype *x = keys;
+#ifdef MITM_MD5
+	const vtype ones = vset1_epi32(0xffffffff);
+#else
+	const vtype t = vset1_epi32(0x6ed9eba1);
+#endif
+	int v, h, k;
+
+	for (h = 0; h < mitm_hashes; h++)
+	for (v = block * NBKEYS / SIMD_COEF_32;
+	     v < (block + 1) * NBKEYS / SIMD_COEF_32; v++) {
+		vtype *target = (vtype*)&mitm_target[(size_t)h * mitm_keys * 4];
+		vtype a = vset1_epi32(mitm_state[h][0]);
+		vtype b = vset1_epi32(mitm_state[h][1]);
+		vtype c = vset1_epi32(mitm_state[h][2]);
+		vtype d = vset1_epi32(mitm_state[h][3]);
+
+		for (k = 15; k >= mitm_steps; k--) {
+			const vtype m = vload(&x[v * 16 + mitm_x[k]]);
+#ifdef MITM_MD5
+			const vtype t = vset1_epi32(mitm_t[k]);
+#endif
+
+			switch (k % 4) {
+			case 0:
+				MITM_UNSTEP(a, b, c, d, MITM_S0);
+				break;
+			case 1:
+				MITM_UNSTEP(d, a, b, c, MITM_S1);
+				break;
+			case 2:
+				MITM_UNSTEP(c, d, a, b, MITM_S2);
+				break;
+			default:
+				MITM_UNSTEP(b, c, d, a, MITM_S3);
+			}
+		}
+		vstore(&target[v * 4 + 0], a);
+		vstore(&target[v * 4 + 1], b);
+		vstore(&target[v * 4 + 2], c);
+		vstore(&target[v * 4 + 3], d);
+	}
+}
+
+/*
+ * Checks the output of a block of keys, and replaces the state of the ones
+ * that met a hash with its binary.
+ */
+static void mitm_check(uint32_t *out, int block)
+{
+	int v, h, k;
+
+	for (h = 0; h < mitm_hashes; h++) {
+		const uint32_t *target = &mitm_target[(size_t)h * mitm_keys * 4 +
+		                                      block * NBKEYS * 4];
+
+		for (v = 0; v < NBKEYS / SIMD_COEF_32; v++) {
+			uint32_t *o = &out[v * 4 * SIMD_COEF_32];
+			const uint32_t *t = &target[v * 4 * SIMD_COEF_32];
+			int lane;
+
+			if (!vanyeq_epi32(vload((vtype*)o), vload((vtype*)t)))
+				continue;
+
+			for (lane = 0; lane < SIMD_COEF_32; lane++) {
+				for (k = 0; k < 4; k++)
+					if (o[k * SIMD_COEF_32 + lane] !=
+					    t[k * SIMD_COEF_32 + lane])
+						break;
+				if (k < 4)
+					continue;
+				for (k = 0; k < 4; k++)
+					o[k * SIMD_COEF_32 + lane] =
+						mitm_binary[h][k];
+			}
+		}
+	}
+}
@@ -72,8 +72,21 @@
  *        In a non-simd mode, there is only 1 saved_key variable (not
  *        an array of them).
  *
+ * SET_KEY_BUFFER         Define to the buffer set_key() should write to,
+ *        if other than saved_key (and SET_KEY_LENGTHS likewise for
+ *        saved_len).  get_key() still reads saved_key and saved_len.
+ *        This is for formats double-buffering their keys (see
+ *        select_keys() in formats.h).
+ *
  */
 
+#ifndef SET_KEY_BUFFER
+#define SET_KEY_BUFFER saved_key
+#endif
+#ifndef SET_KEY_LENGTHS
+#define SET_KEY_LENGTHS saved_len
+#endif
+
 #if defined(SIMD_COEF_32)
 
 #if !defined SALT_APPENDED
@@ -109,7 +122,7 @@ static void set_key(char *_key, int index)
 	const uint32_t *key = (uint32_t*)(is_aligned(_key, sizeof(uint32_t)) ?
 	                                      _key : strcpy(buf_aligned, _key));
 #endif
-	uint32_t *keybuffer = &((uint32_t*)saved_key)[GETPOSW32(0,index)];
+	uint32_t *keybuffer = &((uint32_t*)SET_KEY_BUFFER)[GETPOSW32(0,index)];
 	uint32_t *keybuf_word = keybuffer;
 	unsigned int len=0;
 	uint32_t temp;
@@ -189,19 +202,19 @@ key_cleaning:
 		keybuf_word += SIMD_COEF_32;
 	}
 #if defined (INCLUDE_TRAILING_NULL)
-	((unsigned char*)saved_key)[GETPOS(len,index)] = 0;
+	((unsigned char*)SET_KEY_BUFFER)[GETPOS(len,index)] = 0;
 	++len; /* Trailing null is included */
-	((unsigned char*)saved_key)[GETPOS(len,index)] = 0x80;
+	((unsigned char*)SET_KEY_BUFFER)[GETPOS(len,index)] = 0x80;
 #endif
 
 #if defined(SET_SAVED_LEN)
 	// some formats append salt, so need length, and outputting the length to
 	// uint32[14] is worthless.
-	saved_len[index] = len;
+	SET_KEY_LENGTHS[index] = len;
 #else
 #if SALT_APPENDED
 	len += SALT_APPENDED;
-	((unsigned char*)saved_key)[GETPOS(len,index)] = 0x80;
+	((unsigned char*)SET_KEY_BUFFER)[GETPOS(len,index)] = 0x80;
 #endif
 
 	// Normal key setting, set the bit length since we know it.
@@ -222,9 +235,9 @@ static void set_key(char *key, int index)
 	strnzcpyn(saved_key, key, sizeof(saved_key));
 #else
 #  if defined(SET_SAVED_LEN) || defined (NON_SIMD_SET_SAVED_LEN)
-	saved_len[index] =
+	SET_KEY_LENGTHS[index] =
 #  endif
-	strnzcpyn(saved_key[index], key, sizeof(*saved_key));
+	strnzcpyn(SET_KEY_BUFFER[index], key, sizeof(*SET_KEY_BUFFER));
 #endif
 }
 #endif  // SIMD_COEF_32
@@ -6,9 +6,11 @@
  */
 
 #define NEED_OS_TIMER
+#define NEED_OS_FORK
 #include "os.h"
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
@@ -29,6 +31,12 @@
 #if _MSC_VER || HAVE_IO_H
 #include <io.h> // open()
 #endif
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "arch.h"
 #include "params.h"
@@ -37,8 +45,12 @@
 #if CRK_PREFETCH && defined(__SSE__)
 #include <xmmintrin.h>
 #endif
+#if CRK_PREFETCH && (defined(__AVX2__) || defined(__AVX512F__))
+#include <immintrin.h>
+#endif
 
 #include "misc.h"
+#include "mem_map.h"
 #include "memory.h"
 #include "signals.h"
 #include "idle.h"
@@ -66,6 +78,7 @@
 #include "gpu_common.h"
 #endif
 #include "rules.h"
+#include "suppressor.h"
 #include "tty.h"
 
 #ifdef index
@@ -85,6 +98,11 @@ static unsigned int crk_prefetch;
 #define crk_prefetch CRK_PREFETCH
 #endif
 #endif
+#if CRK_PREFETCH
+/* get_hashes() outputs and bitmap hits for crk_process_results_batch() */
+static uint32_t *crk_batch_hashes;
+static unsigned int *crk_batch_lucky, crk_batch_size;
+#endif
 static int crk_key_index, crk_last_key;
 static void *crk_last_salt;
 static struct db_keys *crk_guesses;
@@ -92,6 +110,10 @@ static uint64_t *crk_timestamps;
 static char crk_stdout_key[PLAINTEXT_BUFFER_SIZE];
 static int kpc_warn, kpc_warn_limit, single_running;
 static fix_state_fp hybrid_fix_state;
+static enum { SCHEDULE_NONE, SCHEDULE_COUNT, SCHEDULE_YIELD } crk_schedule;
+static int crk_schedule_passwords;
+/* Salts in list order, and those out of order, for crk_schedule_salts() */
+static struct db_salt **crk_schedule_order, **crk_schedule_moved;
 
 int crk_stacked_rule_count = 1;
 rule_stack crk_rule_stack;
@@ -102,6 +124,152 @@ void (*crk_fix_state)(void);
 int (*crk_process_key)(char *key);
 
 static int process_key_stack_rules(char *key);
+static int crk_process_results(struct db_salt *salt, unsigned int match);
+static int crk_process_event(void);
+
+#if HAVE_PTHREAD
+/*
+ * Double-buffered keys: for a single salt and a format having select_keys(),
+ * crypt_all() for a complete batch runs in a helper thread while the cracking
+ * mode already fills the format's other key buffer.  The results of a batch
+ * are processed by crk_async_wait() in the main thread before the next batch
+ * is started, so guesses, events and pot syncs stay single-threaded.  The
+ * recovery state is only ever saved after such a wait, so it never covers a
+ * batch not yet checked.
+ */
+static struct {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	enum { ASYNC_IDLE, ASYNC_RUN, ASYNC_DONE, ASYNC_EXIT } state;
+	struct db_salt *salt;
+	int count, match;
+	int slot;	/* key buffer currently filled by set_key() */
+	int active, busy;
+} crk_async;
+
+static void *crk_async_thread(void *arg)
+{
+	pthread_mutex_lock(&crk_async.mutex);
+	while (1) {
+		while (crk_async.state == ASYNC_IDLE ||
+		       crk_async.state == ASYNC_DONE)
+			pthread_cond_wait(&crk_async.cond, &crk_async.mutex);
+		if (crk_async.state == ASYNC_EXIT)
+			break;
+		pthread_mutex_unlock(&crk_async.mutex);
+
+		crk_async.match =
+			crk_methods.crypt_all(&crk_async.count, crk_async.salt);
+
+		pthread_mutex_lock(&crk_async.mutex);
+		crk_async.state = ASYNC_DONE;
+		pthread_cond_broadcast(&crk_async.cond);
+	}
+	pthread_mutex_unlock(&crk_async.mutex);
+
+	return NULL;
+}
+
+static void crk_async_init(struct db_main *db)
+{
+	sigset_t all, old;
+
+	crk_async.active = crk_async.busy = 0;
+
+	if (!db->loaded || !crk_methods.select_keys || db->salt_count != 1 ||
+	    (options.flags & FLG_SINGLE_CHK) ||
+	    !cfg_get_bool(SECTION_OPTIONS, NULL, "DoubleBufferKeys", 1))
+		return;
+
+	pthread_mutex_init(&crk_async.mutex, NULL);
+	pthread_cond_init(&crk_async.cond, NULL);
+	crk_async.state = ASYNC_IDLE;
+
+/* Signals are for the main thread only */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	if (pthread_create(&crk_async.thread, NULL, crk_async_thread, NULL)) {
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		log_event("! Can't create thread for double-buffered keys");
+		return;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	crk_async.slot = 0;
+	crk_methods.select_keys(0, 0);
+	crk_async.active = 1;
+
+	log_event("- Keys will be double-buffered, overlapping set_key() with crypt_all()");
+}
+
+/*
+ * Hands the keys just set to crypt_all() in the helper thread, and switches
+ * set_key() over to the other buffer.
+ */
+static void crk_async_start(struct db_salt *salt, int count)
+{
+	crk_methods.select_keys(crk_async.slot ^ 1, crk_async.slot);
+	crk_async.slot ^= 1;
+
+	pthread_mutex_lock(&crk_async.mutex);
+	crk_async.salt = salt;
+	crk_async.count = count;
+	crk_async.state = ASYNC_RUN;
+	crk_async.busy = 1;
+	pthread_cond_broadcast(&crk_async.cond);
+	pthread_mutex_unlock(&crk_async.mutex);
+}
+
+/*
+ * Waits for the batch in flight, if any, and checks its results.  Returns
+ * non-zero if there's nothing left to crack.
+ */
+static int crk_async_wait(void)
+{
+	if (!crk_async.busy)
+		return 0;
+
+	pthread_mutex_lock(&crk_async.mutex);
+	while (crk_async.state != ASYNC_DONE)
+		pthread_cond_wait(&crk_async.cond, &crk_async.mutex);
+	crk_async.state = ASYNC_IDLE;
+	pthread_mutex_unlock(&crk_async.mutex);
+	crk_async.busy = 0;
+
+	crk_last_key = crk_async.count;
+	status_update_crypts((uint64_t)crk_async.salt->count * crk_async.count,
+	                     crk_async.count);
+
+	if (!crk_db->salts)
+		return 1;
+
+	return crk_process_results(crk_async.salt, crk_async.match);
+}
+
+static void crk_async_done(void)
+{
+	if (!crk_async.active)
+		return;
+
+	crk_async_wait();
+
+	pthread_mutex_lock(&crk_async.mutex);
+	crk_async.state = ASYNC_EXIT;
+	pthread_cond_broadcast(&crk_async.cond);
+	pthread_mutex_unlock(&crk_async.mutex);
+	pthread_join(crk_async.thread, NULL);
+
+	pthread_cond_destroy(&crk_async.cond);
+	pthread_mutex_destroy(&crk_async.mutex);
+
+/* Leave the format single-buffered, with the keys last crypted */
+	crk_methods.select_keys(crk_async.slot ^ 1, crk_async.slot ^ 1);
+	crk_async.active = 0;
+}
+#else
+#define crk_async_wait()	0
+#endif
 
 /* Expose max_keys_per_crypt to the world (needed in recovery.c) */
 int crk_max_keys_per_crypt(void)
@@ -130,6 +298,232 @@ static void crk_init_salt(void)
 	}
 }
 
+#if HAVE_PTHREAD
+/*
+ * Salt threads: for a format declaring FMT_REENTRANT, a batch of keys is
+ * hashed for several salts at once by a pool of threads, each having its own
+ * copy of the format's state other than the keys.  Salts are handed out in
+ * order and the results are checked under the pool's mutex, so that
+ * crk_process_results() and everything it calls still sees one salt at a
+ * time.  Events are only processed by the main thread, between batches.  The
+ * threads are created on first use and kept for the rest of the session, so
+ * formats may allocate their per-thread buffers on first use too.
+ */
+static struct {
+	pthread_t *threads;
+	int created;		/* threads in the pool */
+	int active;		/* in use for the current database */
+	pthread_mutex_t mutex;
+	pthread_cond_t start, finished;
+	unsigned int batch;
+	struct db_salt **salts;
+	int salt_count, next, running, keys, done;
+	struct db_salt *stop;
+} crk_pool;
+
+/*
+ * Takes salts from the current batch until there are no more, called and
+ * returning with the mutex locked.
+ */
+static void crk_pool_work(void)
+{
+	while (!crk_pool.done && !event_abort &&
+	       crk_pool.next < crk_pool.salt_count) {
+		struct db_salt *salt = crk_pool.salts[crk_pool.next++];
+		int count = crk_pool.keys;
+		int match;
+
+		if (!salt->count)	/* got rid of while in this batch */
+			continue;
+
+		crk_pool.running++;
+		pthread_mutex_unlock(&crk_pool.mutex);
+
+		crk_db->format->methods.set_salt(salt->salt);
+		match = crk_methods.crypt_all(&count, salt);
+
+		pthread_mutex_lock(&crk_pool.mutex);
+		crk_pool.running--;
+
+		if (crk_pool.done)
+			continue;
+
+		crk_last_key = count;
+		status_update_crypts((uint64_t)salt->count * count, count);
+
+		if (crk_process_results(salt, match)) {
+			crk_pool.done = 1;
+			crk_pool.stop = salt;
+		}
+	}
+
+	if (!crk_pool.running)
+		pthread_cond_broadcast(&crk_pool.finished);
+}
+
+static void *crk_pool_thread(void *arg)
+{
+	unsigned int batch = 0;
+
+#ifdef _OPENMP
+/* We're the parallelism here, so don't have crypt_all() add its own */
+	omp_set_num_threads(1);
+#endif
+
+	pthread_mutex_lock(&crk_pool.mutex);
+	while (1) {
+		while (crk_pool.batch == batch)
+			pthread_cond_wait(&crk_pool.start, &crk_pool.mutex);
+		batch = crk_pool.batch;
+		crk_pool_work();
+	}
+
+	return NULL;
+}
+
+static void crk_pool_init(struct db_main *db)
+{
+	sigset_t all, old;
+	int threads;
+
+	crk_pool.active = 0;
+
+	if (!db->loaded || db->salt_count < 2 ||
+	    !(db->format->params.flags & FMT_REENTRANT) ||
+	    (options.flags & FLG_SINGLE_CHK))
+		return;
+
+	threads = cfg_get_int(SECTION_OPTIONS, NULL, "SaltThreads");
+	if (threads == 0) {
+#ifdef _OPENMP
+		threads = omp_get_max_threads();
+#else
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	}
+	if (threads > db->salt_count)
+		threads = db->salt_count;
+	if (threads < 2)
+		return;
+
+	if (!crk_pool.created) {
+		pthread_mutex_init(&crk_pool.mutex, NULL);
+		pthread_cond_init(&crk_pool.start, NULL);
+		pthread_cond_init(&crk_pool.finished, NULL);
+	}
+
+	if (threads > crk_pool.created) {
+		crk_pool.threads = mem_realloc(crk_pool.threads,
+		    threads * sizeof(*crk_pool.threads));
+
+/* Signals are for the main thread only */
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &old);
+		while (crk_pool.created < threads &&
+		       !pthread_create(&crk_pool.threads[crk_pool.created],
+		                       NULL, crk_pool_thread, NULL))
+			crk_pool.created++;
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+		if (crk_pool.created < 2) {
+			log_event("! Can't create threads for salts");
+			return;
+		}
+	}
+
+	crk_pool.salts = mem_alloc(db->salt_count * sizeof(*crk_pool.salts));
+	crk_pool.active = 1;
+
+	log_event("- %d threads will hash different salts at once",
+	          crk_pool.created < threads ? crk_pool.created : threads);
+}
+
+/*
+ * Runs the keys buffered against all salts from the one given to the end of
+ * the list.  Returns the salt we stopped at, or NULL if we got through them
+ * all, with *done like from crk_password_loop().
+ */
+static struct db_salt *crk_pool_run(struct db_salt *salt, int *done)
+{
+	struct db_salt *stop;
+	int i, started;
+
+#if !OS_TIMER
+	sig_timer_emu_tick();
+#endif
+
+	idle_yield();
+
+	status.resume_salt_md5 = salt->salt_md5;
+
+	if (event_pending && crk_process_event()) {
+		*done = -1;
+		return salt;
+	}
+
+	if (hybrid_fix_state)
+		hybrid_fix_state();
+
+	pthread_mutex_lock(&crk_pool.mutex);
+
+	crk_pool.salt_count = 0;
+	do {
+		crk_pool.salts[crk_pool.salt_count++] = salt;
+	} while ((salt = salt->next));
+	crk_pool.next = crk_pool.done = 0;
+	crk_pool.keys = crk_key_index;
+	crk_pool.stop = NULL;
+
+	crk_pool.batch++;
+	pthread_cond_broadcast(&crk_pool.start);
+
+	while (crk_pool.running || (!crk_pool.done && !event_abort &&
+	       crk_pool.next < crk_pool.salt_count))
+		pthread_cond_wait(&crk_pool.finished, &crk_pool.mutex);
+
+	if (crk_pool.done) {
+		*done = 1;
+		stop = crk_pool.stop;
+	} else if (crk_pool.next < crk_pool.salt_count) {
+/* All salts before this one were completed */
+		*done = -1;
+		stop = crk_pool.salts[crk_pool.next];
+		status.resume_salt_md5 = stop->salt_md5;
+	} else {
+		*done = 0;
+		stop = NULL;
+	}
+
+	started = crk_pool.next;
+	pthread_mutex_unlock(&crk_pool.mutex);
+
+/*
+ * The threads are idle until the next batch, so the hash tables of salts
+ * that got cracks can be shrunk without holding up the others.
+ */
+	for (i = 0; i < started; i++) {
+		salt = crk_pool.salts[i];
+		if (salt->count && salt->hash_size > 0 &&
+		    salt->count < password_hash_thresholds[salt->hash_size] / 2)
+			ldr_shrink_hash(crk_db, salt);
+	}
+
+/* Had we got down to one salt, crk_init_salt() set it in a pool thread */
+	if (crk_methods.set_salt == crk_dummy_set_salt && crk_db->salts)
+		crk_db->format->methods.set_salt(crk_db->salts->salt);
+
+	return stop;
+}
+
+static void crk_pool_done(void)
+{
+	if (crk_pool.active) {
+		MEM_FREE(crk_pool.salts);
+		crk_pool.active = 0;
+	}
+}
+#endif
+
 static void crk_help(void)
 {
 	static int printed = 0;
@@ -227,11 +621,57 @@ void crk_init(struct db_main *db, void (*fix_state)(void),
 
 	crk_guesses = guesses;
 
+	crk_schedule = SCHEDULE_NONE;
+	if (options.salt_schedule && db->loaded && db->salt_count > 1 &&
+	    !guesses) {
+		if (!strcmp(options.salt_schedule, "count"))
+			crk_schedule = SCHEDULE_COUNT;
+		else if (!strcmp(options.salt_schedule, "yield"))
+			crk_schedule = SCHEDULE_YIELD;
+	}
+	if (crk_schedule) {
+		crk_schedule_passwords = -1;
+		MEM_FREE(crk_schedule_order);
+		crk_schedule_order = mem_alloc(2 * db->salt_count *
+		    sizeof(*crk_schedule_order));
+		crk_schedule_moved = crk_schedule_order + db->salt_count;
+		log_event("- Salts will be scheduled by %s",
+		    crk_schedule == SCHEDULE_YIELD ?
+		    "remaining hashes per cost" : "remaining hashes");
+/*
+ * The order at the time a session was saved may be different from ours, so
+ * we can't skip to the salt we were at.  Redo that batch for all salts.
+ */
+		if (status.resume_salt) {
+			status.resume_salt = 0;
+			log_event("- Not resuming at a salt, as they're scheduled");
+		}
+	}
+
+#if CRK_POT_SYNC
+/* Different database, e.g. after "single crack" mode, so see all of the log */
+	crk_sync_pos = 0;
+#endif
+
+#if HAVE_PTHREAD
+	crk_async_init(db);
+	crk_pool_init(db);
+#endif
+
 	kpc_warn = crk_params->min_keys_per_crypt;
 
 	if (db->loaded) {
 		size = crk_params->max_keys_per_crypt * sizeof(uint64_t);
 		memset(crk_timestamps = mem_alloc(size), -1, size);
+#if CRK_PREFETCH
+		if (crk_methods.get_hashes) {
+			crk_batch_size = crk_params->max_keys_per_crypt;
+			crk_batch_hashes = mem_alloc(crk_batch_size *
+			    sizeof(*crk_batch_hashes));
+			crk_batch_lucky = mem_alloc(crk_batch_size *
+			    sizeof(*crk_batch_lucky));
+		}
+#endif
 	} else
 		crk_stdout_key[0] = 0;
 
@@ -344,24 +784,41 @@ static void crk_remove_hash(struct db_salt *salt, struct db_password *pw)
 
 	hash = crk_db->format->methods.binary_hash[salt->hash_size](pw->binary);
 	count = 0;
-	start = current = &salt->hash[hash >> PASSWORD_HASH_SHR];
-	do {
-		if (crk_db->format->methods.binary_hash[salt->hash_size]
-		    ((*current)->binary) == hash)
-			count++;
-		if (*current == pw) {
+
+	if (salt->table) {
+		int pos = -1;
+
+		while ((pos = hashtab_next(salt->table, salt->table_mask,
+		    hash, pos)) >= 0)
+			if (HASHTAB_PTR(salt->table, pos) == pw)
+				break;
+
+		assert(pos >= 0);
+
+		hashtab_remove(salt->table, salt->table_mask, pos);
+		count = 1 + (hashtab_next(salt->table, salt->table_mask,
+		    hash, -1) >= 0);
+	} else {
+		start = current = &salt->hash[hash >> PASSWORD_HASH_SHR];
+		do {
+			if (crk_db->format->methods.binary_hash[salt->hash_size]
+			    ((*current)->binary) == hash)
+				count++;
+			if (*current == pw) {
 /*
  * If we can, skip the write to hash table to avoid unnecessary page
  * copy-on-write when running with "--fork".  We can do this when we're about
  * to remove this entry from the bitmap, which we'd be checking first.
  */
-			if (count == 1 && current == start && !pw->next_hash)
-				break;
-			*current = pw->next_hash;
-		} else {
-			current = &(*current)->next_hash;
-		}
-	} while (*current);
+				if (count == 1 && current == start &&
+				    !pw->next_hash)
+					break;
+				*current = pw->next_hash;
+			} else {
+				current = &(*current)->next_hash;
+			}
+		} while (*current);
+	}
 
 	assert(count >= 1);
 
@@ -386,6 +843,112 @@ static void crk_remove_hash(struct db_salt *salt, struct db_password *pw)
 		pw->binary = NULL;
 }
 
+#if OS_FORK && HAVE_MMAP && defined(MAP_ANON) && defined(__GNUC__)
+#define CRK_POT_SYNC			1
+
+/*
+ * Log of hashes cracked by any of the "--fork" processes, in shared memory
+ * set up before fork(), so that the others can drop them without re-reading
+ * the pot file.  Space is reserved atomically and an entry is published by
+ * storing its length last, so readers stop at the first incomplete entry.
+ * When the log fills up, we're back to syncing through the pot file only.
+ */
+struct crk_sync_log {
+	volatile size_t head;
+	volatile int overflow;
+	size_t size;
+	char data[1];
+};
+
+struct crk_sync_entry {
+	volatile uint32_t length;
+	uint32_t node;
+	char ciphertext[1];
+};
+
+#define CRK_SYNC_ENTRY_SIZE(length) \
+	((offsetof(struct crk_sync_entry, ciphertext) + (length) + 1 + 7) & ~7)
+
+static struct crk_sync_log *crk_sync_log;
+static size_t crk_sync_pos;
+
+void crk_pot_sync_init(void)
+{
+	struct crk_sync_log *log;
+	size_t size = (size_t)cfg_get_int(SECTION_OPTIONS, NULL,
+	    "PotSyncLogSize");
+
+	if (size == (size_t)-1)
+		size = 64;
+	if (!size || !options.fork)
+		return;
+	size <<= 20;
+
+	log = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED
+#ifdef MAP_NORESERVE
+	    | MAP_NORESERVE
+#endif
+	    , -1, 0);
+	if (log == MAP_FAILED) {
+		log_event("! Can't map %u MiB for pot sync log: %s",
+		    (unsigned int)(size >> 20), strerror(errno));
+		return;
+	}
+
+	log->size = size - offsetof(struct crk_sync_log, data);
+	crk_sync_log = log;
+	log_event("- Pot sync log of %u MiB shared by forked processes",
+	    (unsigned int)(size >> 20));
+}
+
+int crk_pot_sync_shared(void)
+{
+	return crk_sync_log && !crk_sync_log->overflow;
+}
+
+static void crk_pot_sync_add(const char *ciphertext)
+{
+	struct crk_sync_log *log = crk_sync_log;
+	struct crk_sync_entry *entry;
+	size_t length = strlen(ciphertext);
+	size_t size = CRK_SYNC_ENTRY_SIZE(length);
+	size_t pos;
+
+	if (!log || log->overflow)
+		return;
+
+	pos = __sync_fetch_and_add(&log->head, size);
+	if (pos + size > log->size) {
+		log->overflow = 1;
+		log_event("Pot sync log full, syncing through pot file only");
+		return;
+	}
+
+	entry = (struct crk_sync_entry *)&log->data[pos];
+	entry->node = options.node_min;
+	memcpy(entry->ciphertext, ciphertext, length + 1);
+	__sync_synchronize();
+	entry->length = length;
+}
+
+static int crk_pot_sync_pending(void)
+{
+	struct crk_sync_log *log = crk_sync_log;
+
+	return log && crk_sync_pos < log->head && crk_sync_pos < log->size &&
+	    ((struct crk_sync_entry *)&log->data[crk_sync_pos])->length;
+}
+#else
+void crk_pot_sync_init(void)
+{
+}
+
+int crk_pot_sync_shared(void)
+{
+	return 0;
+}
+#endif
+
 /* Negative index is not counted/reported (got it from pot sync) */
 static int crk_process_guess(struct db_salt *salt, struct db_password *pw, int index)
 {
@@ -472,6 +1035,12 @@ static int crk_process_guess(struct db_salt *salt, struct db_password *pw, int i
 		          crk_db->options->flags & DB_LOGIN ? repuid : "",
 		          (char*)ct,
 		          repkey, key, crk_db->options->field_sep_char, index);
+#if CRK_POT_SYNC
+		if (crk_sync_log && !(crk_params->flags & FMT_NOT_EXACT))
+			crk_pot_sync_add(ct ? ct : ldr_pot_source(
+				crk_methods.source(pw->source, pw->binary),
+				buffer));
+#endif
 
 		if (options.crack_status)
 			event_pending = event_status = 1;
@@ -597,6 +1166,31 @@ static int crk_remove_pot_entry(char *ciphertext)
 			}
 		} while ((pw = pw->next));
 	}
+	else if (salt->table) {
+		int hash, pos = -1;
+		char *binary = crk_methods.binary(ciphertext);
+
+		hash = crk_methods.binary_hash[salt->hash_size](binary);
+		BLOB_FREE(crk_db->format, binary);
+
+		while ((pos = hashtab_next(salt->table, salt->table_mask,
+		    hash, pos)) >= 0) {
+			char *source;
+
+			pw = HASHTAB_PTR(salt->table, pos);
+			source = crk_methods.source(pw->source, pw->binary);
+
+			if (!strcmp(source, ciphertext)) {
+				if (crk_process_guess(salt, pw, -1))
+					return 1;
+
+				if (!(crk_db->options->flags & DB_WORDS))
+					break;
+				if (!(crk_params->flags & FMT_NOT_EXACT))
+					pos = -1;
+			}
+		}
+	}
 	else {
 		int hash;
 		char *binary = crk_methods.binary(ciphertext);
@@ -718,6 +1312,51 @@ int crk_reload_pot(void)
 	return (!crk_db->salts);
 }
 
+#if CRK_POT_SYNC
+/*
+ * Drop the hashes other forked processes have added to the shared log since
+ * we last looked.  Our own cracks are already gone from our database.
+ */
+static int crk_pot_sync_read(void)
+{
+	struct crk_sync_log *log = crk_sync_log;
+	int passwords = crk_db->password_count;
+	int salts = crk_db->salt_count;
+	int done = 0;
+
+	if (crk_params->flags & FMT_NOT_EXACT)
+		return 0;
+
+	ldr_in_pot = 1;
+
+	while (crk_sync_pos < log->head && crk_sync_pos < log->size) {
+		struct crk_sync_entry *entry =
+		    (struct crk_sync_entry *)&log->data[crk_sync_pos];
+		uint32_t length = entry->length;
+
+		if (!length)
+			break;
+		__sync_synchronize();
+		crk_sync_pos += CRK_SYNC_ENTRY_SIZE(length);
+
+		if (entry->node != options.node_min &&
+		    (done = crk_remove_pot_entry(entry->ciphertext)))
+			break;
+	}
+
+	ldr_in_pot = 0;
+
+	passwords -= crk_db->password_count;
+	salts -= crk_db->salt_count;
+
+	if (john_main_process && passwords)
+		log_event("+ pot sync removed %d hashes/%d salts; %s",
+		          passwords, salts, crk_loaded_counts());
+
+	return done;
+}
+#endif
+
 #ifdef HAVE_MPI
 static void crk_mpi_probe(void)
 {
@@ -837,10 +1476,7 @@ void crk_set_hybrid_fix_state_func_ptr(fix_state_fp fp)
 static int crk_password_loop(struct db_salt *salt)
 {
 	int count;
-	unsigned int match, index;
-#if CRK_PREFETCH
-	unsigned int target;
-#endif
+	unsigned int match;
 
 #if !OS_TIMER
 	sig_timer_emu_tick();
@@ -904,12 +1540,333 @@ static int crk_password_loop(struct db_salt *salt)
 		}
 	}
 
+/* Our own results for this salt are all checked by now */
+	if (salt->hash_size > 0 && !crk_guesses &&
+	    salt->count < password_hash_thresholds[salt->hash_size] / 2)
+		ldr_shrink_hash(crk_db, salt);
+
 	count = crk_key_index;
+#if HAVE_PTHREAD
+	if (crk_async.active && !single_running) {
+		crk_async_start(salt, count);
+		return 0;
+	}
+#endif
 	match = crk_methods.crypt_all(&count, salt);
 	crk_last_key = count;
 
 	status_update_crypts((uint64_t)salt->count * count, count);
 
+	return crk_process_results(salt, match);
+}
+
+/*
+ * Checks one crypt_all() output against a salt's compact hash table, starting
+ * with the entry at pos (which is the first one with this hash).
+ */
+static MAYBE_INLINE int crk_process_table_index(struct db_salt *salt,
+    unsigned int index, unsigned int hash, int pos)
+{
+	while (pos >= 0) {
+		struct db_password *pw = HASHTAB_PTR(salt->table, pos);
+
+		if (crk_methods.cmp_one(pw->binary, index))
+		if (crk_methods.cmp_exact(crk_methods.source(
+		    pw->source, pw->binary), index)) {
+			if (crk_process_guess(salt, pw, index))
+				return 1;
+/* The entry is gone and others may have moved into its place, so start over */
+			if (!(crk_params->flags & FMT_NOT_EXACT))
+				pos = -1;
+		}
+
+		pos = hashtab_next(salt->table, salt->table_mask, hash, pos);
+	}
+
+	return 0;
+}
+
+/*
+ * Same as crk_process_results() below, for salts with a compact hash table.
+ */
+static int crk_process_results_table(struct db_salt *salt, unsigned int match)
+{
+	unsigned int index;
+#if CRK_PREFETCH
+	unsigned int target;
+
+	for (index = 0; index < match; index = target) {
+		unsigned int slot, ahead, lucky;
+		int left;
+		struct {
+			unsigned int i, h;
+			union {
+				unsigned int *b;
+				int pos;
+			} u;
+		} a[CRK_PREFETCH];
+		target = index + crk_prefetch;
+		if (target > match)
+			target = match;
+		for (slot = 0, ahead = index; ahead < target; slot++, ahead++) {
+			unsigned int h = salt->index(ahead);
+			unsigned int *b = &salt->bitmap[h / (sizeof(*salt->bitmap) * 8)];
+			a[slot].h = h;
+			a[slot].u.b = b;
+#ifdef __SSE__
+			_mm_prefetch((const char *)b, _MM_HINT_NTA);
+#else
+			*(volatile unsigned int *)b;
+#endif
+		}
+		lucky = 0;
+		for (slot = 0, ahead = index; ahead < target; slot++, ahead++) {
+			unsigned int h = a[slot].h;
+			if (*a[slot].u.b & (1U << (h % (sizeof(*salt->bitmap) * 8)))) {
+				uint32_t *v = salt->table[h & salt->table_mask].value;
+#ifdef __SSE__
+				_mm_prefetch((const char *)v, _MM_HINT_NTA);
+#else
+				*(volatile uint32_t *)v;
+#endif
+				a[lucky].i = ahead;
+				a[lucky++].h = h;
+			}
+		}
+		if (!lucky)
+			continue;
+/*
+ * Like with the hash table, look up all entries before we need them, and
+ * prefetch the password pointers and the binaries they point to.
+ */
+		for (slot = 0; slot < lucky; slot++) {
+			int pos = hashtab_next(salt->table, salt->table_mask,
+			    a[slot].h, -1);
+			a[slot].u.pos = pos;
+			if (pos >= 0) {
+				void **p = &HASHTAB_PTR(salt->table, pos);
+#ifdef __SSE__
+				_mm_prefetch((const char *)p, _MM_HINT_NTA);
+#else
+				*(void * volatile *)p;
+#endif
+			}
+		}
+		for (slot = 0; slot < lucky; slot++) {
+			struct db_password *pw;
+			if (a[slot].u.pos < 0)
+				continue;
+			pw = HASHTAB_PTR(salt->table, a[slot].u.pos);
+#ifdef __SSE__
+			_mm_prefetch((const char *)&pw->binary, _MM_HINT_NTA);
+#else
+			*(void * volatile *)&pw->binary;
+#endif
+		}
+		left = crk_db->password_count;
+		for (slot = 0; slot < lucky; slot++) {
+			int pos = a[slot].u.pos;
+/* Our lookups are stale if a successful guess has moved entries around */
+			if (crk_db->password_count != left)
+				pos = hashtab_next(salt->table, salt->table_mask,
+				    a[slot].h, -1);
+			if (crk_process_table_index(salt, a[slot].i, a[slot].h,
+			    pos))
+				return 1;
+		}
+	}
+#else
+	for (index = 0; index < match; index++) {
+		unsigned int hash = salt->index(index);
+		if (salt->bitmap[hash / (sizeof(*salt->bitmap) * 8)] &
+		    (1U << (hash % (sizeof(*salt->bitmap) * 8))))
+		if (crk_process_table_index(salt, index, hash,
+		    hashtab_next(salt->table, salt->table_mask, hash, -1)))
+			return 1;
+	}
+#endif
+
+	return 0;
+}
+
+#if CRK_PREFETCH
+/*
+ * Tests count hashes against a bitmap, storing the indices of those that have
+ * their bits set into lucky[].  Returns the number of such indices.
+ */
+static unsigned int crk_bitmap_filter(const unsigned int *bitmap,
+    const uint32_t *hashes, unsigned int count, unsigned int *lucky)
+{
+	unsigned int index = 0, lucky_count = 0;
+
+#if defined(__AVX512F__)
+	const __m512i ones = _mm512_set1_epi32(1), bits = _mm512_set1_epi32(31);
+
+	for (; index + 16 <= count; index += 16) {
+		__m512i h = _mm512_loadu_si512((const void *)&hashes[index]);
+		__m512i w = _mm512_i32gather_epi32(_mm512_srli_epi32(h, 5),
+		    (const void *)bitmap, 4);
+		__mmask16 m = _mm512_test_epi32_mask(w,
+		    _mm512_sllv_epi32(ones, _mm512_and_si512(h, bits)));
+		if (m) {
+			unsigned int i;
+			for (i = 0; i < 16; i++)
+			if (m & (1U << i))
+				lucky[lucky_count++] = index + i;
+		}
+	}
+#elif defined(__AVX2__)
+	const __m256i ones = _mm256_set1_epi32(1), bits = _mm256_set1_epi32(31);
+
+	for (; index + 8 <= count; index += 8) {
+		__m256i h = _mm256_loadu_si256((const __m256i *)&hashes[index]);
+		__m256i w = _mm256_i32gather_epi32((const int *)bitmap,
+		    _mm256_srli_epi32(h, 5), 4);
+		__m256i b = _mm256_sllv_epi32(ones, _mm256_and_si256(h, bits));
+		int m = _mm256_movemask_ps(_mm256_castsi256_ps(
+		    _mm256_cmpeq_epi32(_mm256_and_si256(w, b), b)));
+		if (m) {
+			unsigned int i;
+			for (i = 0; i < 8; i++)
+			if (m & (1 << i))
+				lucky[lucky_count++] = index + i;
+		}
+	}
+#endif
+
+	for (; index < count; index++) {
+		uint32_t h = hashes[index];
+		if (bitmap[h / 32] & (1U << (h % 32)))
+			lucky[lucky_count++] = index;
+	}
+
+	return lucky_count;
+}
+
+/*
+ * Same as crk_process_results() below, for formats with a get_hashes() method.
+ * Rather than calling salt->index() and testing the bitmap one output at a
+ * time, we get all hashes at once and filter them through the bitmap with
+ * vector gathers, then look up only the lucky ones, crk_prefetch at a time.
+ */
+static int crk_process_results_batch(struct db_salt *salt, unsigned int match)
+{
+	uint32_t *hashes = crk_batch_hashes;
+	unsigned int count, done;
+
+	crk_methods.get_hashes(salt->hash_size, match, hashes);
+	count = crk_bitmap_filter(salt->bitmap, hashes, match, crk_batch_lucky);
+
+	for (done = 0; done < count; done += crk_prefetch) {
+		unsigned int *lucky = &crk_batch_lucky[done];
+		unsigned int slot, n = count - done;
+		union {
+			int pos;
+			struct db_password **p;
+		} a[CRK_PREFETCH];
+		if (n > crk_prefetch)
+			n = crk_prefetch;
+
+		if (salt->table) {
+			int left;
+
+			for (slot = 0; slot < n; slot++) {
+				uint32_t *v = salt->table[hashes[lucky[slot]] &
+				    salt->table_mask].value;
+#ifdef __SSE__
+				_mm_prefetch((const char *)v, _MM_HINT_NTA);
+#else
+				*(volatile uint32_t *)v;
+#endif
+			}
+			for (slot = 0; slot < n; slot++) {
+				int pos = hashtab_next(salt->table,
+				    salt->table_mask, hashes[lucky[slot]], -1);
+				a[slot].pos = pos;
+				if (pos >= 0) {
+					void **p = &HASHTAB_PTR(salt->table, pos);
+#ifdef __SSE__
+					_mm_prefetch((const char *)p, _MM_HINT_NTA);
+#else
+					*(void * volatile *)p;
+#endif
+				}
+			}
+			for (slot = 0; slot < n; slot++) {
+				struct db_password *pw;
+				if (a[slot].pos < 0)
+					continue;
+				pw = HASHTAB_PTR(salt->table, a[slot].pos);
+#ifdef __SSE__
+				_mm_prefetch((const char *)&pw->binary, _MM_HINT_NTA);
+#else
+				*(void * volatile *)&pw->binary;
+#endif
+			}
+			left = crk_db->password_count;
+			for (slot = 0; slot < n; slot++) {
+				unsigned int index = lucky[slot];
+				int pos = a[slot].pos;
+				if (crk_db->password_count != left)
+					pos = hashtab_next(salt->table,
+					    salt->table_mask, hashes[index], -1);
+				if (crk_process_table_index(salt, index,
+				    hashes[index], pos))
+					return 1;
+			}
+			continue;
+		}
+
+		for (slot = 0; slot < n; slot++) {
+			struct db_password **pwp =
+			    &salt->hash[hashes[lucky[slot]] >> PASSWORD_HASH_SHR];
+			a[slot].p = pwp;
+#ifdef __SSE__
+			_mm_prefetch((const char *)pwp, _MM_HINT_NTA);
+#else
+			*(void * volatile *)pwp;
+#endif
+		}
+		for (slot = 0; slot < n; slot++) {
+			struct db_password *pw = *a[slot].p;
+			if (!pw)
+				continue;
+#ifdef __SSE__
+			_mm_prefetch((const char *)&pw->binary, _MM_HINT_NTA);
+#else
+			*(void * volatile *)&pw->binary;
+#endif
+		}
+		for (slot = 0; slot < n; slot++) {
+/* Re-read the bucket, as a guess may have emptied it since the prefetch */
+			struct db_password *pw = *a[slot].p;
+			unsigned int index = lucky[slot];
+			if (!pw)
+				continue;
+			do {
+				if (crk_methods.cmp_one(pw->binary, index))
+				if (crk_methods.cmp_exact(crk_methods.source(
+				    pw->source, pw->binary), index))
+				if (crk_process_guess(salt, pw, index))
+					return 1;
+			} while ((pw = pw->next_hash));
+		}
+	}
+
+	return 0;
+}
+#endif
+
+/*
+ * Checks the crypt_all() outputs against the salt's loaded hashes.
+ */
+static int crk_process_results(struct db_salt *salt, unsigned int match)
+{
+	unsigned int index;
+#if CRK_PREFETCH
+	unsigned int target;
+#endif
+
 	if (!match)
 		return 0;
 
@@ -932,6 +1889,14 @@ static int crk_password_loop(struct db_salt *salt)
 		return 0;
 	}
 
+#if CRK_PREFETCH
+	if (match <= crk_batch_size)
+		return crk_process_results_batch(salt, match);
+#endif
+
+	if (salt->table)
+		return crk_process_results_table(salt, match);
+
 #if CRK_PREFETCH
 	for (index = 0; index < match; index = target) {
 		unsigned int slot, ahead, lucky;
@@ -1036,6 +2001,124 @@ static int crk_password_loop(struct db_salt *salt)
 	return 0;
 }
 
+/*
+ * --salt-schedule: whenever hashes have been cracked, re-sort the salts so
+ * that those where we expect the most cracks per unit of time come first.
+ * Every key is still tried against all salts, only the order within a batch
+ * changes, so this is about getting cracks (and dropping salts) sooner.  The
+ * order only depends on the database, with ties kept in load order.
+ */
+
+/* Relative time to compute a hash for the salt, from its tunable costs */
+static double crk_salt_cost(struct db_salt *salt)
+{
+	double cost = 1;
+	int i;
+
+	for (i = 0; i < FMT_TUNABLE_COSTS; i++)
+		if (crk_methods.tunable_cost_value[i] && salt->cost[i] > 1)
+			cost *= salt->cost[i];
+
+	return cost;
+}
+
+static double crk_salt_weight(struct db_salt *salt)
+{
+	if (crk_schedule == SCHEDULE_YIELD)
+		return salt->count / crk_salt_cost(salt);
+
+	return salt->count;
+}
+
+/* Whether salt a goes before salt b */
+static int crk_schedule_before(struct db_salt *a, struct db_salt *b)
+{
+	double wa = crk_salt_weight(a), wb = crk_salt_weight(b);
+
+	if (wa != wb)
+		return wa > wb;
+	return a->sequential_id < b->sequential_id;
+}
+
+static int crk_schedule_cmp(const void *x, const void *y)
+{
+	struct db_salt *a = *(struct db_salt **)x, *b = *(struct db_salt **)y;
+
+	return crk_schedule_before(a, b) ? -1 : 1;
+}
+
+/*
+ * The list is in order from the last call, and cracks only ever lower the
+ * weight of a salt, so only salts that got cracks can be out of order and
+ * they can only have to go later.  Going backwards, we take out those that
+ * would go after the salt we kept last, then sort just these and merge them
+ * back in.
+ */
+static void crk_schedule_salts(void)
+{
+	struct db_salt *salt, **tail;
+	int i, j, k, n, m, fix_hash;
+
+	if (crk_db->password_count == crk_schedule_passwords ||
+	    crk_db->salt_count < 2)
+		return;
+	crk_schedule_passwords = crk_db->password_count;
+
+	for (n = 0, salt = crk_db->salts; salt; salt = salt->next)
+		crk_schedule_order[n++] = salt;
+
+	for (i = j = n - 1, m = 0; i >= 0; i--) {
+		salt = crk_schedule_order[i];
+		if (i == n - 1 ||
+		    crk_schedule_before(salt, crk_schedule_order[j + 1]))
+			crk_schedule_order[j--] = salt;
+		else
+			crk_schedule_moved[m++] = salt;
+	}
+	if (!m)
+		return;
+
+	qsort(crk_schedule_moved, m, sizeof(*crk_schedule_moved),
+	    crk_schedule_cmp);
+
+/*
+ * Like the loader, keep the salt_hash entries pointing at the first salt.
+ * Only those of moved salts can change, as everything else stays in order.
+ */
+	fix_hash = 0;
+	if (crk_db->salt_hash)
+	for (k = 0; k < m; k++) {
+		int hash = crk_methods.salt_hash(crk_schedule_moved[k]->salt);
+
+		if (crk_db->salt_hash[hash] == crk_schedule_moved[k]) {
+			crk_db->salt_hash[hash] = NULL;
+			fix_hash = 1;
+		}
+	}
+
+	tail = &crk_db->salts;
+	for (i = j + 1, k = 0; i < n || k < m; tail = &salt->next) {
+		if (k == m || (i < n && crk_schedule_before(
+		    crk_schedule_order[i], crk_schedule_moved[k])))
+			salt = crk_schedule_order[i++];
+		else
+			salt = crk_schedule_moved[k++];
+		*tail = salt;
+		if (fix_hash) {
+			int hash = crk_methods.salt_hash(salt->salt);
+
+			if (!crk_db->salt_hash[hash])
+				crk_db->salt_hash[hash] = salt;
+		}
+	}
+	*tail = NULL;
+
+	log_event("- Salt schedule: first %d hashes at cost %.0f, "
+	    "last %d hashes at cost %.0f (%d salts, %d moved)",
+	    crk_db->salts->count, crk_salt_cost(crk_db->salts),
+	    salt->count, crk_salt_cost(salt), n, m);
+}
+
 /*
  * When crk_process_key() has a complete batch, it calls this function
  * to run the batch with all salts.
@@ -1048,9 +2131,20 @@ static int crk_salt_loop(void)
 
 	single_running = 0;
 
+	if (crk_async_wait())
+		return 1;
+
 	if (event_reload && crk_reload_pot())
 		return 1;
 
+#if CRK_POT_SYNC
+	if (crk_pot_sync_pending() && crk_pot_sync_read())
+		return 1;
+#endif
+
+	if (crk_schedule)
+		crk_schedule_salts();
+
 	salt = crk_db->salts;
 
 	/* on first run, right after restore, this can be non-zero */
@@ -1071,6 +2165,11 @@ static int crk_salt_loop(void)
 		}
 	}
 
+#if HAVE_PTHREAD
+	if (crk_pool.active && crk_db->salt_count > 1)
+		salt = crk_pool_run(salt, &done);
+	else
+#endif
 	/* Normal loop over all salts */
 	do {
 		crk_methods.set_salt(salt->salt);
@@ -1134,7 +2233,10 @@ static int crk_salt_loop(void)
 int crk_process_buffer(void)
 {
 	if (crk_db->loaded && crk_key_index)
-		return crk_salt_loop();
+		return crk_salt_loop() || crk_async_wait();
+
+	if (crk_async_wait())
+		return 1;
 
 	if (event_pending && crk_process_event())
 		return 1;
@@ -1229,13 +2331,57 @@ int crk_direct_process_key(char *key)
 	return ext_abort;
 }
 
+/*
+ * Bulk version of crk_process_key() for count keys stride bytes apart, as
+ * produced by mask mode.  Keys go straight to the format for as long as a
+ * batch is being filled, so the per-key overhead is just the set_key() call.
+ */
+int crk_process_keys(char *keys, int stride, int count)
+{
+	if (crk_process_key != crk_direct_process_key) {
+		while (count--) {
+			if (crk_process_key(keys))
+				return 1;
+			keys += stride;
+		}
+		return 0;
+	}
+
+	while (count) {
+		int n;
+
+		if (crk_key_index >= crk_process_key_max_keys) {
+			/* First key of a batch, or not cracking */
+			if (crk_direct_process_key(keys))
+				return 1;
+			keys += stride;
+			count--;
+			continue;
+		}
+
+		n = MIN(count, crk_process_key_max_keys - crk_key_index);
+		count -= n;
+		while (n--) {
+			crk_methods.set_key(keys, crk_key_index++);
+			keys += stride;
+		}
+
+		if (crk_key_index >= crk_process_key_max_keys && crk_salt_loop())
+			return 1;
+	}
+
+	return 0;
+}
+
 static int process_key_stack_rules(char *key)
 {
 	int ret = 0;
 	char *word;
 
+	suppressor_new_word();
 	while ((word = rules_process_stack_all(key, &crk_rule_stack)))
-		if ((ret = crk_direct_process_key(word)))
+		if (!suppressor_word_dupe(word) && !suppressor_dupe(word) &&
+		    (ret = crk_direct_process_key(word)))
 			break;
 
 	return ret;
@@ -1338,7 +2484,17 @@ void crk_done(void)
 		if (crk_key_index && crk_db->salts && !event_abort)
 			crk_salt_loop();
 
+#if HAVE_PTHREAD
+		crk_async_done();
+		crk_pool_done();
+#endif
 		MEM_FREE(crk_timestamps);
+		MEM_FREE(crk_schedule_order);
+#if CRK_PREFETCH
+		MEM_FREE(crk_batch_hashes);
+		MEM_FREE(crk_batch_lucky);
+		crk_batch_size = 0;
+#endif
 	}
 	c_cleanup();
 }
@@ -48,6 +48,12 @@ extern int crk_direct_process_key(char *key);
  */
 extern int (*crk_process_key)(char *key);
 
+/*
+ * Same as calling crk_process_key() for each of count keys, found stride
+ * bytes apart starting at keys.
+ */
+extern int crk_process_keys(char *keys, int stride, int count);
+
 /*
  * Process all/any keys already loaded with crk_process_key, regardless of
  * max_keys_per_crypt.  After this, it's safe to call reset() mid-run.
@@ -79,6 +85,18 @@ extern void crk_done(void);
  */
 extern int crk_reload_pot(void);
 
+/*
+ * Sets up the log of cracked hashes shared by "--fork" processes, if enabled
+ * (must be called before fork()).
+ */
+extern void crk_pot_sync_init(void);
+
+/*
+ * Whether our cracks reach the other "--fork" processes through that log, so
+ * there's no need to signal them to re-read the pot file.
+ */
+extern int crk_pot_sync_shared(void);
+
 /*
  * Exported for stacked modes
  */
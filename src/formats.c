@@ -659,6 +659,24 @@ static char* is_key_right(struct fmt_main *format, int index,
 		return err_buf;
 	}
 
+	if (format->methods.get_hashes) {
+		uint32_t *hashes = mem_alloc(match * sizeof(*hashes));
+		int j;
+
+		for (size = 0; size < PASSWORD_HASH_SIZES; size++) {
+			format->methods.get_hashes(size, match, hashes);
+			for (j = 0; j < match; j++)
+			if (hashes[j] != (uint32_t)format->methods.get_hash[size](j)) {
+				sprintf(err_buf, "get_hashes(%d) [%d] %x!=%x",
+				    size, j, hashes[j],
+				    format->methods.get_hash[size](j));
+				MEM_FREE(hashes);
+				return err_buf;
+			}
+		}
+		MEM_FREE(hashes);
+	}
+
 	if (!format->methods.cmp_exact(ciphertext, i)) {
 		if (options.verbosity > VERB_LEGACY)
 			snprintf(err_buf, sizeof(err_buf), "cmp_exact(%d) %s", match, ciphertext);
@@ -1450,6 +1468,28 @@ static char *fmt_self_test_body(struct fmt_main *format,
 		}
 	}
 
+	/* Keys set into the second buffer must not disturb the first one */
+	if (format->methods.select_keys) {
+		char key0[PLAINTEXT_BUFFER_SIZE];
+
+		format->methods.clear_keys();
+		fmt_set_key(format->params.tests[0].plaintext, 0);
+		strnzcpy(key0, format->methods.get_key(0), sizeof(key0));
+		format->methods.select_keys(1, 0);
+		format->methods.clear_keys();
+		fmt_set_key(longcand(format, 0, ml), 0);
+		if (strcmp(format->methods.get_key(0), key0)) {
+			format->methods.select_keys(0, 0);
+			return "select_keys()";
+		}
+		format->methods.select_keys(0, 1);
+		if (!strcmp(format->methods.get_key(0), key0)) {
+			format->methods.select_keys(0, 0);
+			return "select_keys() (second buffer)";
+		}
+		format->methods.select_keys(0, 0);
+	}
+
 	format->methods.clear_keys();
 	format->private.initialized = 2;
 
@@ -20,8 +20,9 @@
  * in case of any problem with the new additions
  * (tunable cost parameters)
  * (format signatures, #14)
+ * (select_keys() and get_hashes() methods, #15)
  */
-#define FMT_MAIN_VERSION 14	/* change if structure fmt_main changes */
+#define FMT_MAIN_VERSION 15	/* change if structure fmt_main changes */
 
 /*
  * fmt_main is declared for real further down this file, but we refer to it in
@@ -81,6 +82,11 @@ struct db_salt;
  * identification of uncracked hashes for this salt.
  */
 #define FMT_REMOVE			0x00000020
+/*
+ * The salt returned by salt() is plain data, with no pointers in it, so it
+ * may be copied to another process (as the parallel loader does).
+ */
+#define FMT_FLAT_SALT			0x00000040
 /*
  * Format has false positive matches. Thus, do not remove hashes when
  * a likely PW is found.  This should only be set for formats where a
@@ -121,6 +127,19 @@ struct db_salt;
 #endif
 /* Non-hash format. If used, binary_size must be sizeof(fmt_data) */
 #define FMT_BLOB			0x04000000
+#if HAVE_PTHREAD && defined(__GNUC__)
+/*
+ * set_salt(), crypt_all(), cmp_*() and get_hash[]() only use state that is
+ * per thread (FMT_THREAD_LOCAL), other than the keys, so that several salts
+ * may be hashed at once by different threads.  Note that OpenMP threads see
+ * their own copies, too.
+ */
+#define FMT_REENTRANT			0x08000000
+#define FMT_THREAD_LOCAL		__thread
+#else
+#define FMT_REENTRANT			0
+#define FMT_THREAD_LOCAL
+#endif
 /* We've already warned the user about hashes of this type being present */
 #define FMT_WARNED			0x80000000
 
@@ -401,6 +420,20 @@ struct fmt_methods {
 
 /* Compares an ASCII ciphertext against a particular crypt_all() output */
 	int (*cmp_exact)(char *source, int index);
+
+/* Optional (may be NULL) double-buffering of keys.  Makes set_key() and
+ * clear_keys() work on key buffer set_slot, while crypt_all(), get_key() and
+ * cmp_exact() use key buffer crypt_slot (each slot is 0 or 1).  The cracker
+ * uses this to fill the next batch of keys while crypt_all() is still running
+ * on the previous one in another thread, so set_key() must not touch anything
+ * else crypt_all() uses.  Both slots are 0 until this is first called. */
+	void (*select_keys)(int set_slot, int crypt_slot);
+
+/* Optional (may be NULL) batch version of get_hash[size]: stores the values
+ * for crypt_all() outputs 0 to count - 1 into hashes[].  Formats that keep
+ * their outputs in interleaved SIMD layout provide this so the cracker can
+ * test a whole batch against the bitmap at once. */
+	void (*get_hashes)(int size, int count, uint32_t *hashes);
 };
 
 /*
@@ -0,0 +1,101 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+#include <stddef.h>
+
+#include "hashtab.h"
+
+/* Keep positions within an int */
+#define HASHTAB_MAX_BUCKETS		(0x40000000 / HASHTAB_BUCKET_SIZE)
+
+static int hashtab_full(struct db_hash_bucket *bucket)
+{
+	unsigned int i, full = 1;
+
+	for (i = 0; i < HASHTAB_BUCKET_SIZE; i++)
+		full &= bucket->value[i] != 0;
+
+	return full;
+}
+
+unsigned int hashtab_buckets(unsigned int count, unsigned int space)
+{
+	unsigned int buckets = 1;
+
+/* Aim for a load factor between 1/4 and 1/2, at which overflows into the
+ * next bucket are rare */
+	while (buckets < space && buckets < HASHTAB_MAX_BUCKETS &&
+	    buckets * (HASHTAB_BUCKET_SIZE / 2) < count)
+		buckets <<= 1;
+
+/* With values as the home positions, buckets beyond the hash space would
+ * never be used, so we'd rather give up if the load gets too high */
+	if (count > buckets * (HASHTAB_BUCKET_SIZE / 4 * 3))
+		return 0;
+
+	return buckets;
+}
+
+void hashtab_insert(struct db_hash_bucket *table, unsigned int mask,
+    uint32_t hash, void *ptr)
+{
+	unsigned int bucket = hash & mask;
+
+	for (;;) {
+		unsigned int i;
+
+		for (i = 0; i < HASHTAB_BUCKET_SIZE; i++)
+			if (!table[bucket].value[i]) {
+				table[bucket].value[i] = hash + 1;
+				table[bucket].ptr[i] = ptr;
+				return;
+			}
+
+		bucket = (bucket + 1) & mask;
+	}
+}
+
+void hashtab_remove(struct db_hash_bucket *table, unsigned int mask, int pos)
+{
+	unsigned int bucket = pos / HASHTAB_BUCKET_SIZE;
+	unsigned int slot = pos % HASHTAB_BUCKET_SIZE;
+
+/*
+ * Entries only ever overflow past full buckets, and lookups rely on that.  So
+ * if we're making room in a full bucket, move into it an entry that overflowed
+ * past it (if any), which in turn makes room in the entry's bucket.
+ */
+	while (hashtab_full(&table[bucket])) {
+		unsigned int next = bucket, i;
+
+		do {
+			unsigned int dist;
+
+			next = (next + 1) & mask;
+			dist = (next - bucket) & mask;
+			for (i = 0; i < HASHTAB_BUCKET_SIZE; i++)
+				if (table[next].value[i] &&
+				    ((next - (table[next].value[i] - 1)) & mask) >=
+				    dist)
+					break;
+		} while (i == HASHTAB_BUCKET_SIZE &&
+		    hashtab_full(&table[next]));
+
+		if (i == HASHTAB_BUCKET_SIZE)
+			break;
+
+		table[bucket].value[slot] = table[next].value[i];
+		table[bucket].ptr[slot] = table[next].ptr[i];
+		bucket = next;
+		slot = i;
+	}
+
+	table[bucket].value[slot] = 0;
+	table[bucket].ptr[slot] = NULL;
+}
@@ -0,0 +1,104 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+/*
+ * Compact open-addressing hash table for salts with very many loaded hashes.
+ *
+ * This replaces the array of buckets and the next_hash chains behind the
+ * bitmap, which at the largest size is 2 GiB of pointers on 64-bit systems no
+ * matter how many hashes there are.  The table consists of buckets of
+ * HASHTAB_BUCKET_SIZE entries, each holding the full get_hash() value inline
+ * plus a pointer to the password.  The values of a bucket fill exactly one
+ * cache line, so checking a bitmap hit against it normally takes a single
+ * memory access and no walking of a chain.
+ *
+ * A bucket overflows into the next one only when it's full, so lookups stop
+ * at the first bucket that isn't.
+ */
+
+#ifndef _JOHN_HASHTAB_H
+#define _JOHN_HASHTAB_H
+
+#include <stdint.h>
+
+#define HASHTAB_BUCKET_SIZE		16
+
+struct db_hash_bucket {
+/* get_hash() values plus one, or zero for unused entries */
+	uint32_t value[HASHTAB_BUCKET_SIZE];
+
+/* Pointers to the passwords */
+	void *ptr[HASHTAB_BUCKET_SIZE];
+};
+
+/* Password pointer for a position returned by hashtab_next() */
+#define HASHTAB_PTR(table, pos) \
+	((table)[(pos) / HASHTAB_BUCKET_SIZE].ptr[(pos) % HASHTAB_BUCKET_SIZE])
+
+/*
+ * Returns the number of buckets (a power of two) for a table holding count
+ * hashes whose get_hash() values are below space, or zero if the hash space
+ * is too small for this table to be any good.
+ */
+extern unsigned int hashtab_buckets(unsigned int count, unsigned int space);
+
+/*
+ * Adds an entry.  The table must have been zeroed initially and must not be
+ * full.  mask is the number of buckets minus one.
+ */
+extern void hashtab_insert(struct db_hash_bucket *table, unsigned int mask,
+    uint32_t hash, void *ptr);
+
+/*
+ * Removes the entry at a position previously returned by hashtab_next().
+ * Other entries may move, so any lookups in progress have to be restarted.
+ */
+extern void hashtab_remove(struct db_hash_bucket *table, unsigned int mask,
+    int pos);
+
+/*
+ * Returns the position of the first entry with the given hash if pos is
+ * negative, or of the next one after pos.  Returns -1 when there are no more.
+ */
+static inline int hashtab_next(struct db_hash_bucket *table,
+    unsigned int mask, uint32_t hash, int pos)
+{
+	unsigned int bucket, slot;
+
+	if (pos < 0) {
+		bucket = hash & mask;
+		slot = 0;
+	} else {
+		bucket = pos / HASHTAB_BUCKET_SIZE;
+		slot = pos % HASHTAB_BUCKET_SIZE + 1;
+	}
+
+	for (;;) {
+		uint32_t *value = table[bucket].value;
+		unsigned int i, match = 0, empty = 0;
+
+/* No early exits here, so that this may be vectorized */
+		for (i = 0; i < HASHTAB_BUCKET_SIZE; i++) {
+			match |= value[i] == hash + 1;
+			empty |= !value[i];
+		}
+
+		if (match)
+		for (i = slot; i < HASHTAB_BUCKET_SIZE; i++)
+			if (value[i] == hash + 1)
+				return bucket * HASHTAB_BUCKET_SIZE + i;
+		if (empty)
+			return -1;
+
+		bucket = (bucket + 1) & mask;
+		slot = 0;
+	}
+}
+
+#endif
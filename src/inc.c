@@ -31,6 +31,7 @@
 #include "unicode.h"
 #include "mask.h"
 #include "regex.h"
+#include "workq.h"
 
 extern struct fmt_main fmt_LM;
 
@@ -112,6 +113,8 @@ static int restore_state(FILE *file)
 
 static void fix_state(void)
 {
+	workq_fix_state();
+
 	if (hybrid_rec_entry || hybrid_rec_length) {
 		rec_entry = hybrid_rec_entry;
 		rec_length = hybrid_rec_length;
@@ -802,13 +805,15 @@ void do_incremental_crack(struct db_main *db, const char *mode)
 	entry--;
 	while (ptr < &header->order[sizeof(header->order) - 1]) {
 		int skip = 0;
-		if (options.node_count) {
+		if (options.node_count && !workq_active()) {
 			int for_node = entry % options.node_count + 1;
 			skip = for_node < options.node_min ||
 			    for_node > options.node_max;
 		}
 
 		entry++;
+		if (workq_active())
+			skip = !workq_mine(entry);
 		length = *ptr++; fixed = *ptr++; count = *ptr++;
 
 		if (length >= CHARSET_LENGTH ||
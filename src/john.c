@@ -90,6 +90,7 @@ static int john_omp_threads_new;
 #include "logger.h"
 #include "status.h"
 #include "recovery.h"
+#include "cracker.h"
 #include "options.h"
 #include "config.h"
 #include "bench.h"
@@ -104,6 +105,7 @@ static int john_omp_threads_new;
 #include "mask.h"
 #include "mkv.h"
 #include "subsets.h"
+#include "workq.h"
 #include "external.h"
 #include "batch.h"
 #include "dynamic_compiler.h"
@@ -1379,6 +1381,8 @@ static void john_load(void)
 			/*
 			 * flush before forking, to avoid multiple log entries
 			 */
+			crk_pot_sync_init();
+			workq_init();
 			log_flush();
 			john_fork();
 		}
@@ -0,0 +1 @@
+#define JOHN_BLD "linux-gnu 64-bit x86_64 AVX512BW AC"
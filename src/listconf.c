@@ -133,7 +133,8 @@ static void listconf_list_method_names()
 {
 	puts("init, done, reset, prepare, valid, split, binary, salt, tunable_cost_value,");
 	puts("source, binary_hash, salt_hash, salt_compare, set_salt, set_key, get_key,");
-	puts("clear_keys, crypt_all, get_hash, cmp_all, cmp_one, cmp_exact");
+	puts("clear_keys, crypt_all, get_hash, cmp_all, cmp_one, cmp_exact, select_keys,");
+	puts("get_hashes");
 }
 
 static void listconf_list_build_info(void)
@@ -756,6 +757,7 @@ void listconf_parse_late(void)
 			printf(" Uses a bitslice implementation      %s\n", (format->params.flags & FMT_BS) ? "yes" : "no");
 			printf(" The split() method unifies case     %s\n", (format->params.flags & FMT_SPLIT_UNIFIES_CASE) ? "yes" : "no");
 			printf(" Supports very long hashes           %s\n", (format->params.flags & FMT_HUGE_INPUT) ? "yes" : "no");
+			printf(" Hashes several salts at once        %s\n", (format->params.flags & FMT_REENTRANT) ? "yes" : "no");
 			if (format->params.flags & FMT_MASK)
 				printf(" Internal mask generation            yes (device target: %dx)\n", mask_int_cand_target);
 			else
@@ -882,7 +884,9 @@ void listconf_parse_late(void)
 				         strcasecmp(&options.listconf[15], "binary_hash[5]") &&
 					 strcasecmp(&options.listconf[15], "binary_hash[6]") &&
 				         strcasecmp(&options.listconf[15], "salt_hash") &&
-				         strcasecmp(&options.listconf[15], "salt_compare"))
+				         strcasecmp(&options.listconf[15], "salt_compare") &&
+				         strcasecmp(&options.listconf[15], "select_keys") &&
+				         strcasecmp(&options.listconf[15], "get_hashes"))
 				{
 					fprintf(stderr, "Error, invalid option (invalid method name) %s\n", options.listconf);
 					fprintf(stderr, "Valid method names are:\n");
@@ -942,6 +946,10 @@ void listconf_parse_late(void)
 					ShowIt = 1;
 				if (format->methods.set_salt != fmt_default_set_salt && !strcasecmp(&options.listconf[15], "set_salt"))
 					ShowIt = 1;
+				if (format->methods.select_keys != NULL && !strcasecmp(&options.listconf[15], "select_keys"))
+					ShowIt = 1;
+				if (format->methods.get_hashes != NULL && !strcasecmp(&options.listconf[15], "get_hashes"))
+					ShowIt = 1;
 			}
 			if (ShowIt) {
 				int i;
@@ -1001,6 +1009,12 @@ void listconf_parse_late(void)
 				printf("\tcmp_one()\n");
 // there is no default for cmp_exact() it must be defined.
 				printf("\tcmp_exact()\n");
+/* select_keys is always NULL for default */
+				if (format->methods.select_keys != NULL)
+					printf("\tselect_keys()\n");
+/* get_hashes is always NULL for default */
+				if (format->methods.get_hashes != NULL)
+					printf("\tget_hashes()\n");
 				printf("\n\n");
 			}
 			fmt_done(format);
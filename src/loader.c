@@ -10,6 +10,7 @@
 
 #define LDR_WARN_AMBIGUOUS
 
+#define NEED_OS_FORK
 #include <stdio.h>
 // needs to be above sys/stat.h for mingw, if -std=c99 used.
 #include "jumbo.h"
@@ -18,10 +19,14 @@
 #if (!AC_BUILT || HAVE_UNISTD_H) && !_MSC_VER
 #include <unistd.h>
 #endif
+#if OS_FORK
+#include <sys/wait.h>
+#endif
 #ifdef _MSC_VER
 #define S_ISDIR(a) ((a) & _S_IFDIR)
 #endif
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -50,6 +55,7 @@
 #include "single.h"
 #include "showformats.h"
 #include "mgetl.h"
+#include "john_mpi.h"
 
 /*
  * Jumbo may bump this at runtime
@@ -62,6 +68,11 @@ static int ldr_words_max = LDR_WORDS_MAX;
  */
 int ldr_in_pot = 0;
 
+/*
+ * Salts with at least this many hashes get a compact hash table
+ */
+static int ldr_compact_threshold;
+
 /*
  * If this is set, we are populating the test db
  */
@@ -501,6 +512,20 @@ void ldr_set_encoding(struct fmt_main *format)
 	initUnicode(UNICODE_UNICODE);
 }
 
+static void ldr_warn_other_type(struct fmt_main *format, struct fmt_main *alt)
+{
+	alt->params.flags |= FMT_WARNED;
+	if (john_main_process)
+	fprintf(stderr,
+	    "Warning: only loading hashes of type "
+	    "\"%s\", but also saw type \"%s\"\n"
+	    "Use the \"--format=%s\" option to force "
+	    "loading hashes of that type instead\n",
+	    format->params.label,
+	    alt->params.label,
+	    alt->params.label);
+}
+
 static int ldr_split_line(char **login, char **ciphertext,
 	char **gecos, char **home, char **uid,
 	char *source, struct fmt_main **format,
@@ -711,16 +736,7 @@ find_format:
 #endif
 			prepared = alt->methods.prepare(fields, alt);
 			if (alt->methods.valid(prepared, alt)) {
-				alt->params.flags |= FMT_WARNED;
-				if (john_main_process)
-				fprintf(stderr,
-				    "Warning: only loading hashes of type "
-				    "\"%s\", but also saw type \"%s\"\n"
-				    "Use the \"--format=%s\" option to force "
-				    "loading hashes of that type instead\n",
-				    (*format)->params.label,
-				    alt->params.label,
-				    alt->params.label);
+				ldr_warn_other_type(*format, alt);
 				break;
 			}
 		} while ((alt = alt->next));
@@ -921,24 +937,675 @@ static struct list_main *ldr_init_words(char *login, char *gecos, char *home)
 	return words;
 }
 
+/*
+ * Finds the salt in the database, or adds it if it's new.
+ */
+static struct db_salt *ldr_add_salt(struct db_main *db, void *salt)
+{
+	struct fmt_main *format = db->format;
+	struct db_salt *current_salt, *last_salt;
+	int salt_hash, i;
+
+	salt_hash = format->methods.salt_hash(salt);
+
+	if ((current_salt = db->salt_hash[salt_hash])) {
+		do {
+			if (!dyna_salt_cmp(current_salt->salt, salt, format->params.salt_size))
+				break;
+		}  while ((current_salt = current_salt->next));
+	}
+
+	if (!current_salt) {
+		last_salt = db->salt_hash[salt_hash];
+		current_salt = db->salt_hash[salt_hash] =
+			mem_alloc_tiny(db->salt_size, MEM_ALIGN_WORD);
+		current_salt->next = last_salt;
+
+		current_salt->salt = mem_alloc_copy(salt,
+			format->params.salt_size,
+			format->params.salt_align);
+
+		for (i = 0; i < FMT_TUNABLE_COSTS && format->methods.tunable_cost_value[i] != NULL; ++i)
+			current_salt->cost[i] = format->methods.tunable_cost_value[i](current_salt->salt);
+
+		current_salt->index = fmt_dummy_hash;
+		current_salt->bitmap = NULL;
+		current_salt->table = NULL;
+		current_salt->list = NULL;
+		current_salt->hash = &current_salt->list;
+		current_salt->hash_size = -1;
+
+		current_salt->count = 0;
+
+/* Until ldr_init_sqid(), this is the order in which salts were first seen */
+		current_salt->sequential_id = db->salt_count;
+
+		if (db->options->flags & DB_WORDS)
+			current_salt->keys = NULL;
+
+		db->salt_count++;
+	} else
+		dyna_salt_remove(salt);
+
+	return current_salt;
+}
+
+/*
+ * Adds a password hash to its salt.  The binary and source are copied unless
+ * they're from a compiled hash file, which stays mapped for as long as we run.
+ */
+static void ldr_add_pw(struct db_main *db, struct db_salt *current_salt,
+	char *piece, void *binary, int pw_hash, int mapped,
+	char *login, char *gecos, char *home, char *uid,
+	int index, int count, struct list_main **words)
+{
+	struct fmt_main *format = db->format;
+	struct db_password *current_pw, *last_pw;
+	size_t pw_size;
+
+	current_salt->count++;
+	db->password_count++;
+
+/* If we're not allocating memory for the "login" field, we may as well not
+ * allocate it for the "source" field if the format doesn't need it. */
+	pw_size = db->pw_size;
+	if (!(db->options->flags & DB_LOGIN) &&
+	    format->methods.source != fmt_default_source)
+		pw_size -= sizeof(char *);
+
+	last_pw = current_salt->list;
+	current_pw = current_salt->list = mem_alloc_tiny(
+		pw_size, MEM_ALIGN_WORD);
+	current_pw->next = last_pw;
+
+	last_pw = db->password_hash[pw_hash];
+	db->password_hash[pw_hash] = current_pw;
+	current_pw->next_hash = last_pw;
+
+/* If we're not going to use the source field for its usual purpose yet we had
+ * to allocate memory for it (because we need at least one field after it), see
+ * if we can pack the binary value in it. */
+	if (mapped)
+		current_pw->binary = binary;
+	else
+	if ((db->options->flags & DB_LOGIN) &&
+	    format->methods.source != fmt_default_source &&
+	    sizeof(current_pw->source) >= format->params.binary_size)
+		current_pw->binary = memcpy(&current_pw->source,
+			binary, format->params.binary_size);
+	else
+		current_pw->binary = mem_alloc_copy(binary,
+			format->params.binary_size,
+			format->params.binary_align);
+
+	if (format->methods.source == fmt_default_source)
+		current_pw->source = mapped ? piece : str_alloc_copy(piece);
+
+	if (db->options->flags & DB_WORDS) {
+		if (!*words)
+			*words = ldr_init_words(login, gecos, home);
+		current_pw->words = *words;
+	}
+
+	if (db->options->flags & DB_LOGIN) {
+		if (login != no_username && index == 0)
+			login = ldr_conv(login);
+
+		if (options.show_uid_in_cracks)
+			current_pw->uid = str_alloc_copy(uid);
+
+		if (count >= 2 && count <= 9) {
+			current_pw->login = mem_alloc_tiny(
+				strlen(login) + 3, MEM_ALIGN_NONE);
+			sprintf(current_pw->login, "%s:%d",
+				login, index + 1);
+		} else
+		if (login == no_username)
+			current_pw->login = login;
+		else
+		if (*words && *login)
+			current_pw->login = (*words)->head->data;
+		else
+			current_pw->login = str_alloc_copy(login);
+	}
+}
+
+#if HAVE_MMAP
+/*
+ * Compiled hash files.
+ *
+ * Loading a huge hash file spends most of its time in the format's prepare(),
+ * valid(), split(), binary() and salt() methods and in checking for dupes.  So
+ * when enabled, we save what we've loaded from a hash file into a compiled
+ * hash file next to it: the binaries and ciphertexts ready to use as-is, in
+ * the order they were loaded, and one ciphertext per salt to get the salt
+ * from.  Later sessions loading the same file with the same format map the
+ * compiled file read-only, which also lets --fork children and concurrent
+ * sessions share its pages, and only build the in-memory structures.
+ *
+ * We don't save the salts themselves as some formats keep pointers in them,
+ * nor the bitmaps and hash tables, which change as hashes get cracked.
+ */
+#define LDR_CACHE_SUFFIX		".jdb"
+#define LDR_CACHE_MAGIC			"JtRcdb1"
+
+struct ldr_cache_header {
+	char magic[8];
+/* Format that loaded the hashes, and the --format option that chose it */
+	char label[128], format[128];
+/* What the hash file looked like */
+	uint64_t file_size, file_mtime, file_ino, file_dev;
+	uint32_t arch, binary_size, binary_align;
+	uint32_t input_enc, target_enc, field_sep;
+	uint32_t db_flags, salt_count;
+	uint64_t entry_count, salts_offset;
+};
+
+/* The binary follows, then the ciphertext, login, GECOS, home and uid */
+struct ldr_cache_entry {
+	uint32_t size, salt, index, count, flags;
+};
+
+/* Entry flags */
+#define LDR_CACHE_NEW_LINE		0x01
+#define LDR_CACHE_NO_LOGIN		0x02
+
+#define LDR_CACHE_ARCH \
+	((uint32_t)sizeof(void *) | (ARCH_LITTLE_ENDIAN << 8))
+
+static struct {
+	FILE *file;
+	char *name, *tmp_name;
+	uint64_t pos, entry_count;
+	uint64_t *salts;
+	uint32_t salt_count, salt_max, align;
+	uint32_t input_enc, target_enc;
+	int new_line;
+} ldr_cache;
+
+static char *ldr_cache_name(char *name)
+{
+	char *cache_name;
+
+	name = (char *)path_expand(name);
+	cache_name = mem_alloc(strlen(name) + sizeof(LDR_CACHE_SUFFIX));
+	strcpy(cache_name, name);
+	strcat(cache_name, LDR_CACHE_SUFFIX);
+
+	return cache_name;
+}
+
+/*
+ * Whether to use a compiled hash file for this hash file at all.
+ */
+static int ldr_cache_usable(struct db_main *db, char *name, struct stat *st)
+{
+	if (!cfg_get_bool(SECTION_OPTIONS, NULL, "CompileHashFiles", 0))
+		return 0;
+
+	if (options.passwd->count != 1 || db->password_count || db->format)
+		return 0;
+
+	if ((db->options->users && db->options->users->count) ||
+	    (db->options->groups && db->options->groups->count) ||
+	    (db->options->shells && db->options->shells->count) ||
+	    (options.flags & FLG_REJECT_PRINTABLE))
+		return 0;
+
+	if (options.format && strlen(options.format) >=
+	    sizeof(((struct ldr_cache_header *)0)->format))
+		return 0;
+
+	if (stat(path_expand(name), st) || !S_ISREG(st->st_mode))
+		return 0;
+
+	return 1;
+}
+
+static uint32_t ldr_cache_align(uint32_t binary_align)
+{
+	return binary_align > sizeof(uint64_t) ?
+		binary_align : sizeof(uint64_t);
+}
+
+/*
+ * Loads the hashes from a compiled hash file if there's an up to date one.
+ * Returns zero if there isn't.
+ */
+static int ldr_cache_load(struct db_main *db, char *name, struct stat *st)
+{
+	char *cache_name = ldr_cache_name(name);
+	struct ldr_cache_header *header;
+	struct fmt_main *format;
+	struct db_salt **salts;
+	struct list_main *words;
+	struct stat cache_st;
+	char *map, *pos;
+	uint64_t i;
+	int fd;
+
+	if ((fd = open(cache_name, O_RDONLY)) < 0) {
+		MEM_FREE(cache_name);
+		return 0;
+	}
+
+	map = MAP_FAILED;
+	if (!fstat(fd, &cache_st) &&
+	    cache_st.st_size >= sizeof(struct ldr_cache_header) &&
+	    (uint64_t)cache_st.st_size == (size_t)cache_st.st_size)
+		map = mmap(NULL, cache_st.st_size, PROT_READ, MAP_SHARED,
+			fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		MEM_FREE(cache_name);
+		return 0;
+	}
+
+	header = (struct ldr_cache_header *)map;
+
+	format = NULL;
+	if (!memcmp(header->magic, LDR_CACHE_MAGIC, sizeof(header->magic)) &&
+	    header->arch == LDR_CACHE_ARCH &&
+	    header->file_size == (uint64_t)st->st_size &&
+	    header->file_mtime == (uint64_t)st->st_mtime &&
+	    header->file_ino == (uint64_t)st->st_ino &&
+	    header->file_dev == (uint64_t)st->st_dev &&
+	    header->input_enc == options.input_enc &&
+	    header->target_enc == options.target_enc &&
+	    header->field_sep == (unsigned char)db->options->field_sep_char &&
+	    !strncmp(header->format, options.format ? options.format : "",
+	    sizeof(header->format)) &&
+	    header->salts_offset <= cache_st.st_size &&
+	    header->salt_count <= (cache_st.st_size - header->salts_offset) /
+	    sizeof(uint64_t))
+	for (format = fmt_list; format; format = format->next)
+		if (!strncmp(format->params.label, header->label,
+		    sizeof(header->label)))
+			break;
+
+	if (!format || format->params.flags & FMT_BLOB ||
+	    header->binary_size != format->params.binary_size ||
+	    header->binary_align != format->params.binary_align) {
+		munmap(map, cache_st.st_size);
+		MEM_FREE(cache_name);
+		return 0;
+	}
+
+	db->format = format;
+	ldr_set_encoding(format);
+#ifdef HAVE_OPENCL
+	if (!(options.acc_devices->count && options.fork &&
+	      strstr(format->params.label, "-opencl")))
+#endif
+	fmt_init(format);
+	dyna_salt_init(format);
+	ldr_init_password_hash(db);
+
+	salts = mem_alloc(header->salt_count * sizeof(*salts));
+	for (i = 0; i < header->salt_count; i++) {
+		uint64_t offset =
+			((uint64_t *)(map + header->salts_offset))[i];
+		void *salt;
+
+		if (offset >= header->salts_offset ||
+		    !memchr(map + offset, 0, header->salts_offset - offset)) {
+			if (john_main_process)
+				fprintf(stderr, "Corrupt compiled hash file %s\n",
+				    cache_name);
+			error();
+		}
+		salt = format->methods.salt(map + offset);
+		dyna_salt_create(salt);
+		salts[i] = ldr_add_salt(db, salt);
+	}
+
+	pos = map + sizeof(struct ldr_cache_header);
+	pos += -(sizeof(struct ldr_cache_header)) &
+		(ldr_cache_align(header->binary_align) - 1);
+	words = NULL;
+	for (i = 0; i < header->entry_count; i++) {
+		struct ldr_cache_entry *entry = (struct ldr_cache_entry *)pos;
+		char fields[LINE_BUFFER_SIZE], *field[4];
+		char *binary, *piece, *login, *gecos, *home, *uid, *p;
+		size_t len;
+		int n;
+
+		if (pos + sizeof(*entry) > map + header->salts_offset ||
+		    entry->size > map + header->salts_offset - pos ||
+		    entry->salt >= header->salt_count) {
+			if (john_main_process)
+				fprintf(stderr, "Corrupt compiled hash file %s\n",
+				    cache_name);
+			error();
+		}
+
+		binary = pos + ((sizeof(*entry) +
+			ldr_cache_align(header->binary_align) - 1) &
+			~(ldr_cache_align(header->binary_align) - 1));
+		piece = binary + header->binary_size;
+
+/* The login and such may get modified in place, so we need copies */
+		p = piece;
+		len = 0;
+		for (n = 0; n < 5; n++) {
+			size_t l = strnlen(p, pos + entry->size - p) + 1;
+
+			if (p + l > pos + entry->size ||
+			    (n && len + l > sizeof(fields))) {
+				if (john_main_process)
+					fprintf(stderr, "Corrupt compiled hash file %s\n",
+					    cache_name);
+				error();
+			}
+			if (n)
+				field[n - 1] = memcpy(&fields[len], p, l);
+			len += n ? l : 0;
+			p += l;
+		}
+		login = field[0];
+		gecos = field[1];
+		home = field[2];
+		uid = field[3];
+		if (entry->flags & LDR_CACHE_NO_LOGIN)
+			login = no_username;
+		if (entry->flags & LDR_CACHE_NEW_LINE)
+			words = NULL;
+
+		ldr_add_pw(db, salts[entry->salt], piece, binary,
+			db->password_hash_func(binary), 1,
+			login, gecos, home, uid,
+			entry->index, entry->count, &words);
+
+		pos += entry->size;
+		check_abort(0);
+	}
+
+	db->options->flags |= header->db_flags;
+
+	MEM_FREE(salts);
+
+	if (john_main_process && options.verbosity >= VERB_DEFAULT)
+		fprintf(stderr, "Using compiled hash file %s\n", cache_name);
+
+	MEM_FREE(cache_name);
+
+	return 1;
+}
+
+/*
+ * Starts saving the hashes we're about to load from a hash file, into a
+ * temporary file until we're done.
+ */
+static void ldr_cache_begin(char *name)
+{
+	ldr_cache.name = ldr_cache_name(name);
+	ldr_cache.tmp_name = mem_alloc(strlen(ldr_cache.name) + 16);
+	sprintf(ldr_cache.tmp_name, "%s.%u", ldr_cache.name,
+		(unsigned int)getpid());
+
+	if (!(ldr_cache.file = fopen(ldr_cache.tmp_name, "wb"))) {
+		MEM_FREE(ldr_cache.tmp_name);
+		MEM_FREE(ldr_cache.name);
+		return;
+	}
+
+/* The header is written last, but loading may change the encodings */
+	ldr_cache.input_enc = options.input_enc;
+	ldr_cache.target_enc = options.target_enc;
+	ldr_cache.pos = 0;
+	ldr_cache.entry_count = 0;
+	ldr_cache.salts = NULL;
+	ldr_cache.salt_count = ldr_cache.salt_max = 0;
+	ldr_cache.align = 0;
+}
+
+static void ldr_cache_pad(uint32_t align)
+{
+	while (ldr_cache.pos & (align - 1)) {
+		putc(0, ldr_cache.file);
+		ldr_cache.pos++;
+	}
+}
+
+static void ldr_cache_write(const void *data, size_t size)
+{
+	fwrite(data, size, 1, ldr_cache.file);
+	ldr_cache.pos += size;
+}
+
+static void ldr_cache_add(struct db_main *db, struct db_salt *salt,
+	char *piece, void *binary, char *login, char *gecos, char *home,
+	char *uid, int index, int count)
+{
+	struct fmt_main *format = db->format;
+	struct ldr_cache_entry entry;
+	uint64_t start;
+
+	if (!ldr_cache.align) {
+		ldr_cache.align = ldr_cache_align(format->params.binary_align);
+		ldr_cache.pos = sizeof(struct ldr_cache_header);
+		fseek(ldr_cache.file, ldr_cache.pos, SEEK_SET);
+	}
+
+	ldr_cache_pad(ldr_cache.align);
+	start = ldr_cache.pos;
+
+	entry.size = 0;
+	entry.salt = salt->sequential_id;
+	entry.index = index;
+	entry.count = count;
+	entry.flags = 0;
+	if (ldr_cache.new_line) {
+		entry.flags |= LDR_CACHE_NEW_LINE;
+		ldr_cache.new_line = 0;
+	}
+	if (login == no_username)
+		entry.flags |= LDR_CACHE_NO_LOGIN;
+	ldr_cache_write(&entry, sizeof(entry));
+	ldr_cache_pad(ldr_cache.align);
+	ldr_cache_write(binary, format->params.binary_size);
+
+	if (entry.salt == ldr_cache.salt_count) {
+		if (ldr_cache.salt_count == ldr_cache.salt_max) {
+			ldr_cache.salt_max = ldr_cache.salt_max ?
+				ldr_cache.salt_max * 2 : 0x100;
+			ldr_cache.salts = mem_realloc(ldr_cache.salts,
+				ldr_cache.salt_max * sizeof(*ldr_cache.salts));
+		}
+		ldr_cache.salts[ldr_cache.salt_count++] = ldr_cache.pos;
+	}
+
+	ldr_cache_write(piece, strlen(piece) + 1);
+	ldr_cache_write(login, strlen(login) + 1);
+	ldr_cache_write(gecos, strlen(gecos) + 1);
+	ldr_cache_write(home, strlen(home) + 1);
+	ldr_cache_write(uid, strlen(uid) + 1);
+	ldr_cache_pad(ldr_cache.align);
+
+/* Go back and fill in the size */
+	entry.size = ldr_cache.pos - start;
+	fseek(ldr_cache.file, start, SEEK_SET);
+	fwrite(&entry.size, sizeof(entry.size), 1, ldr_cache.file);
+	fseek(ldr_cache.file, ldr_cache.pos, SEEK_SET);
+
+	ldr_cache.entry_count++;
+}
+
+/*
+ * Completes the compiled hash file, or gives up on it if we couldn't save
+ * everything we've loaded.
+ */
+static void ldr_cache_end(struct db_main *db, struct stat *st)
+{
+	struct ldr_cache_header header;
+	int ok;
+
+	if (!ldr_cache.file)
+		return;
+
+	ok = db->format && !(db->format->params.flags & FMT_BLOB) &&
+		ldr_cache.salt_count == db->salt_count &&
+		ldr_cache.entry_count == db->password_count;
+
+	if (ok) {
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, LDR_CACHE_MAGIC, sizeof(header.magic));
+		strnzcpy(header.label, db->format->params.label,
+			sizeof(header.label));
+		strnzcpy(header.format, options.format ? options.format : "",
+			sizeof(header.format));
+		header.file_size = st->st_size;
+		header.file_mtime = st->st_mtime;
+		header.file_ino = st->st_ino;
+		header.file_dev = st->st_dev;
+		header.arch = LDR_CACHE_ARCH;
+		header.binary_size = db->format->params.binary_size;
+		header.binary_align = db->format->params.binary_align;
+		header.input_enc = ldr_cache.input_enc;
+		header.target_enc = ldr_cache.target_enc;
+		header.field_sep = (unsigned char)db->options->field_sep_char;
+		header.db_flags = db->options->flags & (DB_SPLIT | DB_NODUP);
+		header.salt_count = ldr_cache.salt_count;
+		header.entry_count = ldr_cache.entry_count;
+
+		ldr_cache_pad(sizeof(uint64_t));
+		header.salts_offset = ldr_cache.pos;
+		ldr_cache_write(ldr_cache.salts,
+			ldr_cache.salt_count * sizeof(*ldr_cache.salts));
+
+		fseek(ldr_cache.file, 0, SEEK_SET);
+		fwrite(&header, sizeof(header), 1, ldr_cache.file);
+	}
+
+	if (ferror(ldr_cache.file))
+		ok = 0;
+	if (fclose(ldr_cache.file))
+		ok = 0;
+	ldr_cache.file = NULL;
+
+	if (ok && !rename(ldr_cache.tmp_name, ldr_cache.name)) {
+		if (john_main_process && options.verbosity >= VERB_DEFAULT)
+			fprintf(stderr, "Wrote compiled hash file %s\n",
+			    ldr_cache.name);
+	} else
+		unlink(ldr_cache.tmp_name);
+
+	MEM_FREE(ldr_cache.salts);
+	MEM_FREE(ldr_cache.tmp_name);
+	MEM_FREE(ldr_cache.name);
+}
+#endif /* HAVE_MMAP */
+
+static int ldr_dupe_checking = 1;
+
+/*
+ * Loads one of the ciphertexts from a line given its binary, and its salt if
+ * we've got that already (or NULL).
+ */
+static void ldr_load_pw_piece(struct db_main *db, char *piece,
+	void *binary, void *salt,
+	char *login, char *gecos, char *home, char *uid,
+	int index, int count, struct list_main **words)
+{
+	struct fmt_main *format = db->format;
+	struct db_salt *current_salt;
+	struct db_password *current_pw;
+	int pw_hash;
+
+	if (!db->password_hash) {
+		ldr_init_password_hash(db);
+		if ((ldr_dupe_checking = options.loader_dupecheck) == -1)
+			/* Config option is deprecated; Drop after 1.9.0-Jumbo-2 */
+			ldr_dupe_checking = !cfg_get_bool(SECTION_OPTIONS, NULL, "NoLoaderDupeCheck", 0);
+
+		if (john_main_process && !ldr_dupe_checking)
+			fprintf(stderr, "No dupe-checking performed when loading hashes.\n");
+	}
+
+	pw_hash = db->password_hash_func(binary);
+
+	if (options.flags & FLG_REJECT_PRINTABLE) {
+		int i = 0;
+
+		while (isprint((int)((uint8_t*)BLOB_BINARY(format, binary))[i]) &&
+		       i < BLOB_SIZE(format, binary))
+			i++;
+
+		if (i == BLOB_SIZE(format, binary)) {
+			if (john_main_process)
+			fprintf(stderr, "rejecting printable binary"
+			        " \"%.*s\" (%s)\n",
+			        (int)BLOB_SIZE(format, binary),
+			        (char*)BLOB_BINARY(format, binary), piece);
+			BLOB_FREE(format, binary);
+			return;
+		}
+	}
+
+	if (!(db->options->flags & DB_WORDS) && ldr_dupe_checking) {
+		int collisions = 0;
+		if ((current_pw = db->password_hash[pw_hash]))
+		do {
+			if (!fmt_bincmp(binary, current_pw->binary, format) &&
+			    !strcmp(piece, format->methods.source(
+			    current_pw->source, current_pw->binary))) {
+				db->options->flags |= DB_NODUP;
+				break;
+			}
+			if (++collisions <= LDR_HASH_COLLISIONS_MAX)
+				continue;
+
+			if (john_main_process) {
+				if (format->params.binary_size)
+				fprintf(stderr, "Warning: "
+				    "excessive partial hash "
+				    "collisions detected\n%s",
+				    db->password_hash_func !=
+				    fmt_default_binary_hash ? "" :
+				    "(cause: the \"format\" lacks "
+				    "proper binary_hash() function "
+				    "definitions)\n");
+				else
+				fprintf(stderr, "Warning: "
+				    "check for duplicates partially "
+				    "bypassed to speedup loading\n");
+			}
+			ldr_dupe_checking = 0;
+			current_pw = NULL; /* no match */
+			break;
+		} while ((current_pw = current_pw->next_hash));
+
+		if (current_pw) {
+			BLOB_FREE(format, binary);
+			return;
+		}
+	}
+
+	if (!salt)
+		salt = format->methods.salt(piece);
+	dyna_salt_create(salt);
+	current_salt = ldr_add_salt(db, salt);
+
+	ldr_add_pw(db, current_salt, piece, binary, pw_hash, 0,
+		login, gecos, home, uid, index, count, words);
+
+#if HAVE_MMAP
+	if (ldr_cache.file)
+		ldr_cache_add(db, current_salt, piece, binary,
+			login, gecos, home, uid, index, count);
+#endif
+}
+
 #ifdef HAVE_FUZZ
 void ldr_load_pw_line(struct db_main *db, char *line)
 #else
 static void ldr_load_pw_line(struct db_main *db, char *line)
 #endif
 {
-	static int dupe_checking = 1;
 	struct fmt_main *format;
 	int index, count;
 	char *login, *ciphertext, *gecos, *home, *uid;
-	char *piece;
-	void *binary, *salt;
-	int salt_hash, pw_hash;
-	struct db_salt *current_salt, *last_salt;
-	struct db_password *current_pw, *last_pw;
 	struct list_main *words;
-	size_t pw_size;
-	int i;
 
 #ifdef HAVE_FUZZ
 	char *line_sb;
@@ -959,187 +1626,374 @@ static void ldr_load_pw_line(struct db_main *db, char *line)
 	dyna_salt_init(format);
 
 	words = NULL;
+#if HAVE_MMAP
+	ldr_cache.new_line = 1;
+#endif
 
-	if (!db->password_hash) {
-		ldr_init_password_hash(db);
-		if ((dupe_checking = options.loader_dupecheck) == -1)
-			/* Config option is deprecated; Drop after 1.9.0-Jumbo-2 */
-			dupe_checking = !cfg_get_bool(SECTION_OPTIONS, NULL, "NoLoaderDupeCheck", 0);
+	for (index = 0; index < count; index++) {
+		char *piece = format->methods.split(ciphertext, index, format);
 
-		if (john_main_process && !dupe_checking)
-			fprintf(stderr, "No dupe-checking performed when loading hashes.\n");
+		ldr_load_pw_piece(db, piece, format->methods.binary(piece),
+			NULL, login, gecos, home, uid, index, count, &words);
 	}
+}
 
-	for (index = 0; index < count; index++) {
-		piece = format->methods.split(ciphertext, index, format);
+#if OS_FORK
+/*
+ * Parallel loading.
+ *
+ * Formats' prepare(), valid(), split(), binary() and salt() methods commonly
+ * return pointers to static buffers, so rather than calling them from threads
+ * we hand chunks of the hash file to child processes.  Each child writes what
+ * it got from those methods to a temporary file, and we merge the results in
+ * chunk order, doing the dupe checks and all else exactly as when loading
+ * serially.  So the database ends up the same, only sooner.
+ */
+#define LDR_PAR_CHUNK_SIZE		(8 << 20)
 
-		binary = format->methods.binary(piece);
-		pw_hash = db->password_hash_func(binary);
+struct ldr_par_chunk {
+	char *lines;
+	size_t size, alloc;
+	pid_t pid;
+	FILE *results;
+};
 
-		if (options.flags & FLG_REJECT_PRINTABLE) {
-			int i = 0;
+static struct {
+	int workers, running, head, checked;
+	struct ldr_par_chunk *chunks;
+} ldr_par;
 
-			while (isprint((int)((uint8_t*)BLOB_BINARY(format, binary))[i]) &&
-			       i < BLOB_SIZE(format, binary))
-				i++;
+static int ldr_par_init(struct db_main *db, char *name)
+{
+	struct stat st;
+	int workers;
 
-			if (i == BLOB_SIZE(format, binary)) {
-				if (john_main_process)
-				fprintf(stderr, "rejecting printable binary"
-				        " \"%.*s\" (%s)\n",
-				        (int)BLOB_SIZE(format, binary),
-				        (char*)BLOB_BINARY(format, binary), piece);
-				BLOB_FREE(format, binary);
-				continue;
-			}
-		}
+	if ((workers = cfg_get_int(SECTION_OPTIONS, NULL,
+	    "LoaderProcesses")) == 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+		workers = 1;
+#endif
+	}
 
-		if (!(db->options->flags & DB_WORDS) && dupe_checking) {
-			int collisions = 0;
-			if ((current_pw = db->password_hash[pw_hash]))
-			do {
-				if (!fmt_bincmp(binary, current_pw->binary, format) &&
-				    !strcmp(piece, format->methods.source(
-				    current_pw->source, current_pw->binary))) {
-					db->options->flags |= DB_NODUP;
-					break;
-				}
-				if (++collisions <= LDR_HASH_COLLISIONS_MAX)
-					continue;
+#if HAVE_MPI
+	if (mpi_p > 1)
+		workers = 1;
+#endif
 
-				if (john_main_process) {
-					if (format->params.binary_size)
-					fprintf(stderr, "Warning: "
-					    "excessive partial hash "
-					    "collisions detected\n%s",
-					    db->password_hash_func !=
-					    fmt_default_binary_hash ? "" :
-					    "(cause: the \"format\" lacks "
-					    "proper binary_hash() function "
-					    "definitions)\n");
-					else
-					fprintf(stderr, "Warning: "
-					    "check for duplicates partially "
-					    "bypassed to speedup loading\n");
-				}
-				dupe_checking = 0;
-				current_pw = NULL; /* no match */
-				break;
-			} while ((current_pw = current_pw->next_hash));
+	if (workers <= 1 || stat(path_expand(name), &st) ||
+	    !S_ISREG(st.st_mode) || st.st_size < 2 * LDR_PAR_CHUNK_SIZE)
+		return 0;
 
-			if (current_pw) {
-				BLOB_FREE(format, binary);
-				continue;
-			}
-		}
+	ldr_par.workers = workers;
+	ldr_par.running = ldr_par.head = ldr_par.checked = 0;
+/* One more chunk than workers, to fill while they're all busy */
+	ldr_par.chunks = mem_calloc(workers + 1, sizeof(*ldr_par.chunks));
 
-		salt = format->methods.salt(piece);
-		dyna_salt_create(salt);
-		salt_hash = format->methods.salt_hash(salt);
+	return 1;
+}
 
-		if ((current_salt = db->salt_hash[salt_hash])) {
-			do {
-				if (!dyna_salt_cmp(current_salt->salt, salt, format->params.salt_size))
-					break;
-			}  while ((current_salt = current_salt->next));
+static void ldr_par_write(const void *data, size_t size, FILE *file)
+{
+	if (size && fwrite(data, size, 1, file) != 1)
+		_exit(1);
+}
+
+static void ldr_par_write_string(const char *string, FILE *file)
+{
+	uint32_t len = strlen(string) + 1;
+
+	ldr_par_write(&len, sizeof(len), file);
+	ldr_par_write(string, len, file);
+}
+
+/*
+ * The child's part.  It never returns.
+ */
+static void ldr_par_work(struct db_main *db, struct ldr_par_chunk *chunk)
+{
+	struct fmt_main *format = db->format, *alt;
+	char *line = chunk->lines, *end = chunk->lines + chunk->size;
+	FILE *file = chunk->results;
+	uint32_t n;
+
+/* Let our parent do all the talking, such as warnings on other hash types */
+	john_main_process = 0;
+
+	while (line < end) {
+		char *next = line + strlen(line) + 1;
+		char *login, *ciphertext, *gecos, *home, *uid;
+		int32_t count, index;
+
+		count = ldr_split_line(&login, &ciphertext, &gecos, &home,
+			&uid, NULL, &db->format, db->options, line);
+		line = next;
+		if (count <= 0)
+			continue;
+
+		ldr_par_write(&count, sizeof(count), file);
+		n = (login == no_username);
+		ldr_par_write(&n, sizeof(n), file);
+		n = strlen(login) + strlen(gecos) + strlen(home) +
+			strlen(uid) + 4;
+		ldr_par_write(&n, sizeof(n), file);
+		ldr_par_write(login, strlen(login) + 1, file);
+		ldr_par_write(gecos, strlen(gecos) + 1, file);
+		ldr_par_write(home, strlen(home) + 1, file);
+		ldr_par_write(uid, strlen(uid) + 1, file);
+
+		for (index = 0; index < count; index++) {
+			char *piece = format->methods.split(ciphertext, index,
+				format);
+
+			ldr_par_write_string(piece, file);
+			ldr_par_write(format->methods.binary(piece),
+				format->params.binary_size, file);
+			ldr_par_write(format->methods.salt(piece),
+				format->params.salt_size, file);
 		}
+	}
 
-		if (!current_salt) {
-			last_salt = db->salt_hash[salt_hash];
-			current_salt = db->salt_hash[salt_hash] =
-				mem_alloc_tiny(db->salt_size, MEM_ALIGN_WORD);
-			current_salt->next = last_salt;
+	n = 0;
+	ldr_par_write(&n, sizeof(n), file);
 
-			current_salt->salt = mem_alloc_copy(salt,
-				format->params.salt_size,
-				format->params.salt_align);
+/* Report the other hash types we've seen */
+	for (alt = fmt_list, n = 0; alt; alt = alt->next, n++)
+	if (alt->params.flags & FMT_WARNED)
+		ldr_par_write(&n, sizeof(n), file);
+	n = ~(uint32_t)0;
+	ldr_par_write(&n, sizeof(n), file);
 
-			for (i = 0; i < FMT_TUNABLE_COSTS && format->methods.tunable_cost_value[i] != NULL; ++i)
-				current_salt->cost[i] = format->methods.tunable_cost_value[i](current_salt->salt);
+	if (fflush(file))
+		_exit(1);
+	_exit(0);
+}
 
-			current_salt->index = fmt_dummy_hash;
-			current_salt->bitmap = NULL;
-			current_salt->list = NULL;
-			current_salt->hash = &current_salt->list;
-			current_salt->hash_size = -1;
+static void ldr_par_read(void *data, size_t size, FILE *file)
+{
+	if (size && fread(data, size, 1, file) != 1) {
+		if (john_main_process)
+			fprintf(stderr, "Error reading loader child process "
+			    "results\n");
+		error();
+	}
+}
 
-			current_salt->count = 0;
+/*
+ * Reads a length and that many bytes into a buffer, which grows as needed.
+ */
+static char *ldr_par_read_block(char **buf, size_t *alloc, FILE *file)
+{
+	uint32_t len;
 
-			if (db->options->flags & DB_WORDS)
-				current_salt->keys = NULL;
+	ldr_par_read(&len, sizeof(len), file);
+	if (len > *alloc) {
+		MEM_FREE(*buf);
+		*buf = mem_alloc(*alloc = len);
+	}
+	ldr_par_read(*buf, len, file);
 
-			db->salt_count++;
-		} else
-			dyna_salt_remove(salt);
+	return *buf;
+}
 
-		current_salt->count++;
-		db->password_count++;
+/*
+ * Adds the hashes from the oldest chunk to the database.
+ */
+static void ldr_par_merge(struct db_main *db)
+{
+	struct fmt_main *format = db->format, *alt;
+	struct ldr_par_chunk *chunk = &ldr_par.chunks[ldr_par.head];
+	static char *fields, *pieces;
+	static size_t fields_alloc, pieces_alloc;
+	void *binary, *salt;
+	int status;
+	uint32_t n;
 
-/* If we're not allocating memory for the "login" field, we may as well not
- * allocate it for the "source" field if the format doesn't need it. */
-		pw_size = db->pw_size;
-		if (!(db->options->flags & DB_LOGIN) &&
-		    format->methods.source != fmt_default_source)
-			pw_size -= sizeof(char *);
+	while (waitpid(chunk->pid, &status, 0) < 0)
+		if (errno != EINTR)
+			pexit("waitpid");
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		if (john_main_process)
+			fprintf(stderr, "Loader child process failed\n");
+		error();
+	}
 
-		last_pw = current_salt->list;
-		current_pw = current_salt->list = mem_alloc_tiny(
-			pw_size, MEM_ALIGN_WORD);
-		current_pw->next = last_pw;
+	binary = mem_alloc_align(format->params.binary_size + 1,
+		format->params.binary_align);
+	salt = mem_alloc_align(format->params.salt_size + 1,
+		format->params.salt_align);
 
-		last_pw = db->password_hash[pw_hash];
-		db->password_hash[pw_hash] = current_pw;
-		current_pw->next_hash = last_pw;
+	rewind(chunk->results);
+	for (;;) {
+		char *login, *gecos, *home, *uid;
+		struct list_main *words = NULL;
+		int32_t count, index;
 
-/* If we're not going to use the source field for its usual purpose yet we had
- * to allocate memory for it (because we need at least one field after it), see
- * if we can pack the binary value in it. */
-		if ((db->options->flags & DB_LOGIN) &&
-		    format->methods.source != fmt_default_source &&
-		    sizeof(current_pw->source) >= format->params.binary_size)
-			current_pw->binary = memcpy(&current_pw->source,
-				binary, format->params.binary_size);
-		else
-			current_pw->binary = mem_alloc_copy(binary,
-				format->params.binary_size,
-				format->params.binary_align);
+		ldr_par_read(&count, sizeof(count), chunk->results);
+		if (!count)
+			break;
+		if (count >= 2)
+			db->options->flags |= DB_SPLIT;
+
+		ldr_par_read(&n, sizeof(n), chunk->results);
+		login = ldr_par_read_block(&fields, &fields_alloc,
+			chunk->results);
+		gecos = login + strlen(login) + 1;
+		home = gecos + strlen(gecos) + 1;
+		uid = home + strlen(home) + 1;
+		if (n)
+			login = no_username;
+
+#if HAVE_MMAP
+		ldr_cache.new_line = 1;
+#endif
+		for (index = 0; index < count; index++) {
+			char *piece = ldr_par_read_block(&pieces,
+				&pieces_alloc, chunk->results);
 
-		if (format->methods.source == fmt_default_source)
-			current_pw->source = str_alloc_copy(piece);
+			ldr_par_read(binary, format->params.binary_size,
+				chunk->results);
+			ldr_par_read(salt, format->params.salt_size,
+				chunk->results);
 
-		if (db->options->flags & DB_WORDS) {
-			if (!words)
-				words = ldr_init_words(login, gecos, home);
-			current_pw->words = words;
+			ldr_load_pw_piece(db, piece, binary, salt,
+				login, gecos, home, uid, index, count, &words);
 		}
 
-		if (db->options->flags & DB_LOGIN) {
-			if (login != no_username && index == 0)
-				login = ldr_conv(login);
+		check_abort(0);
+	}
 
-			if (options.show_uid_in_cracks)
-				current_pw->uid = str_alloc_copy(uid);
+	for (;;) {
+		ldr_par_read(&n, sizeof(n), chunk->results);
+		if (n == ~(uint32_t)0)
+			break;
+		for (alt = fmt_list; alt && n; alt = alt->next)
+			n--;
+		if (alt && !(alt->params.flags & FMT_WARNED))
+			ldr_warn_other_type(format, alt);
+	}
 
-			if (count >= 2 && count <= 9) {
-				current_pw->login = mem_alloc_tiny(
-					strlen(login) + 3, MEM_ALIGN_NONE);
-				sprintf(current_pw->login, "%s:%d",
-					login, index + 1);
-			} else
-			if (login == no_username)
-				current_pw->login = login;
-			else
-			if (words && *login)
-				current_pw->login = words->head->data;
-			else
-				current_pw->login = str_alloc_copy(login);
+	MEM_FREE(salt);
+	MEM_FREE(binary);
+
+	fclose(chunk->results);
+	chunk->results = NULL;
+	chunk->size = 0;
+
+	ldr_par.head = (ldr_par.head + 1) % (ldr_par.workers + 1);
+	ldr_par.running--;
+}
+
+/*
+ * Hands the chunk being filled to a new child process, once there's one
+ * available.
+ */
+static void ldr_par_start(struct db_main *db)
+{
+	struct ldr_par_chunk *chunk;
+	char *line;
+
+	if (ldr_par.running == ldr_par.workers)
+		ldr_par_merge(db);
+
+	chunk = &ldr_par.chunks[(ldr_par.head + ldr_par.running) %
+		(ldr_par.workers + 1)];
+
+	fflush(stdout);
+	fflush(stderr);
+	if ((chunk->results = tmpfile()) &&
+	    (chunk->pid = fork()) != -1) {
+		if (!chunk->pid)
+			ldr_par_work(db, chunk);
+		ldr_par.running++;
+		return;
+	}
+
+/* Can't have a child process, so load the chunk ourselves, in order */
+	if (chunk->results)
+		fclose(chunk->results);
+	chunk->results = NULL;
+	while (ldr_par.running)
+		ldr_par_merge(db);
+	line = chunk->lines;
+	while (line < chunk->lines + chunk->size) {
+		char *next = line + strlen(line) + 1;
+		ldr_load_pw_line(db, line);
+		line = next;
+	}
+	chunk->size = 0;
+}
+
+static void ldr_par_load_pw_line(struct db_main *db, char *line)
+{
+	struct ldr_par_chunk *chunk;
+	size_t len;
+
+/* Lines are loaded serially until one tells us what the format is */
+	if (!ldr_par.checked) {
+		struct fmt_main *format;
+
+		if (!db->format) {
+			ldr_load_pw_line(db, line);
+			return;
 		}
+
+/* Salts are copied from the children, so they must not hold pointers */
+		format = db->format;
+		if (!(format->params.flags & FMT_FLAT_SALT) ||
+		    (format->params.flags &
+		    (FMT_DYNAMIC | FMT_BLOB | FMT_DYNA_SALT)))
+			ldr_par.workers = 0;
+		dyna_salt_init(format);
+		ldr_par.checked = 1;
 	}
+
+	if (!ldr_par.workers) {
+		ldr_load_pw_line(db, line);
+		return;
+	}
+
+	chunk = &ldr_par.chunks[(ldr_par.head + ldr_par.running) %
+		(ldr_par.workers + 1)];
+	len = strlen(line) + 1;
+	if (chunk->size + len > chunk->alloc) {
+		chunk->alloc = chunk->size + len + LDR_PAR_CHUNK_SIZE;
+		chunk->lines = mem_realloc(chunk->lines, chunk->alloc);
+	}
+	memcpy(chunk->lines + chunk->size, line, len);
+	chunk->size += len;
+
+	if (chunk->size >= LDR_PAR_CHUNK_SIZE)
+		ldr_par_start(db);
 }
 
+static void ldr_par_done(struct db_main *db)
+{
+	int i;
+
+	if (ldr_par.workers &&
+	    ldr_par.chunks[(ldr_par.head + ldr_par.running) %
+	    (ldr_par.workers + 1)].size)
+		ldr_par_start(db);
+
+	while (ldr_par.running)
+		ldr_par_merge(db);
+
+	for (i = 0; i <= ldr_par.workers; i++)
+		MEM_FREE(ldr_par.chunks[i].lines);
+	MEM_FREE(ldr_par.chunks);
+	ldr_par.workers = 0;
+}
+#endif /* OS_FORK */
+
 void ldr_load_pw_file(struct db_main *db, char *name)
 {
 	static int init;
+#if HAVE_MMAP
+	struct stat st;
+	int caching;
+#endif
 
 	if (!init) {
 		struct cfg_list *conf_seeds;
@@ -1186,7 +2040,26 @@ void ldr_load_pw_file(struct db_main *db, char *name)
 		init = 1;
 	}
 
+#if HAVE_MMAP
+	if ((caching = ldr_cache_usable(db, name, &st))) {
+		if (ldr_cache_load(db, name, &st))
+			return;
+		ldr_cache_begin(name);
+	}
+#endif
+
+#if OS_FORK
+	if (ldr_par_init(db, name)) {
+		read_file(db, name, RF_ALLOW_DIR, ldr_par_load_pw_line);
+		ldr_par_done(db);
+	} else
+#endif
 	read_file(db, name, RF_ALLOW_DIR, ldr_load_pw_line);
+
+#if HAVE_MMAP
+	if (caching)
+		ldr_cache_end(db, &st);
+#endif
 }
 
 int ldr_trunc_valid(char *ciphertext, struct fmt_main *format)
@@ -1326,6 +2199,11 @@ struct db_main *ldr_init_test_db(struct fmt_main *format, struct db_main *real)
 void ldr_free_db(struct db_main *db, int base)
 {
 	if (db) {
+		struct db_salt *salt;
+
+		for (salt = db->salts; salt; salt = salt->next)
+			MEM_FREE(salt->table);
+
 		if (db->format &&
 		    (db->format->params.flags & (FMT_DYNA_SALT | FMT_BLOB))) {
 			struct db_salt *psalt = db->salts;
@@ -1722,6 +2600,7 @@ static void ldr_init_hash_for_salt(struct db_main *db, struct db_salt *salt)
 	struct db_password *current;
 	int (*hash_func)(void *binary);
 	size_t bitmap_size, hash_size;
+	unsigned int buckets;
 	int hash;
 
 	if (salt->hash_size < 0) {
@@ -1754,7 +2633,15 @@ static void ldr_init_hash_for_salt(struct db_main *db, struct db_salt *salt)
 	}
 
 	hash_size = bitmap_size >> PASSWORD_HASH_SHR;
-	if (hash_size > 1) {
+	if (salt->count >= ldr_compact_threshold &&
+	    (buckets = hashtab_buckets(salt->count, bitmap_size))) {
+		salt->table = mem_calloc_align(buckets, sizeof(*salt->table),
+		    MEM_ALIGN_CACHE);
+		salt->table_mask = buckets - 1;
+		hash_size = 0;
+		log_event("- Using a compact hash table of %u buckets for %d hashes",
+		    buckets, salt->count);
+	} else if (hash_size > 1) {
 		size_t size = hash_size * sizeof(struct db_password *);
 		salt->hash = mem_alloc_tiny(size, MEM_ALIGN_WORD);
 		memset(salt->hash, 0, size);
@@ -1770,7 +2657,11 @@ static void ldr_init_hash_for_salt(struct db_main *db, struct db_salt *salt)
 		hash = hash_func(current->binary);
 		salt->bitmap[hash / (sizeof(*salt->bitmap) * 8)] |=
 		    1U << (hash % (sizeof(*salt->bitmap) * 8));
-		if (hash_size > 1) {
+		if (salt->table) {
+			current->next_hash = NULL; /* unused */
+			hashtab_insert(salt->table, salt->table_mask,
+			    hash, current);
+		} else if (hash_size > 1) {
 			hash >>= PASSWORD_HASH_SHR;
 			current->next_hash = salt->hash[hash];
 			salt->hash[hash] = current;
@@ -1780,6 +2671,27 @@ static void ldr_init_hash_for_salt(struct db_main *db, struct db_salt *salt)
 	} while ((current = current->next));
 }
 
+/*
+ * Returns the largest hash table size code the format supports that is right
+ * for this many hashes, or -1 if none is.
+ */
+static int ldr_pick_hash_size(struct db_main *db, int count)
+{
+	int size;
+
+	for (size = PASSWORD_HASH_SIZES - 1; size >= 0; size--)
+		if (count >= password_hash_thresholds[size] &&
+		    db->format->methods.binary_hash[size] &&
+		    db->format->methods.binary_hash[size] !=
+		    fmt_default_binary_hash &&
+		    db->format->methods.get_hash[size] &&
+		    db->format->methods.get_hash[size] !=
+			fmt_default_get_hash)
+			break;
+
+	return size;
+}
+
 /*
  * Decide on whether to use a hash table and on its size for each salt, call
  * ldr_init_hash_for_salt() to allocate and initialize the hash tables.
@@ -1789,6 +2701,13 @@ static void ldr_init_hash(struct db_main *db)
 	struct db_salt *current;
 	int threshold, size;
 
+	ldr_compact_threshold = cfg_get_int(SECTION_OPTIONS, NULL,
+	    "CompactHashThreshold");
+	if (ldr_compact_threshold < 0)
+		ldr_compact_threshold = PASSWORD_HASH_COMPACT_THRESHOLD;
+	else if (!ldr_compact_threshold)
+		ldr_compact_threshold = INT_MAX;
+
 	threshold = password_hash_thresholds[0];
 	if (db->format && (db->format->params.flags & FMT_BS)) {
 /*
@@ -1808,16 +2727,7 @@ static void ldr_init_hash(struct db_main *db)
 	do {
 		size = -1;
 		if (current->count >= threshold && mem_saving_level < 3)
-			for (size = PASSWORD_HASH_SIZES - 1; size >= 0; size--)
-				if (current->count >=
-				    password_hash_thresholds[size] &&
-				    db->format->methods.binary_hash[size] &&
-				    db->format->methods.binary_hash[size] !=
-				    fmt_default_binary_hash &&
-				    db->format->methods.get_hash[size] &&
-				    db->format->methods.get_hash[size] !=
-					fmt_default_get_hash)
-					break;
+			size = ldr_pick_hash_size(db, current->count);
 
 		if (mem_saving_level >= 2)
 			size--;
@@ -1827,6 +2737,110 @@ static void ldr_init_hash(struct db_main *db)
 	} while ((current = current->next));
 }
 
+void ldr_shrink_hash(struct db_main *db, struct db_salt *salt)
+{
+	struct db_password **live, *current;
+	int (*hash_func)(void *binary);
+	unsigned int bitmap_size, buckets = 0;
+	int old = salt->hash_size, size, count = 0, hash, i;
+
+	if (!salt->bitmap || old <= 0 ||
+	    salt->count >= password_hash_thresholds[old] / 2 ||
+	    (db->format->params.flags & FMT_BLOB))
+		return;
+
+	size = ldr_pick_hash_size(db, salt->count);
+	if (mem_saving_level >= 2)
+		size--;
+	if (size < 0)
+		size = 0; /* keep the bitmap, the list isn't maintained */
+	if (size >= old)
+		return;
+
+	bitmap_size = password_hash_sizes[size];
+	if (salt->table &&
+	    !(buckets = hashtab_buckets(salt->count, bitmap_size)))
+		return;
+
+/*
+ * Collect what's left.  Removed entries may still be on a chain, but their
+ * bits in the bitmap are clear (or their binary is gone), see
+ * crk_remove_hash().
+ */
+	live = mem_alloc(salt->count * sizeof(*live));
+	hash_func = db->format->methods.binary_hash[old];
+	if (salt->table) {
+		int pos, end = (salt->table_mask + 1) * HASHTAB_BUCKET_SIZE;
+
+		for (pos = 0; pos < end && count <= salt->count; pos++)
+			if ((current = HASHTAB_PTR(salt->table, pos))) {
+				if (count < salt->count)
+					live[count] = current;
+				count++;
+			}
+	} else {
+		int n = password_hash_sizes[old] >> PASSWORD_HASH_SHR;
+
+		for (i = 0; i < n && count <= salt->count; i++)
+		for (current = salt->hash[i]; current;
+		     current = current->next_hash) {
+			if (!current->binary)
+				continue;
+			hash = hash_func(current->binary);
+			if (!(salt->bitmap[hash / (sizeof(*salt->bitmap) * 8)] &
+			    (1U << (hash % (sizeof(*salt->bitmap) * 8)))))
+				continue;
+			if (count < salt->count)
+				live[count] = current;
+			count++;
+		}
+	}
+
+	if (count != salt->count) {
+		MEM_FREE(live);
+		return;
+	}
+
+/*
+ * Rebuild.  The smaller bitmap and hash fit in the memory we have, while a
+ * compact table is replaced to actually give its memory back.
+ */
+	memset(salt->bitmap, 0, (bitmap_size + sizeof(*salt->bitmap) * 8 - 1) /
+	    (sizeof(*salt->bitmap) * 8) * sizeof(*salt->bitmap));
+	if (salt->table) {
+		MEM_FREE(salt->table);
+		salt->table = mem_calloc_align(buckets, sizeof(*salt->table),
+		    MEM_ALIGN_CACHE);
+		salt->table_mask = buckets - 1;
+	} else
+		memset(salt->hash, 0, (bitmap_size >> PASSWORD_HASH_SHR) *
+		    sizeof(*salt->hash));
+
+	hash_func = db->format->methods.binary_hash[size];
+	for (i = 0; i < count; i++) {
+		current = live[i];
+		hash = hash_func(current->binary);
+		salt->bitmap[hash / (sizeof(*salt->bitmap) * 8)] |=
+		    1U << (hash % (sizeof(*salt->bitmap) * 8));
+		if (salt->table) {
+			hashtab_insert(salt->table, salt->table_mask,
+			    hash, current);
+		} else {
+			hash >>= PASSWORD_HASH_SHR;
+			current->next_hash = salt->hash[hash];
+			salt->hash[hash] = current;
+		}
+	}
+
+	MEM_FREE(live);
+
+	salt->hash_size = size;
+	salt->index = db->format->methods.get_hash[size];
+
+	log_event("- Shrunk hash table for a salt with %d hashes left to size %d",
+	    count, size);
+}
+
 /*
  * compute cost ranges after all unneeded salts have been removed
  */
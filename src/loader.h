@@ -17,6 +17,7 @@
 #ifndef BENCH_BUILD
 #include "list.h"
 #include "formats.h"
+#include "hashtab.h"
 #endif
 
 /*
@@ -138,6 +139,13 @@ struct db_salt {
 /* Hash table size code, negative for none */
 	int hash_size;
 
+/* Compact hash table used behind the bitmap instead of the hash table above
+ * for salts with very many hashes, or NULL */
+	struct db_hash_bucket *table;
+
+/* Number of buckets in the compact hash table minus one */
+	unsigned int table_mask;
+
 /* Number of passwords with this salt */
 	int count;
 
@@ -307,6 +315,14 @@ extern void ldr_load_pot_file(struct db_main *db, char *name);
  */
 extern void ldr_fix_database(struct db_main *db);
 
+/*
+ * Shrinks the bitmap and hash table of a salt that has lost most of its
+ * hashes to what the loader would pick for the hashes left, in place, so that
+ * they stay small enough for the caches.  Must not be called while results
+ * for the salt are being checked.
+ */
+extern void ldr_shrink_hash(struct db_main *db, struct db_salt *salt);
+
 /*
  * Create a fake database from a format's test vectors and return a pointer
  * to it.
@@ -264,7 +264,7 @@ static void log_file_flush(struct log_file *f)
 			}
 		} else
 #endif
-		if (options.fork)
+		if (options.fork && !crk_pot_sync_shared())
 			raise(SIGUSR2);
 	}
 #endif
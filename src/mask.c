@@ -12,6 +12,8 @@
 #include <stdio.h> /* for fprintf(stderr, ...) */
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "arch.h"
 #include "misc.h" /* for error() */
@@ -29,9 +31,21 @@
 #include "unicode.h"
 #include "encoding_data.h"
 #include "mask_ext.h"
+#include "int128.h"
+#include "crc32.h"
+#include "workq.h"
 
 //#define MASK_DEBUG
 
+#if JTR_HAVE_INT128
+typedef uint128_t uint_big;
+#else
+typedef uint64_t uint_big;
+#endif
+
+/* Default number of chunks per length for --mask-chunks */
+#define MASK_CHUNK_COUNT		1000
+
 extern void wordlist_hybrid_fix_state(void);
 extern void mkv_hybrid_fix_state(void);
 extern void inc_hybrid_fix_state(void);
@@ -68,6 +82,37 @@ static int mask_has_8bit;
  */
 static uint64_t cand, rec_cand;
 
+/*
+ * With --mask-chunks or --work-stealing, the chunk being worked on and the
+ * number of chunks for the current length, and the same for the chunk
+ * rec_cand is in.
+ */
+static unsigned int chunk, chunk_count, rec_chunk, rec_chunk_count;
+/* With --work-stealing, the length chunk is of (0 if not iterating lengths) */
+static int chunk_len = -1;
+
+/*
+ * Chunks claimed since the last mask_fix_state(), followed by those still to
+ * be done after a restore.  They're saved with the session, as the chunk file
+ * has them handed out already.  The first held_used ones were started.
+ */
+struct held_chunk {
+	int len;
+	unsigned int chunk, count;
+};
+static struct held_chunk *held;
+static int held_count, held_used;
+
+/* Whether the keyspace is done in chunks, taken one after another */
+#define MASK_CHUNKED							\
+	(options.mask_chunks ||						\
+	 (workq_active() && !(options.flags & FLG_MASK_STACKED)))
+
+/* Whether the key generators stop after *my_candidates keys */
+#define MASK_LIMITED							\
+	((options.node_count || options.mask_chunks) &&			\
+	 !(options.flags & FLG_MASK_STACKED))
+
 uint64_t mask_tot_cand;
 uint64_t mask_parent_keys;
 
@@ -1626,6 +1671,122 @@ static MAYBE_INLINE char* mask_utf8_to_cp(const char *in)
 		start ? start + ranges(ps).iter :			\
 		ranges(ps).chars[ranges(ps).iter];
 
+/*
+ * Blocks of keys for generate_keys_bulk() are about this size, but always
+ * have room for all values of the first placeholder.
+ */
+#define MASK_BULK_SIZE			0x10000
+
+static char *bulk_keys;
+static size_t bulk_size;
+
+/*
+ * Same as generate_keys(), for when keys need no conversion or filtering.
+ * Keys are written to a block of fixed-stride keys that holds every
+ * combination of the first (fastest) placeholders, so those are written once
+ * per call.  The remaining placeholders work as an odometer over the whole
+ * block, and each block is passed to crk_process_keys() in one go.
+ *
+ * While a block is being processed, the placeholder states (as picked up by
+ * mask_fix_state()) are those of its first key.
+ */
+static int generate_keys_bulk(mask_cpu_context *cpu_mask_ctx,
+                              uint64_t *my_candidates)
+{
+	int ps[MAX_NUM_MASK_PLHDR], pos[MAX_NUM_MASK_PLHDR];
+	int num_ps = 0, inner, len, stride, block, period, first, i, j;
+	int limited = MASK_LIMITED;
+
+	for (j = cpu_mask_ctx->ps1; j < MAX_NUM_MASK_PLHDR; j = ranges(j).next) {
+		if (mask_increments_len &&
+		    ranges(j).pos + ranges(j).offset >= mask_cur_len)
+			break;
+		ps[num_ps] = j;
+		pos[num_ps] = ranges(j).pos + ranges(j).offset;
+		template_key[pos[num_ps++]] = ranges(j).chars[ranges(j).iter];
+	}
+
+	len = strlen(template_key);
+	stride = (len + 1 + 7) & ~7;
+
+	for (inner = 0, block = 1; inner < num_ps; inner++) {
+		int count = ranges(ps[inner]).count;
+
+		if (inner && block * count * stride > MASK_BULK_SIZE)
+			break;
+		block *= count;
+	}
+
+	if (bulk_size < (size_t)block * stride) {
+		MEM_FREE(bulk_keys);
+		bulk_size = (size_t)block * stride;
+		bulk_keys = mem_alloc(bulk_size);
+	}
+
+	for (i = 0; i < block; i++)
+		memcpy(bulk_keys + i * stride, template_key, len + 1);
+
+	for (j = 0, period = 1; j < inner; j++) {
+		mask_range *r = &ranges(ps[j]);
+
+		for (i = 0; i < block; i++)
+			bulk_keys[i * stride + pos[j]] =
+				r->chars[i / period % r->count];
+		period *= r->count;
+	}
+
+	/* Start where we were restored or put by divide_work() */
+	for (j = inner - 1, first = 0; j >= 0; j--)
+		first = first * ranges(ps[j]).count + ranges(ps[j]).iter;
+
+	while (1) {
+		int n = block - first;
+
+		if (limited) {
+			if (!(*my_candidates)--)
+				break;
+			if (n > *my_candidates + 1)
+				n = *my_candidates + 1;
+		}
+
+#ifdef MASK_DEBUG
+		fprintf(stderr, "process_keys(\"%s\", %d)\n",
+		        bulk_keys + first * stride, n);
+#endif
+		if (crk_process_keys(bulk_keys + first * stride, stride, n))
+			return 1;
+
+		if (limited) {
+			*my_candidates -= n - 1;
+			if (n < block - first)
+				continue;
+		}
+
+		first = 0;
+		for (j = 0; j < inner; j++)
+			ranges(ps[j]).iter = 0;
+
+		for (j = inner; ; j++) {
+			mask_range *r;
+			char c;
+
+			if (j == num_ps)
+				return 0;
+
+			r = &ranges(ps[j]);
+			if (++r->iter == r->count)
+				r->iter = 0;
+			c = r->chars[r->iter];
+			for (i = 0; i < block; i++)
+				bulk_keys[i * stride + pos[j]] = c;
+			if (r->iter)
+				break;
+		}
+	}
+
+	return 0;
+}
+
 static int generate_keys(mask_cpu_context *cpu_mask_ctx,
 			  uint64_t *my_candidates)
 {
@@ -1639,6 +1800,10 @@ static int generate_keys(mask_cpu_context *cpu_mask_ctx,
 	fprintf(stderr, "%s(\"%s\")\n", __FUNCTION__, template_key);
 #endif
 
+	if (!f_filter && !(mask_has_8bit && options.internal_cp != UTF_8 &&
+	                   options.target_enc == UTF_8))
+		return generate_keys_bulk(cpu_mask_ctx, my_candidates);
+
 #define process_key(key_i)	  \
 	do { \
 		key = key_i; \
@@ -1659,9 +1824,7 @@ static int generate_keys(mask_cpu_context *cpu_mask_ctx,
 		init_key(ps);
 
 		while (1) {
-			if (options.node_count &&
-			    !(options.flags & FLG_MASK_STACKED) &&
-			    !(*my_candidates)--)
+			if (MASK_LIMITED && !(*my_candidates)--)
 				goto done;
 
 #ifdef MASK_DEBUG
@@ -1694,8 +1857,7 @@ static int generate_keys(mask_cpu_context *cpu_mask_ctx,
 					for (iterate_over(ps2)) {
 						set_template_key(ps2, start2);
 						for (iterate_over(ps1)) {
-							if (options.node_count &&
-							    !(options.flags & FLG_MASK_STACKED) &&
+							if (MASK_LIMITED &&
 							    !(*my_candidates)--)
 								goto done;
 							set_template_key(ps1, start1);
@@ -1744,9 +1906,7 @@ static int bench_generate_keys(mask_cpu_context *cpu_mask_ctx,
 		init_key(ps);
 
 		while (1) {
-			if (options.node_count &&
-			    !(options.flags & FLG_MASK_STACKED) &&
-			    !(*my_candidates)--)
+			if (MASK_LIMITED && !(*my_candidates)--)
 				goto done;
 
 			process_key(template_key);
@@ -1774,8 +1934,7 @@ static int bench_generate_keys(mask_cpu_context *cpu_mask_ctx,
 					for (iterate_over(ps2)) {
 						set_template_key(ps2, start2);
 						for (iterate_over(ps1)) {
-							if (options.node_count &&
-							    !(options.flags & FLG_MASK_STACKED) &&
+							if (MASK_LIMITED &&
 							    !(*my_candidates)--)
 								goto done;
 							set_template_key(ps1, start1);
@@ -1844,55 +2003,261 @@ static void skip_position(mask_cpu_context *cpu_mask_ctx, int *arr)
 		}
 }
 
+/*
+ * Number of candidates for the placeholders generated on CPU side.
+ */
+static uint_big cpu_keyspace(mask_cpu_context *cpu_mask_ctx)
+{
+	uint_big total = 1;
+	int ps = cpu_mask_ctx->ps1;
+
+	while (ps < MAX_NUM_MASK_PLHDR) {
+		if (cpu_mask_ctx->ranges[ps].pos < max_keylen)
+			total *= cpu_mask_ctx->ranges[ps].count;
+		ps = cpu_mask_ctx->ranges[ps].next;
+	}
+
+	return total;
+}
+
+/*
+ * Sets the placeholders to candidate number offset of the CPU side keyspace.
+ */
+static void set_position(mask_cpu_context *cpu_mask_ctx, uint_big offset)
+{
+	uint_big ctr = 1;
+	int ps = cpu_mask_ctx->ps1;
+
+	while (ps < MAX_NUM_MASK_PLHDR) {
+		cpu_mask_ctx->ranges[ps].iter = (offset / ctr) %
+			cpu_mask_ctx->ranges[ps].count;
+		ctr *= cpu_mask_ctx->ranges[ps].count;
+		ps = cpu_mask_ctx->ranges[ps].next;
+	}
+}
+
+/*
+ * Returns total * num / den rounded down, exactly and without overflow for
+ * num <= den.  So shares of a keyspace add up to the whole, with no gaps or
+ * overlaps between them.
+ */
+static uint_big share_of(uint_big total, unsigned int num, unsigned int den)
+{
+	return total / den * num + total % den * num / den;
+}
+
 /*
  * Divide a work between multiple nodes.  Called by finalize_mask()
+ *
+ * A range of node numbers gets the share of that many nodes, so nodes of
+ * different speed can be given shares to match (see --node in doc/OPTIONS).
  */
 static uint64_t divide_work(mask_cpu_context *cpu_mask_ctx)
 {
-	uint64_t offset, my_candidates, total_candidates, ctr;
-	int ps;
-	double fract;
+	uint_big total, offset;
+	uint64_t my_candidates;
 
 #ifdef MASK_DEBUG
 	fprintf(stderr, "%s()\n", __FUNCTION__);
 #endif
 
-	fract = (double)(options.node_max - options.node_min + 1) /
-		options.node_count;
+	total = cpu_keyspace(cpu_mask_ctx);
+	offset = share_of(total, options.node_min - 1, options.node_count);
+	my_candidates = share_of(total, options.node_max, options.node_count) -
+		offset;
 
-	offset = 1;
-	ps = cpu_mask_ctx->ps1;
-	while(ps < MAX_NUM_MASK_PLHDR) {
-		if (cpu_mask_ctx->ranges[ps].pos < max_keylen)
-			offset *= cpu_mask_ctx->ranges[ps].count;
-		ps = cpu_mask_ctx->ranges[ps].next;
+	if (!my_candidates && !mask_increments_len) {
+		if (john_main_process)
+			fprintf(stderr, "%u: Error: Insufficient work. Cannot distribute work among nodes!\n", options.node_min);
+		error();
 	}
 
-	total_candidates = offset;
-	offset *= fract;
-	my_candidates = offset;
-	offset = my_candidates * (options.node_min - 1);
+	set_position(cpu_mask_ctx, offset);
 
-	/* Compensate for rounding errors */
-	if (options.node_max == options.node_count)
-		my_candidates = total_candidates - offset;
+	return my_candidates;
+}
 
-	if (!my_candidates && !mask_increments_len) {
-		if (john_main_process)
-			fprintf(stderr, "%u: Error: Insufficient work. Cannot distribute work among nodes!\n", options.node_min);
+/*
+ * Sets the position and the number of candidates for chunk of chunk_count.
+ */
+static void start_chunk(mask_cpu_context *cpu_mask_ctx, uint64_t *my_candidates)
+{
+	uint_big total = cpu_keyspace(cpu_mask_ctx);
+	uint_big start = share_of(total, chunk, chunk_count);
+
+	log_event("- Mask chunk %u of %u", chunk + 1, chunk_count);
+
+	set_position(cpu_mask_ctx, start);
+	*my_candidates = share_of(total, chunk + 1, chunk_count) - start;
+}
+
+/*
+ * Number of chunks to split each length's keyspace in.
+ */
+static unsigned int chunks_per_len(void)
+{
+	int count = cfg_get_int("Mask", NULL, "ChunkCount");
+
+	return count > 0 ? count : MASK_CHUNK_COUNT;
+}
+
+/*
+ * Claims the next chunk of the current length from the --mask-chunks file,
+ * which holds a CRC-32 of the mask it's for, then a line per length with the
+ * next chunk to hand out and the number of chunks.  Returns 0 if all chunks
+ * were already handed out.
+ */
+static int claim_chunk(mask_cpu_context *cpu_mask_ctx)
+{
+	struct {
+		int len;
+		unsigned int next, count;
+	} lines[PLAINTEXT_BUFFER_SIZE + 1];
+	const int len = mask_increments_len ? mask_cur_len : 0;
+	const char *name = options.mask_chunks;
+	char line[LINE_BUFFER_SIZE];
+	uint_big total;
+	CRC32_t crc;
+	unsigned int file_crc;
+	int fd, n = 0, i, have_crc = 0;
+	FILE *file;
+
+	CRC32_Init(&crc);
+	CRC32_Update(&crc, options.eff_mask, strlen(options.eff_mask));
+
+	if ((fd = open(name, O_RDWR | O_CREAT, 0600)) < 0 ||
+	    !(file = fdopen(fd, "r+")))
+		pexit("%s", name);
+	jtr_lock(fd, F_SETLKW, F_WRLCK, name);
+
+	while (n <= PLAINTEXT_BUFFER_SIZE && fgets(line, sizeof(line), file)) {
+		if (!strncmp(line, "mask ", 5))
+			have_crc = sscanf(line + 5, "%x", &file_crc) == 1;
+		else if (sscanf(line, "%d %u %u", &lines[n].len,
+		                &lines[n].next, &lines[n].count) == 3 &&
+		         lines[n].count)
+			n++;
+	}
+
+/* Chunks of another mask would silently skip parts of this one */
+	if ((n || have_crc) && (!have_crc || file_crc != crc)) {
+		fprintf(stderr, "Error: Chunk file %s is for another mask\n",
+		        name);
 		error();
 	}
 
-	ctr = 1;
-	ps = cpu_mask_ctx->ps1;
-	while(ps < MAX_NUM_MASK_PLHDR) {
-		cpu_mask_ctx->ranges[ps].iter = (offset / ctr) %
-			cpu_mask_ctx->ranges[ps].count;
-		ctr *= cpu_mask_ctx->ranges[ps].count;
-		ps = cpu_mask_ctx->ranges[ps].next;
+	for (i = 0; i < n; i++)
+		if (lines[i].len == len)
+			break;
+	if (i == n) {
+		if (i > PLAINTEXT_BUFFER_SIZE) {
+			fprintf(stderr, "Error: Bad chunk file %s\n", name);
+			error();
+		}
+		lines[n].len = len;
+		lines[n].next = 0;
+		lines[n++].count = chunks_per_len();
 	}
 
-	return my_candidates;
+	/* Skip empty chunks, of a keyspace smaller than the chunk count */
+	total = cpu_keyspace(cpu_mask_ctx);
+	chunk_count = lines[i].count;
+	for (chunk = lines[i].next; chunk < chunk_count; chunk++)
+		if (share_of(total, chunk + 1, chunk_count) >
+		    share_of(total, chunk, chunk_count))
+			break;
+	lines[i].next = chunk < chunk_count ? chunk + 1 : chunk_count;
+
+	rewind(file);
+	fprintf(file, "mask %08x\n", crc);
+	for (i = 0; i < n; i++)
+		fprintf(file, "%d %u %u\n",
+		        lines[i].len, lines[i].next, lines[i].count);
+	if (fflush(file) || ftruncate(fd, ftell(file)))
+		pexit("%s", name);
+
+	jtr_lock(fd, F_SETLK, F_UNLCK, name);
+	if (fclose(file))
+		pexit("fclose");
+
+	return chunk < chunk_count;
+}
+
+/*
+ * Takes the next chunk of the current length that no other --fork process
+ * took.  Returns 0 if there's none left.
+ */
+static int steal_chunk(mask_cpu_context *cpu_mask_ctx)
+{
+	const int len = mask_increments_len ? mask_cur_len : 0;
+	uint_big total = cpu_keyspace(cpu_mask_ctx);
+
+	if (chunk_len != len) {
+		chunk_len = len;
+		chunk = 0;
+		chunk_count = chunks_per_len();
+	} else if (chunk < chunk_count)
+		chunk++;
+
+	/* Empty chunks, of a keyspace smaller than the chunk count, aren't */
+	for (; chunk < chunk_count; chunk++)
+		if (share_of(total, chunk + 1, chunk_count) >
+		    share_of(total, chunk, chunk_count) &&
+		    workq_mine((uint64_t)len << 32 | chunk))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Moves on to the next chunk of the current length: one held from before a
+ * restore, or else a newly claimed one.  Returns 0 if there's none left.
+ */
+static int next_chunk(mask_cpu_context *cpu_mask_ctx, uint64_t *my_candidates)
+{
+	const int len = mask_increments_len ? mask_cur_len : 0;
+
+	if (!options.mask_chunks) {
+		if (!steal_chunk(cpu_mask_ctx))
+			return 0;
+	} else if (held_used < held_count && held[held_used].len == len) {
+		chunk = held[held_used].chunk;
+		chunk_count = held[held_used++].count;
+	} else if (claim_chunk(cpu_mask_ctx)) {
+		held = mem_realloc(held, (held_count + 1) * sizeof(*held));
+		memmove(&held[held_used + 1], &held[held_used],
+		        (held_count - held_used) * sizeof(*held));
+		held[held_used].len = len;
+		held[held_used].chunk = chunk;
+		held[held_used++].count = chunk_count;
+		held_count++;
+	} else
+		return 0;
+
+	start_chunk(cpu_mask_ctx, my_candidates);
+
+	return 1;
+}
+
+/*
+ * Generates the keys, a chunk at a time if using --mask-chunks or
+ * --work-stealing.  A restored session first finishes the chunk it was in.
+ */
+static int generate_chunks(mask_cpu_context *cpu_mask_ctx,
+                           uint64_t *my_candidates)
+{
+	if (!MASK_CHUNKED)
+		return generate_keys(cpu_mask_ctx, my_candidates);
+
+	if (!*my_candidates && !next_chunk(cpu_mask_ctx, my_candidates))
+		return 0;
+
+	do {
+		if (generate_keys(cpu_mask_ctx, my_candidates))
+			return 1;
+	} while (next_chunk(cpu_mask_ctx, my_candidates));
+
+	return 0;
 }
 
 /*
@@ -1906,6 +2271,10 @@ static double get_progress(void)
 
 	emms();
 
+	/* Chunks are handed out in order, so this is progress of all nodes */
+	if (MASK_CHUNKED)
+		return chunk_count ? 100.0 * chunk / chunk_count : -1;
+
 	if (!mask_tot_cand)
 		return -1;
 
@@ -1930,6 +2299,13 @@ void mask_save_state(FILE *file)
 	}
 	for (i = 0; i < rec_ctx.count; i++)
 		fprintf(file, "%u\n", (unsigned)rec_ctx.ranges[i].iter);
+	if (MASK_CHUNKED) {
+		fprintf(file, "%u\n%u\n%d\n",
+		        rec_chunk, rec_chunk_count, held_count);
+		for (i = 0; i < held_count; i++)
+			fprintf(file, "%d %u %u\n",
+			        held[i].len, held[i].chunk, held[i].count);
+	}
 }
 
 int mask_restore_state(FILE *file)
@@ -1971,6 +2347,19 @@ int mask_restore_state(FILE *file)
 		restored_ctx.ranges[i].iter = cpu_mask_ctx.ranges[i].iter = cu;
 	else
 		return fail;
+
+	if (MASK_CHUNKED) {
+		if (fscanf(file, "%u\n%u\n%d\n", &chunk, &chunk_count,
+		           &held_count) != 3 || held_count < 0)
+			return fail;
+		held = mem_alloc(held_count * sizeof(*held));
+		for (i = 0; i < held_count; i++)
+		if (fscanf(file, "%d %u %u\n", &held[i].len, &held[i].chunk,
+		           &held[i].count) != 3)
+			return fail;
+		held_used = 0;
+		chunk_len = mask_increments_len ? restored_len : 0;
+	}
 	restored = 1;
 	return 0;
 }
@@ -1989,6 +2378,17 @@ void mask_fix_state(void)
 	rec_len = mask_cur_len;
 	for (i = 0; i < rec_ctx.count; i++)
 		rec_ctx.ranges[i].iter = cpu_mask_ctx.ranges[i].iter;
+	rec_chunk = chunk;
+	rec_chunk_count = chunk_count;
+	if (!(options.flags & FLG_MASK_STACKED))
+		workq_fix_state();
+	/* The state is in the last chunk started, so those are done with */
+	if (held_used) {
+		memmove(held, &held[held_used],
+		        (held_count - held_used) * sizeof(*held));
+		held_count -= held_used;
+		held_used = 0;
+	}
 }
 
 void remove_slash(char *mask)
@@ -2116,6 +2516,44 @@ char *stretch_mask(char *mask, mask_parsed_ctx *parsed_mask)
 
 static void finalize_mask(int len);
 
+/*
+ * CPU formats put internal candidates where the placeholders are in the
+ * template key.  That's not where they end up if keys are converted to
+ * UTF-8, nor for a Unicode format given UTF-8 keys with 8-bit characters,
+ * so we don't use internal candidates in those cases.
+ */
+static int int_mask_misplaced(mask_cpu_context *ctx)
+{
+	static int logged;
+	const char *label = mask_fmt->params.label;
+	int i, j;
+
+	if (!mask_int_cand_target || options.target_enc != UTF_8 ||
+	    strstr(label, "-opencl") || strstr(label, "-ztex") ||
+	    (options.internal_cp == UTF_8 &&
+	     !(mask_fmt->params.flags & FMT_UNICODE)))
+		return 0;
+
+	if (options.flags & FLG_MASK_STACKED)
+		goto misplaced;
+
+	for (i = 0; mask[i]; i++)
+		if (mask[i] & 0x80)
+			goto misplaced;
+
+	for (i = 0; i < ctx->count; i++)
+		for (j = 0; j < ctx->ranges[i].count; j++)
+			if (ctx->ranges[i].chars[j] & 0x80)
+				goto misplaced;
+
+	return 0;
+
+misplaced:
+	if (!logged++)
+		log_event("- Not using internal mask with 8-bit characters and UTF-8");
+	return 1;
+}
+
 /*
  * Notes about escapes, lists and ranges:
  *
@@ -2150,7 +2588,6 @@ void mask_init(struct db_main *db, char *unprocessed_mask)
 	mask_fmt = db->format;
 	mask_bench_index = 0;
 
-#if defined(HAVE_OPENCL) || defined(HAVE_ZTEX)
 	/* Disable internal mask */
 	if (options.req_int_cand_target == 0) {
 		if (mask_int_cand_target)
@@ -2158,7 +2595,6 @@ void mask_init(struct db_main *db, char *unprocessed_mask)
 		mask_fmt->params.flags &= ~FMT_MASK;
 		mask_int_cand_target = 0;
 	} else
-#endif
 	/* These formats are too wierd for magnum to get working */
 	if (!strcasecmp(mask_fmt->params.label, "descrypt-opencl") ||
 	    !strcasecmp(mask_fmt->params.label, "lm-opencl"))
@@ -2177,6 +2613,13 @@ void mask_init(struct db_main *db, char *unprocessed_mask)
 
 	max_keylen = options.rule_stack ? 125 : options.eff_maxlength;
 
+	if (options.mask_chunks && (options.flags & FLG_MASK_STACKED)) {
+		if (john_main_process)
+			fprintf(stderr,
+			        "Error: --mask-chunks can't be used with hybrid mask\n");
+		error();
+	}
+
 	if ((options.flags & FLG_MASK_STACKED) && max_keylen < 2) {
 		if (john_main_process)
 			fprintf(stderr,
@@ -2229,6 +2672,9 @@ void mask_init(struct db_main *db, char *unprocessed_mask)
 
 	if (!(options.flags & FLG_MASK_STACKED) && john_main_process) {
 		log_event("Proceeding with mask mode");
+		if (workq_active() && !options.mask_chunks)
+			log_event("- Work stealing: taking chunks of the keyspace "
+			          "rather than a node share");
 
 		if (rec_restored) {
 			fprintf(stderr, "Proceeding with mask mode:%s", unprocessed_mask);
@@ -2439,13 +2885,11 @@ static void finalize_mask(int len)
 			log_event("- Disabling internal mask due to stacked rules");
 		}
 	}
-#if defined(HAVE_OPENCL) || defined(HAVE_ZTEX)
 	else if ((mask_fmt->params.flags & FMT_MASK) && options.req_int_cand_target > 0) {
 		log_event("- Overriding format's target internal mask factor of %d with user requested %d",
 		          mask_int_cand_target, options.req_int_cand_target);
 		mask_int_cand_target = options.req_int_cand_target;
 	}
-#endif
 
 #ifdef MASK_DEBUG
 	fprintf(stderr, "%s() qw %d minlen %d maxlen %d max_key_len %d mask_add_len %d mask len %d\n", __FUNCTION__, mask_num_qw, options.eff_minlength, max_keylen, len, mask_add_len, mask_len(mask));
@@ -2481,7 +2925,14 @@ static void finalize_mask(int len)
 #endif
 	init_cpu_mask(mask, &parsed_mask, &cpu_mask_ctx, len);
 
-	mask_ext_calc_combination(&cpu_mask_ctx, max_static_range);
+	if (int_mask_misplaced(&cpu_mask_ctx)) {
+		int target = mask_int_cand_target;
+
+		mask_int_cand_target = 0;
+		mask_ext_calc_combination(&cpu_mask_ctx, max_static_range);
+		mask_int_cand_target = target;
+	} else
+		mask_ext_calc_combination(&cpu_mask_ctx, max_static_range);
 
 #ifdef MASK_DEBUG
 	fprintf(stderr, "%s() MASK_FMT_INT_PLHDRs: max static range %d: ",
@@ -2500,7 +2951,11 @@ static void finalize_mask(int len)
 
 	/* If running hybrid (stacked), we let the parent mode distribute */
 	if (!restored) {
-		if (options.node_count && !(options.flags & FLG_MASK_STACKED)) {
+		if (MASK_CHUNKED) {
+			/* generate_chunks() claims the first chunk */
+			cand = 0;
+		} else if (options.node_count &&
+		           !(options.flags & FLG_MASK_STACKED)) {
 			cand = divide_work(&cpu_mask_ctx);
 		} else {
 			cand = 1;
@@ -2545,6 +3000,7 @@ void mask_done()
 		if (!event_abort) {
 			mask_tot_cand = status.cands;
 			cand_length = 0;
+			chunk = chunk_count;
 		}
 		if (!(options.flags & FLG_TEST_CHK)) {
 			crk_done();
@@ -2567,6 +3023,10 @@ void mask_destroy()
 
 	MEM_FREE(template_key);
 	MEM_FREE(template_key_offsets);
+	MEM_FREE(bulk_keys);
+	MEM_FREE(held);
+	held_count = held_used = 0;
+	bulk_size = 0;
 	MEM_FREE(mask_skip_ranges);
 	MEM_FREE(mask_int_cand.int_cand);
 	mask_int_cand.num_int_cand = 1;
@@ -2644,6 +3104,8 @@ int do_mask_crack(const char *extern_key)
 
 			if (restored)
 				restored = 0;
+			else if (MASK_CHUNKED)
+				cand = 0;
 			else if (options.node_count) {
 				cand = divide_work(&cpu_mask_ctx);
 			}
@@ -2669,7 +3131,7 @@ int do_mask_crack(const char *extern_key)
 				if (cfg_get_bool("Mask", NULL, "MaskLengthIterStatus", 1))
 					event_pending = event_status = 1;
 
-				if (generate_keys(&cpu_mask_ctx, &cand))
+				if (generate_chunks(&cpu_mask_ctx, &cand))
 					return 1;
 			}
 		}
@@ -2706,7 +3168,7 @@ int do_mask_crack(const char *extern_key)
 			if (bench_generate_keys(&cpu_mask_ctx, &cand))
 				return 1;
 		} else {
-			if (generate_keys(&cpu_mask_ctx, &cand))
+			if (generate_chunks(&cpu_mask_ctx, &cand))
 				return 1;
 		}
 	}
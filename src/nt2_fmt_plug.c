@@ -36,6 +36,7 @@ john_register_one(&fmt_NT2);
 #include "memory.h"
 #include "johnswap.h"
 #include "simd-intrinsics.h"
+#include "common-simd-getpos.h"
 
 #ifdef SIMD_COEF_32
 #define NBKEYS				(SIMD_COEF_32 * SIMD_PARA_MD4)
@@ -151,6 +152,17 @@ static char *source(char *source, void *binary)
 static unsigned char (*saved_key);
 static unsigned char (*crypt_key);
 static unsigned int (**buf_ptr);
+/* Keys are in a legacy codepage, see set_key_CP() */
+static int cp_keys;
+
+#define INT_MASK_UTF16
+#define INT_MASK_TO_UNICODE(c)	(cp_keys ? CP_to_Unicode[c] : (c))
+#include "common-simd-intmask.h"
+#ifdef REVERSE_STEPS
+#define MITM_MD4
+#define MITM_UNREVERSE(hash)	md4_unreverse(hash)
+#include "common-simd-mitm.h"
+#endif
 #else
 static UTF16 (*saved_key)[PLAINTEXT_LENGTH + 1];
 static uint32_t (*crypt_key)[4];
@@ -187,6 +199,9 @@ static void init(struct fmt_main *self)
 		if (options.target_enc != ENC_RAW && options.target_enc != ISO_8859_1) {
 			/* This avoids an if clause for every set_key */
 			self->methods.set_key = set_key_CP;
+#if SIMD_COEF_32
+			cp_keys = 1;
+#endif
 		}
 		if (CP_to_Unicode[0xfc] == 0x00fc) {
 			tests[1].plaintext = "\xFC";	// German u-umlaut in UTF-8
@@ -208,6 +223,10 @@ static void init(struct fmt_main *self)
 	buf_ptr = mem_calloc(self->params.max_keys_per_crypt, sizeof(*buf_ptr));
 	for (i=0; i<self->params.max_keys_per_crypt; i++)
 		buf_ptr[i] = (unsigned int*)&saved_key[GETPOSW(0, i)];
+	int_mask_init(self);
+#ifdef REVERSE_STEPS
+	mitm_init(self);
+#endif
 #else
 	saved_len = mem_calloc(self->params.max_keys_per_crypt,
 	                       sizeof(*saved_len));
@@ -221,6 +240,10 @@ static void init(struct fmt_main *self)
 static void done(void)
 {
 #if SIMD_COEF_32
+#ifdef REVERSE_STEPS
+	mitm_done();
+#endif
+	int_mask_done();
 	MEM_FREE(buf_ptr);
 #else
 	MEM_FREE(saved_len);
@@ -229,6 +252,13 @@ static void done(void)
 	MEM_FREE(saved_key);
 }
 
+static void reset(struct db_main *db)
+{
+#if SIMD_COEF_32
+	crypt_key = int_mask_reset(crypt_key, NBKEYS * DIGEST_SIZE);
+#endif
+}
+
 static char *split(char *ciphertext, int index, struct fmt_main *self)
 {
 	static char out[37];
@@ -323,6 +353,7 @@ static void set_key(char *_key, int index)
 	unsigned int *keybuf_word = buf_ptr[index];
 	unsigned int len, temp2;
 
+	int_mask_set_key(_key, index);
 	len = 0;
 	while((temp2 = *key++)) {
 		unsigned int temp;
@@ -380,6 +411,7 @@ static void set_key_CP(char *_key, int index)
 	unsigned int *keybuf_word = buf_ptr[index];
 	unsigned int len, temp2;
 
+	int_mask_set_key(_key, index);
 	len = 0;
 	while((temp2 = *key++)) {
 		unsigned int temp;
@@ -426,6 +458,7 @@ static void set_key_utf8(char *_key, int index)
 	UTF32 chl, chh = 0x80;
 	unsigned int len = 0;
 
+	int_mask_set_key(_key, index);
 	while (*source) {
 		chl = *source;
 		if (chl >= 0xC0) {
@@ -556,10 +589,14 @@ static char *get_key(int index)
 {
 #ifdef SIMD_COEF_32
 	// Get the key back from the key buffer, from UCS-2
-	unsigned int *keybuffer = (unsigned int*)&saved_key[GETPOSW(0, index)];
+	unsigned int *keybuffer;
 	static UTF16 key[PLAINTEXT_LENGTH + 1];
 	unsigned int md4_size=0;
 	unsigned int i=0;
+	int cand;
+
+	index = int_mask_key(index, &cand);
+	keybuffer = (unsigned int*)&saved_key[GETPOSW(0, index)];
 
 	for (; md4_size < PLAINTEXT_LENGTH; i += SIMD_COEF_32, md4_size++)
 	{
@@ -578,7 +615,7 @@ static char *get_key(int index)
 #if !ARCH_LITTLE_ENDIAN
 	alter_endianity_w16(key, md4_size<<1);
 #endif
-	return (char*)utf16_to_enc(key);
+	return int_mask_patch((char*)utf16_to_enc(key), index, cand);
 #else
 	return (char*)utf16_to_enc(saved_key[index]);
 #endif
@@ -594,15 +631,37 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 	int i = 0;
 	const unsigned int count =
 		(*pcount + MIN_KEYS_PER_CRYPT - 1) / MIN_KEYS_PER_CRYPT;
+#ifdef SIMD_COEF_32
+	const int cands = int_mask_begin(*pcount);
+#ifdef REVERSE_STEPS
+	const int steps = mitm_begin(salt, *pcount);
+#endif
+#endif
 
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
 	for (i = 0; i < count; i++) {
 #ifdef SIMD_COEF_32
+		int j;
 
-		SIMDmd4body(&saved_key[i*NBKEYS*64], (unsigned int*)&crypt_key[i*NBKEYS*DIGEST_SIZE], NULL, SSEi_REVERSE_STEPS | SSEi_MIXED_IN);
+#ifdef REVERSE_STEPS
+		if (steps)
+			mitm_block(saved_key, i);
+#endif
+		for (j = 0; j < cands; j++) {
+			uint32_t *out = (uint32_t*)&crypt_key[(i*cands+j)*NBKEYS*DIGEST_SIZE];
 
+			int_mask_block(saved_key, i, j);
+#ifdef REVERSE_STEPS
+			if (steps) {
+				SIMDmd4body(&saved_key[i*NBKEYS*64], out, NULL, SSEi_EARLY_STEPS(steps) | SSEi_MIXED_IN);
+				mitm_check(out, i);
+				continue;
+			}
+#endif
+			SIMDmd4body(&saved_key[i*NBKEYS*64], out, NULL, SSEi_REVERSE_STEPS | SSEi_MIXED_IN);
+		}
 #else
 		MD4_CTX ctx;
 
@@ -611,6 +670,9 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 		MD4_Final((unsigned char*) crypt_key[i], &ctx);
 #endif
 	}
+#ifdef SIMD_COEF_32
+	*pcount = int_mask_count(crypt_key, *pcount);
+#endif
 	return *pcount;
 }
 
@@ -722,14 +784,17 @@ struct fmt_main fmt_NT2 = {
 #ifdef _OPENMP
 		FMT_OMP | FMT_OMP_BAD |
 #endif
-		FMT_CASE | FMT_8_BIT | FMT_SPLIT_UNIFIES_CASE | FMT_UNICODE | FMT_ENC,
+#ifdef SIMD_COEF_32
+		FMT_MASK |
+#endif
+		FMT_CASE | FMT_8_BIT | FMT_SPLIT_UNIFIES_CASE | FMT_UNICODE | FMT_ENC | FMT_FLAT_SALT,
 		{ NULL },
 		{ FORMAT_TAG },
 		tests
 	}, {
 		init,
 		done,
-		fmt_default_reset,
+		reset,
 		prepare,
 		valid,
 		split,
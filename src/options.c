@@ -109,6 +109,7 @@ static struct opt_entry opt_list[] = {
 	{"rules", FLG_RULES_SET, FLG_RULES_CHK, FLG_RULES_ALLOW, FLG_STDIN_CHK, OPT_FMT_STR_ALLOC, &options.activewordlistrules},
 	{"rules-stack", FLG_RULES_STACK_SET, FLG_RULES_STACK_CHK, 0, OPT_REQ_PARAM, OPT_FMT_STR_ALLOC, &options.rule_stack},
 	{"rules-skip-nop", FLG_RULE_SKIP_NOP, FLG_RULE_SKIP_NOP, FLG_RULES_IN_USE},
+	{"rules-word-major", FLG_ONCE, 0, FLG_RULES_CHK, OPT_BOOL, NULL, &options.rules_word_major},
 	{"incremental", FLG_INC_SET, FLG_CRACKING_CHK, 0, 0, OPT_FMT_STR_ALLOC, &options.charset},
 	{"incremental-charcount", FLG_ONCE, 0, FLG_INC_CHK, OPT_REQ_PARAM, "%u", &options.charcount},
 	{"subsets", FLG_SUBSETS_SET, FLG_CRACKING_CHK, 0, 0, OPT_FMT_STR_ALLOC, &options.subset_full},
@@ -156,6 +157,7 @@ static struct opt_entry opt_list[] = {
 	{"node", FLG_ONCE, 0, FLG_CRACKING_CHK, OPT_REQ_PARAM, OPT_FMT_STR_ALLOC, &options.node_str},
 #if OS_FORK
 	{"fork", FLG_FORK, FLG_FORK, FLG_CRACKING_CHK, FLG_STDIN_CHK | FLG_STDOUT | FLG_PIPE_CHK | OPT_REQ_PARAM, "%u", &options.fork},
+	{"work-stealing", FLG_ONCE, 0, FLG_FORK, OPT_BOOL, NULL, &options.work_stealing},
 #endif
 	{"pot", FLG_ONCE, 0, FLG_PWD_SUP, OPT_REQ_PARAM, OPT_FMT_STR_ALLOC, &options.activepot},
 	{"format", FLG_FORMAT, FLG_FORMAT, 0, FLG_STDOUT | OPT_REQ_PARAM, OPT_FMT_STR_ALLOC, &options.format},
@@ -190,14 +192,16 @@ static struct opt_entry opt_list[] = {
 	{"lws", FLG_ONCE, 0, 0, USUAL_REQ_CLR | FLG_STDOUT | OPT_REQ_PARAM, Zu, &options.lws},
 	{"gws", FLG_ONCE, 0, 0, USUAL_REQ_CLR | FLG_STDOUT | OPT_REQ_PARAM, Zu, &options.gws},
 #endif
-#if defined(HAVE_OPENCL) || defined(HAVE_ZTEX)
 	{"mask-internal-target", FLG_ONCE, 0, 0, FLG_RULES_STACK_CHK | USUAL_REQ_CLR | FLG_STDOUT | OPT_REQ_PARAM, "%d", &options.req_int_cand_target},
+	{"mask-chunks", FLG_ONCE, 0, FLG_MASK_CHK, FLG_TEST_CHK | OPT_REQ_PARAM, OPT_FMT_STR_ALLOC, &options.mask_chunks},
+#if defined(HAVE_OPENCL) || defined(HAVE_ZTEX)
 	{"devices", FLG_ONCE, 0, 0, USUAL_REQ_CLR | FLG_STDOUT | OPT_REQ_PARAM, OPT_FMT_ADD_LIST_MULTI, &options.acc_devices},
 #endif
 	{"skip-self-tests", FLG_NOTESTS, FLG_NOTESTS, 0, USUAL_REQ_CLR | FLG_STDOUT},
 	{"costs", FLG_ONCE, 0, 0, USUAL_REQ_CLR | OPT_REQ_PARAM, OPT_FMT_STR_ALLOC, &costs_str},
 	{"keep-guessing", FLG_ONCE, 0, FLG_CRACKING_CHK, USUAL_REQ_CLR | FLG_STDOUT | OPT_TRISTATE, NULL, &options.keep_guessing},
 	{"tune", FLG_ONCE, 0, 0, USUAL_REQ_CLR | FLG_STDOUT | OPT_REQ_PARAM, OPT_FMT_STR_ALLOC, &options.tune},
+	{"salt-schedule", FLG_ONCE, 0, FLG_CRACKING_CHK, USUAL_REQ_CLR | OPT_REQ_PARAM, OPT_FMT_STR_ALLOC, &options.salt_schedule},
 	{"force-tty", FLG_FORCE_TTY, FLG_FORCE_TTY, FLG_CRACKING_CHK},
 	{NULL}
 };
@@ -215,7 +219,8 @@ static struct opt_entry opt_list[] = {
 
 #if OS_FORK
 #define JOHN_USAGE_FORK \
-"--fork=N                   Fork N processes\n"
+"--fork=N                   Fork N processes\n" \
+"--work-stealing            Let --fork processes take work from each other\n"
 #else
 #define JOHN_USAGE_FORK ""
 #endif
@@ -282,6 +287,7 @@ static struct opt_entry opt_list[] = {
 "                           modes that otherwise don't support rules\n" \
 "--rules-stack=:rule[;..]   Same, using \"immediate\" rule(s)\n" \
 "--rules-skip-nop           Skip any NOP \":\" rules (you already ran w/o rules)\n" \
+"--rules-word-major         Apply all rules to each word before reading the next\n" \
 "--loopback[=FILE]          Like --wordlist, but extract words from a .pot file\n" \
 "--mem-file-size=SIZE       Size threshold for wordlist preload (default %u MB)\n" \
 "--dupe-suppression[=SIZE]  Opportunistic dupe suppression for wordlist+rules\n" \
@@ -289,6 +295,8 @@ static struct opt_entry opt_list[] = {
 "--incremental-charcount=N  Override CharCount for incremental mode\n" \
 "--external=MODE            External mode or word filter\n" \
 "--mask[=MASK]              Mask mode using MASK (or default from john.conf)\n" \
+"--mask-internal-target=N   Request a specific internal mask target\n" \
+"--mask-chunks=FILE         Take mask mode work in chunks from shared FILE\n" \
 "--markov[=OPTIONS]         \"Markov\" mode (see doc/MARKOV)\n" \
 "--mkv-stats=FILE           \"Markov\" stats file\n" \
 PRINCE_USAGE \
@@ -324,6 +332,8 @@ JOHN_USAGE_REGEX \
 "--salts=#M[-N]             Load M [to N] most populated salts\n" \
 "--costs=[-]C[:M][,...]     Load salts with[out] cost value Cn [to Mn]. For\n" \
 "                           tunable cost parameters, see doc/OPTIONS\n" \
+"--salt-schedule=HOW        Reorder salts as hashes get cracked (none, count\n" \
+"                           or yield, see doc/OPTIONS)\n" \
 JOHN_USAGE_FORK \
 "--node=MIN[-MAX]/TOTAL     This node's number range out of TOTAL count\n" \
 "--save-memory=LEVEL        Enable memory saving, at LEVEL 1..3\n" \
@@ -369,7 +379,6 @@ FUZZ_USAGE \
 #define JOHN_USAGE_GPU \
 "\nOpenCL options:\n" \
 "--devices=N[,..]           Set OpenCL device(s) (see --list=opencl-devices)\n" \
-"--mask-internal-target=N   Request a specific internal mask target\n" \
 "--force-scalar             Force scalar mode\n" \
 "--force-vector-width=N     Force vector width N\n" \
 "--lws=N                    Force local worksize N\n" \
@@ -378,8 +387,7 @@ FUZZ_USAGE \
 "                           or set ZTEX device(s) by its(their) serial number(s)\n"
 #elif defined(HAVE_ZTEX)
 #define JOHN_USAGE_ZTEX \
-"--devices=N[,..]           Set ZTEX device(s) by its(their) serial number(s)\n" \
-"--mask-internal-target=N   Request a specific internal mask target\n"
+"--devices=N[,..]           Set ZTEX device(s) by its(their) serial number(s)\n"
 #endif
 
 static void opt_banner(char *name)
@@ -447,9 +455,8 @@ void opt_init(char *name, int argc, char **argv)
 	list_init(&options.loader.shells);
 #if defined(HAVE_OPENCL) || defined(HAVE_ZTEX)
 	list_init(&options.acc_devices);
-
-	options.req_int_cand_target = -1;
 #endif
+	options.req_int_cand_target = -1;
 
 	options.length = -1;
 	options.suppressor_size = -1;
@@ -748,6 +755,12 @@ void opt_init(char *name, int argc, char **argv)
 			error_msg("Allowed arguments to --tune is auto, report or N, where N is a positive number");
 	}
 
+	if (options.salt_schedule &&
+	    strcmp(options.salt_schedule, "none") &&
+	    strcmp(options.salt_schedule, "count") &&
+	    strcmp(options.salt_schedule, "yield"))
+		error_msg("Allowed arguments to --salt-schedule are none, count or yield");
+
 	if (salts_str) {
 		int two_salts = 0;
 
@@ -898,6 +911,8 @@ void opt_init(char *name, int argc, char **argv)
 #endif
 		    range == options.node_count)
 			msg = "node numbers can't span the whole range";
+		if (!msg && options.mask_chunks)
+			msg = "can't be used with --mask-chunks";
 		if (msg) {
 			if (john_main_process)
 			fprintf(stderr, "Invalid node specification: %s: %s\n",
@@ -366,6 +366,9 @@ struct options_main {
 /* Stacked rules applied within cracker.c for any mode */
 	char *rule_stack;
 
+/* Wordlist mode applies all rules to a word before reading the next one */
+	int rules_word_major;
+
 /* Salt brute-force */
 	int regen_lost_salts;
 
@@ -439,6 +442,8 @@ struct options_main {
 	char *custom_mask[MAX_NUM_CUST_PLHDR];
 /* Tune options */
 	char *tune;
+/* Salt schedule (none, count or yield) */
+	char *salt_schedule;
 /* Incremental CharCount override */
 	int charcount;
 /* Subsets full charset */
@@ -457,10 +462,12 @@ struct options_main {
 	int crack_status;
 /* --catch-up=oldsession */
 	char *catchup;
-#if defined(HAVE_OPENCL) || defined(HAVE_ZTEX)
 /* --mask-internal-target=N */
 	int req_int_cand_target;
-#endif
+/* --mask-chunks=FILE */
+	char *mask_chunks;
+/* --work-stealing between --fork processes */
+	int work_stealing;
 /* --dupe-suppression[=SIZE] */
 	int suppressor_size;
 };
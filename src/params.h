@@ -251,6 +251,13 @@
 #define PASSWORD_HASH_THRESHOLD_5	(PASSWORD_HASH_SIZE_4 / 10)
 #define PASSWORD_HASH_THRESHOLD_6	(PASSWORD_HASH_SIZE_5 / 35)
 
+/*
+ * Default count of entries at which a salt gets the compact hash table (see
+ * hashtab.h) behind its bitmap instead of the hash table.  Can be overridden
+ * with CompactHashThreshold in john.conf.
+ */
+#define PASSWORD_HASH_COMPACT_THRESHOLD	PASSWORD_HASH_THRESHOLD_6
+
 /*
  * Tables of the above values.
  */
@@ -32,6 +32,7 @@ john_register_one(&fmt_pbkdf2_hmac_sha256);
 #endif
 
 #include "misc.h"
+#include "memory.h"
 #include "arch.h"
 #include "common.h"
 #include "formats.h"
@@ -41,6 +42,10 @@ john_register_one(&fmt_pbkdf2_hmac_sha256);
 #include "pbkdf2_hmac_sha256.h"
 #include "pbkdf2_hmac_common.h"
 
+#if FMT_REENTRANT
+#include <pthread.h>
+#endif
+
 #define FORMAT_LABEL            "PBKDF2-HMAC-SHA256"
 #define FORMAT_NAME		""
 
@@ -68,31 +73,72 @@ john_register_one(&fmt_pbkdf2_hmac_sha256);
 #define PAD_SIZE                128
 #define PLAINTEXT_LENGTH        125
 
-static struct custom_salt {
+struct custom_salt {
 	uint8_t length;
 	uint8_t salt[PBKDF2_32_MAX_SALT_SIZE + 3];
 	uint32_t rounds;
-} *cur_salt;
+};
 
 static char (*saved_key)[PLAINTEXT_LENGTH + 1];
-static uint32_t (*crypt_out)[PBKDF2_SHA256_BINARY_SIZE / sizeof(uint32_t)];
+static int max_keys;
+
+/* The salt and results are per thread (FMT_REENTRANT) */
+static FMT_THREAD_LOCAL struct custom_salt *cur_salt;
+static FMT_THREAD_LOCAL uint32_t (*crypt_out)[PBKDF2_SHA256_BINARY_SIZE / sizeof(uint32_t)];
+static FMT_THREAD_LOCAL unsigned int crypt_out_gen;
+
+/*
+ * All threads' crypt_out buffers, for done() to free.  It also bumps out_gen
+ * so that threads which outlive it allocate a new one on their next use.
+ */
+static void **out_bufs;
+static int out_bufs_count, out_bufs_alloc;
+static unsigned int out_gen = 1;
+#if FMT_REENTRANT
+static pthread_mutex_t out_bufs_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 static void init(struct fmt_main *self)
 {
 	omp_autotune(self, OMP_SCALE);
 
-	saved_key = mem_calloc(self->params.max_keys_per_crypt,
-	                       sizeof(*saved_key));
-	crypt_out = mem_calloc(self->params.max_keys_per_crypt,
-	                       sizeof(*crypt_out));
+	max_keys = self->params.max_keys_per_crypt;
+	saved_key = mem_calloc(max_keys, sizeof(*saved_key));
 }
 
 static void done(void)
 {
-	MEM_FREE(crypt_out);
+	int i;
+
+	for (i = 0; i < out_bufs_count; i++)
+		MEM_FREE(out_bufs[i]);
+	MEM_FREE(out_bufs);
+	out_bufs_count = out_bufs_alloc = 0;
+	out_gen++;
+	crypt_out = NULL;
+
 	MEM_FREE(saved_key);
 }
 
+static void alloc_crypt_out(void)
+{
+	crypt_out = mem_calloc(max_keys, sizeof(*crypt_out));
+	crypt_out_gen = out_gen;
+
+#if FMT_REENTRANT
+	pthread_mutex_lock(&out_bufs_mutex);
+#endif
+	if (out_bufs_count == out_bufs_alloc) {
+		out_bufs_alloc = out_bufs_alloc ? 2 * out_bufs_alloc : 16;
+		out_bufs = mem_realloc(out_bufs,
+		                       out_bufs_alloc * sizeof(*out_bufs));
+	}
+	out_bufs[out_bufs_count++] = crypt_out;
+#if FMT_REENTRANT
+	pthread_mutex_unlock(&out_bufs_mutex);
+#endif
+}
+
 static void *get_salt(char *ciphertext)
 {
 	static struct custom_salt salt;
@@ -128,6 +174,15 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 {
 	const int count = *pcount;
 	int index;
+	struct custom_salt *cs;
+	uint32_t (*out)[PBKDF2_SHA256_BINARY_SIZE / sizeof(uint32_t)];
+
+	if (crypt_out_gen != out_gen)
+		alloc_crypt_out();
+
+/* OpenMP threads would see their own (unset) copies of these */
+	cs = cur_salt;
+	out = crypt_out;
 
 #ifdef _OPENMP
 #pragma omp parallel for
@@ -143,13 +198,13 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 		for (i = 0; i < SSE_GROUP_SZ_SHA256; ++i) {
 			lens[i] = strlen(saved_key[index+i]);
 			pin[i] = (unsigned char*)saved_key[index+i];
-			x.pout[i] = crypt_out[index+i];
+			x.pout[i] = out[index+i];
 		}
-		pbkdf2_sha256_sse((const unsigned char **)pin, lens, cur_salt->salt, cur_salt->length, cur_salt->rounds, &(x.poutc), PBKDF2_SHA256_BINARY_SIZE, 0);
+		pbkdf2_sha256_sse((const unsigned char **)pin, lens, cs->salt, cs->length, cs->rounds, &(x.poutc), PBKDF2_SHA256_BINARY_SIZE, 0);
 #else
 		pbkdf2_sha256((const unsigned char*)(saved_key[index]), strlen(saved_key[index]),
-			cur_salt->salt, cur_salt->length,
-			cur_salt->rounds, (unsigned char*)crypt_out[index], PBKDF2_SHA256_BINARY_SIZE, 0);
+			cs->salt, cs->length,
+			cs->rounds, (unsigned char*)out[index], PBKDF2_SHA256_BINARY_SIZE, 0);
 #endif
 	}
 
@@ -214,7 +269,7 @@ struct fmt_main fmt_pbkdf2_hmac_sha256 = {
 		sizeof(ARCH_WORD),
 		MIN_KEYS_PER_CRYPT,
 		MAX_KEYS_PER_CRYPT,
-		FMT_CASE | FMT_8_BIT | FMT_OMP,
+		FMT_CASE | FMT_8_BIT | FMT_OMP | FMT_REENTRANT,
 		{
 			"iteration count",
 		},
@@ -83,6 +83,7 @@ typedef union {
 #define vstore(m, x)            vst1q_u32((uint32_t*)(m), (x).v32)
 #define vstoreu                 vstoreu_emu
 #define VSTOREU_EMULATED        1
+#define vsub_epi32(x, y)        (vtype)vsubq_u32((x).v32, (y).v32)
 #define vunpackhi_epi32(x, y)   (vtype)(vzipq_u32((x).v32, (y).v32)).val[1]
 #define vunpackhi_epi64(x, y)   vset_epi64(vgetq_lane_u64(((y).v64, 1), vgetq_lane_u64((x).v64, 1))
 #define vunpacklo_epi32(x, y)   (vtype)(vzipq_u32(x, y)).val[0]
@@ -137,6 +138,7 @@ typedef union {
 #define vstore(m, x)            vec_st((x).v32, 0, (uint32_t*)(m))
 #define vstoreu                 vstoreu_emu
 #define VSTOREU_EMULATED        1
+#define vsub_epi32(x, y)        (vtype)vec_sub((x).v32, (y).v32)
 #define vunpackhi_epi32(x, y)   (vtype)vec_mergel((x).v32, (y).v32)
 #define vunpackhi_epi64(x, y)   (vtype)(vtype64)vec_mergel((vector long)(x).v64, (vector long)(y).v64)
 #define vunpacklo_epi32(x, y)   (vtype)vec_mergeh((x).v32, (y).v32)
@@ -205,6 +207,7 @@ typedef __m512i vtype;
 #define vsrli_epi64             _mm512_srli_epi64
 #define vstore(x, y)            _mm512_store_si512((void*)(x), y)
 #define vstoreu(x, y)           _mm512_storeu_si512((void*)(x), y)
+#define vsub_epi32              _mm512_sub_epi32
 #define vunpackhi_epi32         _mm512_unpackhi_epi32
 #define vunpackhi_epi64         _mm512_unpackhi_epi64
 #define vunpacklo_epi32         _mm512_unpacklo_epi32
@@ -348,6 +351,7 @@ typedef __m256i vtype;
 #define vsrli_epi64             _mm256_srli_epi64
 #define vstore(x, y)            _mm256_store_si256((void*)(x), y)
 #define vstoreu(x, y)           _mm256_storeu_si256((void*)(x), y)
+#define vsub_epi32              _mm256_sub_epi32
 #define vunpackhi_epi32         _mm256_unpackhi_epi32
 #define vunpackhi_epi64         _mm256_unpackhi_epi64
 #define vunpacklo_epi32         _mm256_unpacklo_epi32
@@ -499,6 +503,7 @@ typedef __m128i vtype;
 #define vsrli_epi64             _mm_srli_epi64
 #define vstore(x, y)            _mm_store_si128((vtype*)(x), y)
 #define vstoreu(x, y)           _mm_storeu_si128((vtype*)(x), y)
+#define vsub_epi32              _mm_sub_epi32
 #define vunpackhi_epi32         _mm_unpackhi_epi32
 #define vunpackhi_epi64         _mm_unpackhi_epi64
 #define vunpacklo_epi32         _mm_unpacklo_epi32
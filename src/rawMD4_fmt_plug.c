@@ -314,14 +314,12 @@ static int cmp_exact(char *source, int index)
 }
 
 #ifdef SIMD_COEF_32
-#define SIMD_INDEX (index&(SIMD_COEF_32-1))+(unsigned int)index/SIMD_COEF_32*SIMD_COEF_32*4+SIMD_COEF_32
-static int get_hash_0(int index) { return ((uint32_t*)crypt_key)[SIMD_INDEX] & PH_MASK_0; }
-static int get_hash_1(int index) { return ((uint32_t*)crypt_key)[SIMD_INDEX] & PH_MASK_1; }
-static int get_hash_2(int index) { return ((uint32_t*)crypt_key)[SIMD_INDEX] & PH_MASK_2; }
-static int get_hash_3(int index) { return ((uint32_t*)crypt_key)[SIMD_INDEX] & PH_MASK_3; }
-static int get_hash_4(int index) { return ((uint32_t*)crypt_key)[SIMD_INDEX] & PH_MASK_4; }
-static int get_hash_5(int index) { return ((uint32_t*)crypt_key)[SIMD_INDEX] & PH_MASK_5; }
-static int get_hash_6(int index) { return ((uint32_t*)crypt_key)[SIMD_INDEX] & PH_MASK_6; }
+/* The reversed steps leave word 1 as the one to hash on */
+#define COMMON_GET_HASH_SIMD32 4
+#define COMMON_GET_HASH_VAR crypt_key
+#define COMMON_GET_HASH_SIMD_VAR ((uint32_t*)crypt_key + SIMD_COEF_32)
+#define COMMON_GET_HASH_BATCH
+#include "common-get-hash.h"
 #else
 static int get_hash_0(int index) { return ((uint32_t*)crypt_key[index])[1] & PH_MASK_0; }
 static int get_hash_1(int index) { return ((uint32_t*)crypt_key[index])[1] & PH_MASK_1; }
@@ -358,7 +356,7 @@ struct fmt_main fmt_rawMD4 = {
 #ifdef _OPENMP
 		FMT_OMP | FMT_OMP_BAD |
 #endif
-		FMT_CASE | FMT_8_BIT | FMT_SPLIT_UNIFIES_CASE,
+		FMT_CASE | FMT_8_BIT | FMT_SPLIT_UNIFIES_CASE | FMT_FLAT_SALT,
 		{ NULL },
 		{ FORMAT_TAG },
 		tests
@@ -390,6 +388,10 @@ struct fmt_main fmt_rawMD4 = {
 		fmt_default_clear_keys,
 		crypt_all,
 		{
+#ifdef SIMD_COEF_32
+#define COMMON_GET_HASH_LINK
+#include "common-get-hash.h"
+#else
 			get_hash_0,
 			get_hash_1,
 			get_hash_2,
@@ -397,10 +399,18 @@ struct fmt_main fmt_rawMD4 = {
 			get_hash_4,
 			get_hash_5,
 			get_hash_6
+#endif
 		},
 		cmp_all,
 		cmp_one,
-		cmp_exact
+		cmp_exact,
+		NULL,
+#ifdef SIMD_COEF_32
+#define COMMON_GET_HASH_BATCH_LINK
+#include "common-get-hash.h"
+#else
+		NULL
+#endif
 	}
 };
 
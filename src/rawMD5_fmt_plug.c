@@ -97,39 +97,93 @@ static struct fmt_tests tests[] = {
 #define MAX_KEYS_PER_CRYPT		256
 #endif
 
+/*
+ * Keys are double-buffered (see select_keys()): set_key() fills set_keys
+ * while crypt_all() and get_key() use saved_key.
+ */
 #ifdef SIMD_COEF_32
-static uint32_t (*saved_key)[MD5_BUF_SIZ*NBKEYS];
+static uint32_t (*saved_key)[MD5_BUF_SIZ*NBKEYS], (*set_keys)[MD5_BUF_SIZ*NBKEYS];
+static uint32_t (*key_buf[2])[MD5_BUF_SIZ*NBKEYS];
 static uint32_t (*crypt_key)[DIGEST_SIZE/4*NBKEYS];
+#include "common-simd-intmask.h"
+#ifdef REVERSE_STEPS
+#define MITM_MD5
+#define MITM_UNREVERSE(hash)	md5_unreverse(hash)
+#include "common-simd-mitm.h"
+#endif
 #else
-static int (*saved_len);
-static char (*saved_key)[PLAINTEXT_LENGTH + 1];
+static int (*saved_len), (*set_lens);
+static int (*len_buf[2]);
+static char (*saved_key)[PLAINTEXT_LENGTH + 1], (*set_keys)[PLAINTEXT_LENGTH + 1];
+static char (*key_buf[2])[PLAINTEXT_LENGTH + 1];
 static uint32_t (*crypt_key)[4];
 #endif
 
+static void select_keys(int set_slot, int crypt_slot)
+{
+	set_keys = key_buf[set_slot];
+	saved_key = key_buf[crypt_slot];
+#ifndef SIMD_COEF_32
+	set_lens = len_buf[set_slot];
+	saved_len = len_buf[crypt_slot];
+#else
+	int_mask_select(set_slot, crypt_slot);
+#endif
+}
+
 static void init(struct fmt_main *self)
 {
+	int i;
+
 	omp_autotune(self, OMP_SCALE);
+	for (i = 0; i < 2; i++) {
+#ifndef SIMD_COEF_32
+		len_buf[i] = mem_calloc(self->params.max_keys_per_crypt,
+		                        sizeof(*saved_len));
+		key_buf[i] = mem_calloc(self->params.max_keys_per_crypt,
+		                        sizeof(*saved_key));
+#else
+		key_buf[i] = mem_calloc_align(self->params.max_keys_per_crypt/NBKEYS,
+		                              sizeof(*saved_key), MEM_ALIGN_SIMD);
+#endif
+	}
+	select_keys(0, 0);
 #ifndef SIMD_COEF_32
-	saved_len = mem_calloc(self->params.max_keys_per_crypt,
-	                       sizeof(*saved_len));
-	saved_key = mem_calloc(self->params.max_keys_per_crypt,
-	                       sizeof(*saved_key));
 	crypt_key = mem_calloc(self->params.max_keys_per_crypt,
 	                       sizeof(*crypt_key));
 #else
-	saved_key = mem_calloc_align(self->params.max_keys_per_crypt/NBKEYS,
-	                             sizeof(*saved_key), MEM_ALIGN_SIMD);
 	crypt_key = mem_calloc_align(self->params.max_keys_per_crypt/NBKEYS,
 	                             sizeof(*crypt_key), MEM_ALIGN_SIMD);
+	int_mask_init(self);
+#ifdef REVERSE_STEPS
+	mitm_init(self);
+#endif
 #endif
 }
 
 static void done(void)
 {
+	int i;
+
+#ifdef SIMD_COEF_32
+#ifdef REVERSE_STEPS
+	mitm_done();
+#endif
+	int_mask_done();
+#endif
 	MEM_FREE(crypt_key);
-	MEM_FREE(saved_key);
+	for (i = 0; i < 2; i++) {
+		MEM_FREE(key_buf[i]);
 #ifndef SIMD_COEF_32
-	MEM_FREE(saved_len);
+		MEM_FREE(len_buf[i]);
+#endif
+	}
+}
+
+static void reset(struct db_main *db)
+{
+#ifdef SIMD_COEF_32
+	crypt_key = int_mask_reset(crypt_key, sizeof(*crypt_key));
 #endif
 }
 
@@ -243,7 +297,31 @@ static char *source(char *source, void *binary)
 }
 
 #define NON_SIMD_SET_SAVED_LEN
+#define SET_KEY_BUFFER set_keys
+#define SET_KEY_LENGTHS set_lens
+#ifdef SIMD_COEF_32
+#define set_key simd_set_key
+#define get_key simd_get_key
+#endif
 #include "common-simd-setkey32.h"
+#ifdef SIMD_COEF_32
+#undef set_key
+#undef get_key
+
+static void set_key(char *key, int index)
+{
+	int_mask_set_key(key, index);
+	simd_set_key(key, index);
+}
+
+static char *get_key(int index)
+{
+	int cand;
+
+	index = int_mask_key(index, &cand);
+	return int_mask_patch(simd_get_key(index), index, cand);
+}
+#endif
 
 #ifndef REVERSE_STEPS
 #undef SSEi_REVERSE_STEPS
@@ -256,13 +334,38 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 	int index;
 
 	int loops = (count + MIN_KEYS_PER_CRYPT - 1) / MIN_KEYS_PER_CRYPT;
+#if SIMD_COEF_32
+	const int cands = int_mask_begin(count);
+#ifdef REVERSE_STEPS
+	const int steps = mitm_begin(salt, count);
+#endif
+#endif
 
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
 	for (index = 0; index < loops; index++) {
 #if SIMD_COEF_32
-		SIMDmd5body(saved_key[index], crypt_key[index], NULL, SSEi_REVERSE_STEPS | SSEi_MIXED_IN);
+		int j;
+
+#ifdef REVERSE_STEPS
+		if (steps)
+			mitm_block(saved_key, index);
+#endif
+		for (j = 0; j < cands; j++) {
+			int_mask_block(saved_key, index, j);
+#ifdef REVERSE_STEPS
+			if (steps) {
+				SIMDmd5body(saved_key[index],
+				            crypt_key[index * cands + j], NULL,
+				            SSEi_EARLY_STEPS(steps) | SSEi_MIXED_IN);
+				mitm_check(crypt_key[index * cands + j], index);
+				continue;
+			}
+#endif
+			SIMDmd5body(saved_key[index], crypt_key[index * cands + j],
+			            NULL, SSEi_REVERSE_STEPS | SSEi_MIXED_IN);
+		}
 #else
 		MD5_CTX ctx;
 		MD5_Init(&ctx);
@@ -270,7 +373,13 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 		MD5_Final((unsigned char *)crypt_key[index], &ctx);
 #endif
 	}
+#if SIMD_COEF_32
+	*pcount = int_mask_count(crypt_key, count);
+
+	return *pcount;
+#else
 	return count;
+#endif
 }
 
 static int cmp_all(void *binary, int count) {
@@ -331,6 +440,7 @@ static int cmp_exact(char *source, int index)
 
 #define COMMON_GET_HASH_SIMD32 4
 #define COMMON_GET_HASH_VAR crypt_key
+#define COMMON_GET_HASH_BATCH
 #include "common-get-hash.h"
 
 struct fmt_main fmt_rawMD5 = {
@@ -351,14 +461,17 @@ struct fmt_main fmt_rawMD5 = {
 #ifdef _OPENMP
 		FMT_OMP | FMT_OMP_BAD |
 #endif
-		FMT_CASE | FMT_8_BIT | FMT_SPLIT_UNIFIES_CASE,
+#ifdef SIMD_COEF_32
+		FMT_MASK |
+#endif
+		FMT_CASE | FMT_8_BIT | FMT_SPLIT_UNIFIES_CASE | FMT_FLAT_SALT,
 		{ NULL },
 		{ FORMAT_TAG, FORMAT_TAG2 },
 		tests
 	}, {
 		init,
 		done,
-		fmt_default_reset,
+		reset,
 		prepare,
 		valid,
 		split,
@@ -388,7 +501,10 @@ struct fmt_main fmt_rawMD5 = {
 		},
 		cmp_all,
 		cmp_one,
-		cmp_exact
+		cmp_exact,
+		select_keys,
+#define COMMON_GET_HASH_BATCH_LINK
+#include "common-get-hash.h"
 	}
 };
 
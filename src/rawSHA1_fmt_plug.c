@@ -86,6 +86,7 @@ john_register_one(&fmt_rawSHA1_axcrypt);
 #ifdef SIMD_COEF_32
 static uint32_t (*saved_key)[SHA_BUF_SIZ*NBKEYS];
 static uint32_t (*crypt_key)[DIGEST_SIZE/4*NBKEYS];
+#include "common-simd-intmask.h"
 #else
 static char (*saved_key)[PLAINTEXT_LENGTH + 1];
 static uint32_t (*crypt_key)[DIGEST_SIZE / 4];
@@ -106,6 +107,7 @@ static void init(struct fmt_main *self)
 	                             sizeof(*saved_key), MEM_ALIGN_SIMD);
 	crypt_key = mem_calloc_align(self->params.max_keys_per_crypt/NBKEYS,
 	                             sizeof(*crypt_key), MEM_ALIGN_SIMD);
+	int_mask_init(self);
 #else
 	saved_key = mem_calloc(self->params.max_keys_per_crypt,
 	                       sizeof(*saved_key));
@@ -144,10 +146,20 @@ static void init_ax(struct fmt_main *self)
 
 static void done(void)
 {
+#ifdef SIMD_COEF_32
+	int_mask_done();
+#endif
 	MEM_FREE(crypt_key);
 	MEM_FREE(saved_key);
 }
 
+static void reset(struct db_main *db)
+{
+#ifdef SIMD_COEF_32
+	crypt_key = int_mask_reset(crypt_key, sizeof(*crypt_key));
+#endif
+}
+
 
 #ifdef SIMD_COEF_32
 #define HASH_OFFSET	(index&(SIMD_COEF_32-1))+(((unsigned int)index%NBKEYS)/SIMD_COEF_32)*SIMD_COEF_32*5+pos*SIMD_COEF_32
@@ -176,7 +188,29 @@ static int binary_hash_4(void *binary) { return ((uint32_t*)binary)[pos] & PH_MA
 static int binary_hash_5(void *binary) { return ((uint32_t*)binary)[pos] & PH_MASK_5; }
 static int binary_hash_6(void *binary) { return ((uint32_t*)binary)[pos] & PH_MASK_6; }
 
+#ifdef SIMD_COEF_32
+#define set_key simd_set_key
+#define get_key simd_get_key
+#endif
 #include "common-simd-setkey32.h"
+#ifdef SIMD_COEF_32
+#undef set_key
+#undef get_key
+
+static void set_key(char *key, int index)
+{
+	int_mask_set_key(key, index);
+	simd_set_key(key, index);
+}
+
+static char *get_key(int index)
+{
+	int cand;
+
+	index = int_mask_key(index, &cand);
+	return int_mask_patch(simd_get_key(index), index, cand);
+}
+#endif
 
 static void *get_binary(char *ciphertext)
 {
@@ -249,6 +283,9 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 {
 	const int count = *pcount;
 	int index = 0;
+#if SIMD_COEF_32
+	const int cands = int_mask_begin(count);
+#endif
 
 #ifdef _OPENMP
 	int loops = (count + MAX_KEYS_PER_CRYPT - 1) / MAX_KEYS_PER_CRYPT;
@@ -258,7 +295,13 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 #endif
 	{
 #if SIMD_COEF_32
-		SIMDSHA1body(saved_key[index], crypt_key[index], NULL, SSEi_flags);
+		int j;
+
+		for (j = 0; j < cands; j++) {
+			int_mask_block(saved_key, index, j);
+			SIMDSHA1body(saved_key[index], crypt_key[index * cands + j],
+			             NULL, SSEi_flags);
+		}
 #else
 		SHA_CTX ctx;
 
@@ -267,7 +310,13 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 		SHA1_Final( (unsigned char*) crypt_key[index], &ctx);
 #endif
 	}
+#if SIMD_COEF_32
+	*pcount = int_mask_count(crypt_key, count);
+
+	return *pcount;
+#else
 	return count;
+#endif
 }
 
 static int cmp_all(void *binary, int count) {
@@ -336,14 +385,18 @@ struct fmt_main fmt_rawSHA1 = {
 #ifdef _OPENMP
 		FMT_OMP | FMT_OMP_BAD |
 #endif
-		FMT_CASE | FMT_8_BIT | FMT_SPLIT_UNIFIES_CASE,
+#ifdef SIMD_COEF_32
+		FMT_MASK |
+#endif
+		FMT_CASE | FMT_8_BIT | FMT_SPLIT_UNIFIES_CASE |
+		FMT_FLAT_SALT,
 		{ NULL },
 		{ FORMAT_TAG, FORMAT_TAG_OLD },
 		rawsha1_common_tests
 	}, {
 		init_raw,
 		done,
-		fmt_default_reset,
+		reset,
 		rawsha1_common_prepare,
 		rawsha1_common_valid,
 		rawsha1_common_split,
@@ -65,7 +65,8 @@ john_register_one(&fmt_rawSHA256);
 #define SALT_ALIGN				1
 
 #ifdef SIMD_COEF_32
-#define MIN_KEYS_PER_CRYPT      (SIMD_COEF_32*SIMD_PARA_SHA256)
+#define NBKEYS                  (SIMD_COEF_32*SIMD_PARA_SHA256)
+#define MIN_KEYS_PER_CRYPT      NBKEYS
 #define MAX_KEYS_PER_CRYPT      (64*SIMD_COEF_32*SIMD_PARA_SHA256)
 #else
 #define MIN_KEYS_PER_CRYPT      1
@@ -81,6 +82,7 @@ john_register_one(&fmt_rawSHA256);
 #include "common-simd-getpos.h"
 static uint32_t (*saved_key);
 static uint32_t (*crypt_out);
+#include "common-simd-intmask.h"
 #else
 static int (*saved_len);
 static char (*saved_key)[PLAINTEXT_LENGTH + 1];
@@ -106,11 +108,15 @@ static void init(struct fmt_main *self)
 	crypt_out = mem_calloc_align(self->params.max_keys_per_crypt * 8,
 	                             sizeof(*crypt_out),
 	                             MEM_ALIGN_SIMD);
+	int_mask_init(self);
 #endif
 }
 
 static void done(void)
 {
+#ifdef SIMD_COEF_32
+	int_mask_done();
+#endif
 	MEM_FREE(crypt_out);
 	MEM_FREE(saved_key);
 #ifndef SIMD_COEF_32
@@ -118,6 +124,13 @@ static void done(void)
 #endif
 }
 
+static void reset(struct db_main *db)
+{
+#ifdef SIMD_COEF_32
+	crypt_out = int_mask_reset(crypt_out, NBKEYS * 8 * sizeof(*crypt_out));
+#endif
+}
+
 static void *get_binary(char *ciphertext)
 {
 	static unsigned int *outw;
@@ -156,7 +169,29 @@ static void *get_binary(char *ciphertext)
 #define HASH_IDX ((((unsigned int)index)&(SIMD_COEF_32-1))+(((unsigned int)index)/SIMD_COEF_32)*SIMD_COEF_32*8)
 
 #define NON_SIMD_SET_SAVED_LEN
+#ifdef SIMD_COEF_32
+#define set_key simd_set_key
+#define get_key simd_get_key
+#endif
 #include "common-simd-setkey32.h"
+#ifdef SIMD_COEF_32
+#undef set_key
+#undef get_key
+
+static void set_key(char *key, int index)
+{
+	int_mask_set_key(key, index);
+	simd_set_key(key, index);
+}
+
+static char *get_key(int index)
+{
+	int cand;
+
+	index = int_mask_key(index, &cand);
+	return int_mask_patch(simd_get_key(index), index, cand);
+}
+#endif
 
 #ifndef REVERSE_STEPS
 #undef SSEi_REVERSE_STEPS
@@ -167,15 +202,23 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 {
 	const int count = *pcount;
 	int index;
+#ifdef SIMD_COEF_32
+	const int cands = int_mask_begin(count);
+#endif
 
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
 	for (index = 0; index < count; index += MIN_KEYS_PER_CRYPT) {
 #ifdef SIMD_COEF_32
-		SIMDSHA256body(&saved_key[(unsigned int)index/SIMD_COEF_32*SHA_BUF_SIZ*SIMD_COEF_32],
-		              &crypt_out[(unsigned int)index/SIMD_COEF_32*8*SIMD_COEF_32],
-		              NULL, SSEi_REVERSE_STEPS | SSEi_MIXED_IN);
+		int j;
+
+		for (j = 0; j < cands; j++) {
+			int_mask_block(saved_key, index / NBKEYS, j);
+			SIMDSHA256body(&saved_key[(unsigned int)index/SIMD_COEF_32*SHA_BUF_SIZ*SIMD_COEF_32],
+			              &crypt_out[(unsigned int)(index * cands + j * NBKEYS)/SIMD_COEF_32*8*SIMD_COEF_32],
+			              NULL, SSEi_REVERSE_STEPS | SSEi_MIXED_IN);
+		}
 #else
 		SHA256_CTX ctx;
 		SHA256_Init(&ctx);
@@ -184,7 +227,13 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 #endif
 	}
 
+#ifdef SIMD_COEF_32
+	*pcount = int_mask_count(crypt_out, count);
+
+	return *pcount;
+#else
 	return count;
+#endif
 }
 
 static int cmp_all(void *binary, int count)
@@ -248,7 +297,10 @@ struct fmt_main fmt_rawSHA256 = {
 		MIN_KEYS_PER_CRYPT,
 		MAX_KEYS_PER_CRYPT,
 		FMT_CASE | FMT_8_BIT | FMT_OMP | FMT_OMP_BAD |
-		FMT_SPLIT_UNIFIES_CASE,
+#ifdef SIMD_COEF_32
+		FMT_MASK |
+#endif
+		FMT_SPLIT_UNIFIES_CASE | FMT_FLAT_SALT,
 		{ NULL },
 		{
 			HEX_TAG,
@@ -258,7 +310,7 @@ struct fmt_main fmt_rawSHA256 = {
 	}, {
 		init,
 		done,
-		fmt_default_reset,
+		reset,
 		sha256_common_prepare,
 		sha256_common_valid,
 		sha256_common_split,
@@ -267,7 +267,7 @@ struct fmt_main fmt_raw0_SHA512 = {
 		MIN_KEYS_PER_CRYPT,
 		MAX_KEYS_PER_CRYPT,
 		FMT_CASE | FMT_8_BIT | FMT_OMP | FMT_OMP_BAD |
-		FMT_SPLIT_UNIFIES_CASE,
+		FMT_SPLIT_UNIFIES_CASE | FMT_FLAT_SALT,
 		{ NULL },
 		{
 			FORMAT_TAG,
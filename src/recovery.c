@@ -55,6 +55,7 @@
 #include "regex.h"
 #include "john.h"
 #include "mask.h"
+#include "workq.h"
 #include "unicode.h"
 #include "john_mpi.h"
 #include "signals.h"
@@ -404,6 +405,7 @@ void rec_save(void)
 	if (rec_save_mode) rec_save_mode(rec_file);
 	/* these are 'appended' resume blocks */
 	save_salt_state();
+	workq_save_state(rec_file);
 	if (rec_save_mode2) rec_save_mode2(rec_file);
 	if (rec_save_mode3) rec_save_mode3(rec_file);
 	if (options.flags & FLG_MASK_STACKED)
@@ -678,6 +680,10 @@ void rec_restore_mode(int (*restore_mode)(FILE *file))
 		if (!strcmp(buf, "slt-v2")) {
 			restore_salt_state(2);
 		}
+		if (!strcmp(buf, WORKQ_REC_TAG)) {
+			if (workq_restore_state(rec_file))
+				rec_format_error("work-stealing");
+		}
 		fgetl(buf, sizeof(buf), rec_file);
 	}
 
@@ -5,6 +5,7 @@
  * With heavy changes in Jumbo, by JimF and magnum
  */
 
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -98,7 +99,12 @@ int rules_mute, stack_rules_mute;
 
 static int fmt_case;
 
-static struct {
+/*
+ * Number of characters rules_apply_block() converts at once for short words.
+ */
+#define BLOCK_CHUNK			32
+
+static struct rules_state {
 	unsigned char vars[0x100];
 /*
  * pass == -2	initial syntax checking of rules
@@ -131,6 +137,26 @@ static struct {
 	char *classes[0x100];
 } CC_CACHE_ALIGN rules_data;
 
+/*
+ * In and alt buffers of each word for rules_apply_block(), which keeps a
+ * whole block of words in flight.  The padding lets it read and write
+ * BLOCK_CHUNK characters at the start of a buffer even when the word is
+ * longer, and keeps the words from all landing in the same few cache sets.
+ * These are allocated on first use, so that only threads which apply rules
+ * a block at a time get them.
+ */
+static char (*block_buffer)[2][RULE_WORD_SIZE * 2 + BLOCK_CHUNK];
+
+#ifdef _OPENMP
+/*
+ * Each OpenMP thread gets its own copy of the above, so that rules_apply()
+ * may be called concurrently (see rules_init_thread()).  The main thread's
+ * copy holds the master state set up by rules_init().
+ */
+#pragma omp threadprivate(rules_data, block_buffer)
+static struct rules_state *rules_data_main;
+#endif
+
 /* A null string that is safe to read past (e.g. for ASan) */
 static char safe_null_string[RULE_BUFFER_SIZE];
 
@@ -187,6 +213,13 @@ static char *conv_source = CONV_SOURCE;
 static char *conv_shift, *conv_invert, *conv_vowels, *conv_right, *conv_left;
 static char *conv_tolower, *conv_toupper;
 
+/*
+ * Whether conv_tolower, conv_toupper and conv_invert treat 7-bit characters
+ * as plain ASCII, so that rules_apply_block() may convert those without
+ * looking them up.
+ */
+static int conv_ascii_lower, conv_ascii_upper, conv_ascii_invert;
+
 #define INVALID_LENGTH			0x81
 #define INFINITE_LENGTH			0xFF
 
@@ -480,6 +513,28 @@ static char *rules_init_conv(char *src, char *dst)
 	return conv;
 }
 
+/*
+ * Checks that conv maps 7-bit characters to themselves, except for letters
+ * that are lowercased (if lower) or uppercased (if upper).
+ */
+static int rules_conv_is_ascii(const char *conv, int lower, int upper)
+{
+	int c;
+
+	for (c = 0; c < 0x80; c++) {
+		int expected = c;
+
+		if (lower && c >= 'A' && c <= 'Z')
+			expected = c | 0x20;
+		else if (upper && c >= 'a' && c <= 'z')
+			expected = c & ~0x20;
+		if (ARCH_INDEX(conv[c]) != expected)
+			return 0;
+	}
+
+	return 1;
+}
+
 static void rules_init_convs(void)
 {
 	conv_vowels = rules_init_conv(conv_source, CONV_VOWELS);
@@ -516,6 +571,10 @@ static void rules_init_convs(void)
 		conv_shift = rules_init_conv(conv_source, CONV_SHIFT);
 		conv_invert = rules_init_conv(conv_source, CONV_INVERT);
 	}
+
+	conv_ascii_lower = rules_conv_is_ascii(conv_tolower, 1, 0);
+	conv_ascii_upper = rules_conv_is_ascii(conv_toupper, 0, 1);
+	conv_ascii_invert = rules_conv_is_ascii(conv_invert, 1, 1);
 }
 
 static void rules_init_length(int max_length)
@@ -640,8 +699,24 @@ void rules_init(struct db_main *db, int max_length)
 	rules_init_length(max_length);
 
 	rules_stacked_after = (options.flags & (FLG_RULES_CHK | FLG_SINGLE_CHK)) && (options.flags & FLG_RULES_STACK_CHK);
+
+#ifdef _OPENMP
+	rules_data_main = &rules_data;
+#endif
 }
 
+#ifdef _OPENMP
+void rules_init_thread(void)
+{
+	if (&rules_data == rules_data_main)
+		return;
+
+	memcpy(rules_vars, rules_data_main->vars, sizeof(rules_vars));
+	memcpy(rules_classes, rules_data_main->classes, sizeof(rules_classes));
+	rules_pass = 0;
+}
+#endif
+
 char *rules_reject(char *rule, int split, char *last, struct db_main *db)
 {
 	static char out_rule[RULE_BUFFER_SIZE];
@@ -756,6 +831,76 @@ accept:
 
 #define STACK_MAXLEN (rules_stacked_after ? RULE_WORD_SIZE : rules_max_length)
 
+/*
+ * Sets the length variables that depend on whether our result is passed on
+ * to stacked rules.
+ */
+static void rules_init_stacked_vars(void)
+{
+	if (rules_stacked_after) {
+		rules_vars['*'] = RULE_WORD_SIZE - 1;
+		rules_vars['-'] = RULE_WORD_SIZE - 2;
+		rules_vars['+'] = RULE_WORD_SIZE;
+
+		rules_vars['#'] = 0;
+		rules_vars['@'] = 0;
+		rules_vars['$'] = 1;
+	} else {
+		rules_vars['*'] = rules_max_length;
+		rules_vars['-'] = rules_max_length - 1;
+		rules_vars['+'] = rules_max_length + 1;
+
+		rules_vars['#'] = min_length;
+		rules_vars['@'] = min_length ? min_length - 1 : 0;
+		rules_vars['$'] = min_length + 1;
+	}
+	length_initiated_as = rules_stacked_after;
+}
+
+/*
+ * Final length checks, conversion back to UTF-8 and comparison against the
+ * previous mangled word, common to rules_apply() and rules_apply_compiled().
+ */
+static MAYBE_INLINE char *rules_out(char *in, int length, char *last)
+{
+	in[STACK_MAXLEN] = 0;
+	if (!rules_stacked_after) {
+		if (min_length && length < min_length)
+			return NULL;
+		/*
+		 * Over --max-length are always skipped, while over
+		 * format's length are truncated if FMT_TRUNC.
+		 */
+		if (skip_length && length > skip_length)
+			return NULL;
+	}
+	if (!(options.flags & FLG_MASK_STACKED) && options.internal_cp != UTF_8 &&
+	    options.internal_cp != ENC_RAW && options.target_enc == UTF_8) {
+		char out[PLAINTEXT_BUFFER_SIZE + 1];
+
+		strcpy(in, cp_to_utf8_r(in, out, STACK_MAXLEN));
+		length = strlen(in);
+	}
+
+	if (last) {
+		if (length > STACK_MAXLEN)
+			length = STACK_MAXLEN;
+		if (length >= ARCH_SIZE - 1) {
+			if (*(ARCH_WORD *)in != *(ARCH_WORD *)last)
+				return in;
+			if (strcmp(&in[ARCH_SIZE - 1], &last[ARCH_SIZE - 1]))
+				return in;
+			return NULL;
+		}
+		if (last[length])
+			return in;
+		if (memcmp(in, last, length))
+			return in;
+		return NULL;
+	}
+	return in;
+}
+
 char *rules_apply(char *word_in, char *rule, int split, char *last)
 {
 	union {
@@ -807,26 +952,8 @@ char *rules_apply(char *word_in, char *rule, int split, char *last)
 	rules_vars['l'] = length;
 	rules_vars['m'] = (unsigned char)length - 1;
 
-	if (rules_stacked_after != length_initiated_as) {
-		if (rules_stacked_after) {
-			rules_vars['*'] = RULE_WORD_SIZE - 1;
-			rules_vars['-'] = RULE_WORD_SIZE - 2;
-			rules_vars['+'] = RULE_WORD_SIZE;
-
-			rules_vars['#'] = 0;
-			rules_vars['@'] = 0;
-			rules_vars['$'] = 1;
-		} else {
-			rules_vars['*'] = rules_max_length;
-			rules_vars['-'] = rules_max_length - 1;
-			rules_vars['+'] = rules_max_length + 1;
-
-			rules_vars['#'] = min_length;
-			rules_vars['@'] = min_length ? min_length - 1 : 0;
-			rules_vars['$'] = min_length + 1;
-		}
-		length_initiated_as = rules_stacked_after;
-	}
+	if (rules_stacked_after != length_initiated_as)
+		rules_init_stacked_vars();
 
 	which = 0;
 
@@ -1587,6 +1714,8 @@ char *rules_apply(char *word_in, char *rule, int split, char *last)
 				unsigned char x;
 				int y;
 				POSITION(x)
+				if (!length)
+					break;
 				y = length;
 				while (y) {
 					in[y + x] = in[y];
@@ -1605,6 +1734,8 @@ char *rules_apply(char *word_in, char *rule, int split, char *last)
 			{
 				unsigned char x;
 				POSITION(x)
+				if (!length)
+					break;
 				while (x) {
 					in[length] = in[length - 1];
 					++length;
@@ -1752,42 +1883,7 @@ char *rules_apply(char *word_in, char *rule, int split, char *last)
 		goto out_which;
 
 out_OK:
-	in[STACK_MAXLEN] = 0;
-	if (!rules_stacked_after) {
-		if (min_length && length < min_length)
-			return NULL;
-		/*
-		 * Over --max-length are always skipped, while over
-		 * format's length are truncated if FMT_TRUNC.
-		 */
-		if (skip_length && length > skip_length)
-			return NULL;
-	}
-	if (!(options.flags & FLG_MASK_STACKED) && options.internal_cp != UTF_8 &&
-	    options.internal_cp != ENC_RAW && options.target_enc == UTF_8) {
-		char out[PLAINTEXT_BUFFER_SIZE + 1];
-
-		strcpy(in, cp_to_utf8_r(in, out, STACK_MAXLEN));
-		length = strlen(in);
-	}
-
-	if (last) {
-		if (length > STACK_MAXLEN)
-			length = STACK_MAXLEN;
-		if (length >= ARCH_SIZE - 1) {
-			if (*(ARCH_WORD *)in != *(ARCH_WORD *)last)
-				return in;
-			if (strcmp(&in[ARCH_SIZE - 1], &last[ARCH_SIZE - 1]))
-				return in;
-			return NULL;
-		}
-		if (last[length])
-			return in;
-		if (memcmp(in, last, length))
-			return in;
-		return NULL;
-	}
-	return in;
+	return rules_out(in, length, last);
 
 out_which:
 	if (which == 1) {
@@ -1825,6 +1921,1806 @@ out_ERROR_UNALLOWED:
 	goto out_NULL;
 }
 
+/*
+ * Operand decoding for rules_compile().  Positions given as digits or letters
+ * never change, while the others (such as 'l' or 'p') are looked up each time
+ * the rule is applied.
+ */
+#define COMPILE_VALUE(value) { \
+	if (!((value) = RULE)) return 0; \
+}
+
+#define COMPILE_POSITION(i) { \
+	char var; \
+	COMPILE_VALUE(var) \
+	if ((var >= '0' && var <= '9') || (var >= 'A' && var <= 'Z')) \
+		op->pos[i] = rules_vars[ARCH_INDEX(var)]; \
+	else \
+		op->var[i] = var; \
+}
+
+#define COMPILE_CLASS { \
+	COMPILE_VALUE(op->value[0]) \
+	if (op->value[0] == '?' && !hc_logic && \
+	    !(op->class = rules_classes[ARCH_INDEX(RULE)])) \
+		return 0; \
+}
+
+int rules_compile(char *rule, struct rules_prog *prog)
+{
+	struct rules_op *op = prog->op;
+	char *string = prog->strings;
+
+	if (rules_pass)
+		return 0;
+
+	prog->empty = !NEXT;
+	prog->hc_logic = hc_logic;
+	prog->block = 1;
+
+	while (RULE) {
+		memset(op, 0, sizeof(*op));
+		op->cmd = LAST;
+
+		switch (LAST) {
+		case ':':
+		case ' ':
+		case '\t':
+			continue;
+
+		case 'l':
+		case 'u':
+		case 'c':
+		case 'C':
+		case 't':
+		case 'r':
+		case 'd':
+		case 'f':
+		case 'S':
+		case 'V':
+		case 'P':
+		case 'I':
+		case 'U':
+		case 'k':
+		case 'K':
+		case 'q':
+		case '4':
+		case '6':
+		case 'E':
+			break;
+
+/* These leave per-word state in rules_vars[] or memory for later commands */
+		case 'M':
+			prog->block = 0;
+			break;
+
+		case 'Q':
+			op->count = !!NEXT;
+			break;
+
+		case 'p':
+			if (hc_logic || (NEXT >= '1' && NEXT <= '9')) {
+				op->count = 1;
+				COMPILE_POSITION(0)
+			}
+			break;
+
+		case 'R':
+		case 'L':
+			if (hc_logic || (NEXT >= '0' && NEXT <= '9')) {
+				op->count = 1;
+				COMPILE_POSITION(0)
+			}
+			break;
+
+		case '<':
+		case '>':
+		case '_':
+		case '\'':
+		case 'T':
+		case 'D':
+		case 'W':
+		case 'a':
+		case 'b':
+		case '+':
+		case '-':
+		case '.':
+		case ',':
+		case 'y':
+		case 'Y':
+		case 'z':
+		case 'Z':
+			COMPILE_POSITION(0)
+			break;
+
+		case 'x':
+			op->count = hc_logic;
+			/* fall through */
+		case 'O':
+		case '*':
+			COMPILE_POSITION(0)
+			COMPILE_POSITION(1)
+			break;
+
+		case 'X':
+			COMPILE_POSITION(0)
+			COMPILE_POSITION(1)
+			COMPILE_POSITION(2)
+			break;
+
+		case 'v':
+			prog->block = 0;
+			COMPILE_VALUE(op->value[0])
+			if (op->value[0] < 'a' || op->value[0] > 'k')
+				return 0;
+			COMPILE_POSITION(0)
+			COMPILE_POSITION(1)
+			break;
+
+		case 'i':
+			op->count = hc_logic;
+			/* fall through */
+		case 'o':
+			COMPILE_POSITION(0)
+			COMPILE_VALUE(op->value[0])
+			break;
+
+		case '$':
+			do {
+				COMPILE_VALUE(op->value[op->count])
+				op->count++;
+			} while (op->count < 3 && NEXT == '$' && RULE);
+			break;
+
+/* The prefix is kept in the order it ends up in */
+		case '^':
+			{
+				char a, b;
+				COMPILE_VALUE(a)
+				op->count = 1;
+				if (NEXT == '^') {
+					(void)RULE;
+					COMPILE_VALUE(b)
+					op->count = 2;
+					if (NEXT == '^') {
+						(void)RULE;
+						COMPILE_VALUE(op->value[0])
+						op->count = 3;
+					}
+					op->value[op->count - 2] = b;
+				}
+				op->value[op->count - 1] = a;
+			}
+			break;
+
+		case '[':
+		case ']':
+		case '{':
+		case '}':
+			op->count = 1;
+			while (NEXT == LAST) {
+				(void)RULE;
+				op->count++;
+			}
+			break;
+
+		case 's':
+			COMPILE_CLASS
+			COMPILE_VALUE(op->value[1])
+			break;
+
+		case '/':
+			prog->block = 0;
+			COMPILE_CLASS
+			break;
+
+		case '@':
+		case '!':
+		case '(':
+		case ')':
+		case 'e':
+			COMPILE_CLASS
+			break;
+
+		case '%':
+			prog->block = 0;
+			/* fall through */
+		case '=':
+			COMPILE_POSITION(0)
+			COMPILE_CLASS
+			break;
+
+		case 'A':
+			{
+				char term;
+				COMPILE_POSITION(0)
+				COMPILE_VALUE(term)
+				op->string = string;
+				while (NEXT != term) {
+					COMPILE_VALUE(*string++)
+					op->count++;
+				}
+				(void)RULE;
+			}
+			break;
+
+/* "single crack" mode rules, and anything unknown */
+		default:
+			return 0;
+		}
+
+		op++;
+	}
+
+	op->cmd = 0;
+	return 1;
+}
+
+#define OP_POSITION(value, i) { \
+	if (((value) = op->var[i] ? rules_vars[ARCH_INDEX(op->var[i])] : \
+	    op->pos[i]) == INVALID_LENGTH) \
+		goto out_ERROR_POSITION; \
+}
+
+#define OP_CLASS_export_pos(start, true, false) { \
+	if (op->class) { \
+		for (pos = (start); ARCH_INDEX(in[pos]); pos++) \
+		if (op->class[ARCH_INDEX(in[pos])]) { \
+			true; \
+		} else { \
+			false; \
+		} \
+	} else { \
+		for (pos = (start); ARCH_INDEX(in[pos]); pos++) \
+		if (in[pos] == op->value[0]) { \
+			true; \
+		} else { \
+			false; \
+		} \
+	} \
+}
+
+#define OP_CLASS(start, true, false) { \
+	int pos; \
+	OP_CLASS_export_pos(start, true, false); \
+}
+
+/*
+ * Applies one operation of a compiled rule to the word in *in_p, of *length_p
+ * characters.  Returns 1 if the word is still there, 0 if it was rejected or
+ * -1 for an invalid position.
+ */
+static MAYBE_INLINE int rules_run_op(const struct rules_op *op,
+	char **in_p, char **alt_p, int *length_p, char **memory_p)
+{
+	char *in = *in_p, *alt = *alt_p, *memory = *memory_p;
+	int length = *length_p;
+
+	switch (op->cmd) {
+	case '<':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			if (length >= pos) return 0;
+		}
+		break;
+
+	case '>':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			if (length <= pos) return 0;
+		}
+		break;
+
+	case 'l':
+		CONV(conv_tolower)
+		break;
+
+	case 'u':
+		CONV(conv_toupper)
+		break;
+
+	case 'c':
+		{
+			int pos = 0;
+			if ((in[0] = conv_toupper[ARCH_INDEX(in[0])]))
+			while (in[++pos])
+				in[pos] =
+				    conv_tolower[ARCH_INDEX(in[pos])];
+			in[pos] = 0;
+		}
+		break;
+
+	case 'r':
+		{
+			char *out;
+			GET_OUT
+			*(out += length) = 0;
+			while (*in)
+				*--out = *in++;
+			in = out;
+		}
+		break;
+
+	case 'd':
+		memcpy(in + length, in, length);
+		in[length <<= 1] = 0;
+		break;
+
+	case 'f':
+		{
+			int pos;
+			in[pos = (length <<= 1)] = 0;
+			{
+				char *p = in;
+				while (*p)
+					in[--pos] = *p++;
+			}
+		}
+		break;
+
+	case 'p':
+		if (op->count) {
+			unsigned char x, y;
+			OP_POSITION(x, 0)
+			if (x * length > RULE_WORD_SIZE - 1)
+				x = (RULE_WORD_SIZE - 1) / length;
+			y = x;
+			in[length*(x + 1)] = 0;
+			while (x) {
+				memcpy(in + length*x, in, length);
+				--x;
+			}
+			length *= (y + 1);
+			break;
+		}
+		if (length < 2) break;
+		{
+			int pos = length - 1;
+			if (strchr("sxz", in[pos]) ||
+			    (pos > 1 && in[pos] == 'h' &&
+			    (in[pos - 1] == 'c' || in[pos - 1] == 's')))
+				strcat(in, "es");
+			else
+			if (in[pos] == 'f' && in[pos - 1] != 'f')
+				strcpy(&in[pos], "ves");
+			else
+			if (pos > 1 &&
+			    in[pos] == 'e' && in[pos - 1] == 'f')
+				strcpy(&in[pos - 1], "ves");
+			else
+			if (pos > 1 && in[pos] == 'y') {
+				if (strchr("aeiou", in[pos - 1]))
+					strcat(in, "s");
+				else
+					strcpy(&in[pos], "ies");
+			} else
+				strcat(in, "s");
+		}
+		length = strlen(in);
+		break;
+
+	case '$':
+		memcpy(&in[length], op->value, op->count);
+		in[length += op->count] = 0;
+		break;
+
+	case '^':
+		{
+			char *out;
+			GET_OUT
+			memcpy(out, op->value, op->count);
+			memcpy(&out[op->count], in, length + 1);
+			length += op->count;
+			in = out;
+		}
+		break;
+
+	case 'x':
+		if (op->count) {
+			int pos, pos2;
+			OP_POSITION(pos, 0)
+			OP_POSITION(pos2, 1)
+			if (pos < length && pos+pos2 <= length) {
+				char *out;
+				GET_OUT
+				in += pos;
+				strnzcpy(out, in, pos2 + 1);
+				length = strlen(in = out);
+			}
+			break;
+		}
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			if (pos < length) {
+				char *out;
+				GET_OUT
+				in += pos;
+				OP_POSITION(pos, 1)
+				strnzcpy(out, in, pos + 1);
+				length = strlen(in = out);
+				break;
+			}
+			OP_POSITION(pos, 1)
+			in[length = 0] = 0;
+		}
+		break;
+
+	case 'i':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			if (pos < length) {
+				char *p = in + pos;
+				memmove(p + 1, p, length++ - pos);
+				*p = op->value[0];
+				in[length] = 0;
+				break;
+			}
+			if (op->count) {
+				if (pos == length) {
+					in[length++] = op->value[0];
+					in[length] = 0;
+				}
+				break;
+			}
+		}
+		in[length++] = op->value[0];
+		in[length] = 0;
+		break;
+
+	case 'o':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			if (pos < length)
+				in[pos] = op->value[0];
+		}
+		break;
+
+	case 's':
+		OP_CLASS(0, in[pos] = op->value[1], {})
+		break;
+
+	case '@':
+		length = 0;
+		OP_CLASS(0, {}, in[length++] = in[pos])
+		in[length] = 0;
+		break;
+
+	case '!':
+		OP_CLASS(0, return 0, {})
+		break;
+
+	case '/':
+		{
+			int pos;
+			OP_CLASS_export_pos(0, break, {})
+			rules_vars['p'] = pos;
+			if (in[pos]) break;
+		}
+		return 0;
+
+	case '=':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			if (pos >= length)
+				return 0;
+			OP_CLASS_export_pos(pos, break, return 0)
+		}
+		break;
+
+	case '[':
+		if ((length -= op->count) > 0) {
+			char *out;
+			GET_OUT
+			memcpy(out, &in[op->count], length + 1);
+			in = out;
+			break;
+		}
+		in[length = 0] = 0;
+		break;
+
+	case ']':
+		if ((length -= op->count) < 0)
+			length = 0;
+		in[length] = 0;
+		break;
+
+	case 'C':
+		{
+			int pos = 0;
+			if ((in[0] = conv_tolower[ARCH_INDEX(in[0])]))
+			while (in[++pos])
+				in[pos] =
+				    conv_toupper[ARCH_INDEX(in[pos])];
+			in[pos] = 0;
+		}
+		break;
+
+	case 't':
+		CONV(conv_invert)
+		break;
+
+	case '(':
+		OP_CLASS(0, break, return 0)
+		break;
+
+	case ')':
+		if (!length)
+			return 0;
+		OP_CLASS(length - 1, break, return 0)
+		break;
+
+	case '\'':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			if (pos < length)
+				in[length = pos] = 0;
+		}
+		break;
+
+	case '%':
+		{
+			int count = 0, required, pos;
+			OP_POSITION(required, 0)
+			OP_CLASS_export_pos(0,
+			    if (++count >= required) break, {})
+			if (count < required) return 0;
+			rules_vars['p'] = pos;
+		}
+		break;
+
+	case 'A':
+		{
+			int pos, count = op->count;
+			OP_POSITION(pos, 0)
+			if (pos >= length) { /* append */
+				if (count > RULE_WORD_SIZE - 1 - length)
+					count = RULE_WORD_SIZE - 1 - length;
+				memcpy(&in[length], op->string, count);
+				in[length += count] = 0;
+				break;
+			}
+			/* insert or prepend */
+			{
+				char *out;
+				GET_OUT
+				memcpy(out, in, pos);
+				if (count > RULE_WORD_SIZE - 1 - pos)
+					count = RULE_WORD_SIZE - 1 - pos;
+				memcpy(&out[pos], op->string, count);
+				strcpy(&out[pos + count], &in[pos]);
+				length += count;
+				in = out;
+			}
+		}
+		break;
+
+	case 'T':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			in[pos] = conv_invert[ARCH_INDEX(in[pos])];
+		}
+		break;
+
+	case 'D':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			if (pos < length) {
+				memmove(&in[pos], &in[pos + 1],
+				    length - pos);
+				length--;
+			}
+		}
+		break;
+
+	case '{':
+		if (length) {
+			char *out;
+			int count = op->count;
+			while (count >= length)
+				count -= length;
+			if (!count)
+				break;
+			GET_OUT
+			memcpy(out, &in[count], length - count);
+			memcpy(&out[length - count], in, count);
+			out[length] = 0;
+			in = out;
+			break;
+		}
+		in[0] = 0;
+		break;
+
+	case '}':
+		if (length) {
+			char *out;
+			int pos;
+			int count = op->count;
+			while (count >= length)
+				count -= length;
+			if (!count)
+				break;
+			GET_OUT
+			memcpy(out, &in[pos = length - count], count);
+			memcpy(&out[count], in, pos);
+			out[length] = 0;
+			in = out;
+			break;
+		}
+		in[0] = 0;
+		break;
+
+	case 'S':
+		CONV(conv_shift);
+		break;
+
+	case 'V':
+		CONV(conv_vowels);
+		break;
+
+	case 'R':
+		if (op->count) {
+			unsigned char n;
+			OP_POSITION(n, 0)
+			if (n < length)
+				in[n] = (unsigned char)in[n] >> 1;
+			break;
+		}
+		CONV(conv_right);
+		break;
+
+	case 'L':
+		if (op->count) {
+			unsigned char n;
+			OP_POSITION(n, 0)
+			if (n < length)
+				in[n] = (unsigned char)in[n] << 1;
+			break;
+		}
+		CONV(conv_left);
+		break;
+
+	case 'P':
+		{
+			int pos;
+			if ((pos = length - 1) < 2) break;
+			if (in[pos] == 'd' && in[pos - 1] == 'e') break;
+			if (in[pos] == 'y') in[pos] = 'i'; else
+			if (strchr("bgp", in[pos]) &&
+			    !strchr("bgp", in[pos - 1])) {
+				in[pos + 1] = in[pos];
+				in[pos + 2] = 0;
+			}
+			if (in[pos] == 'e')
+				strcat(in, "d");
+			else
+				strcat(in, "ed");
+		}
+		length = strlen(in);
+		break;
+
+	case 'I':
+		{
+			int pos;
+			if ((pos = length - 1) < 2) break;
+			if (in[pos] == 'g' && in[pos - 1] == 'n' &&
+			    in[pos - 2] == 'i') break;
+			if (strchr("aeiou", in[pos]))
+				strcpy(&in[pos], "ing");
+			else {
+				if (strchr("bgp", in[pos]) &&
+				    !strchr("bgp", in[pos - 1])) {
+					in[pos + 1] = in[pos];
+					in[pos + 2] = 0;
+				}
+				strcat(in, "ing");
+			}
+		}
+		length = strlen(in);
+		break;
+
+	case 'M':
+		memcpy(memory = memory_buffer, in, length + 1);
+		rules_vars['m'] = (unsigned char)length - 1;
+		break;
+
+	case 'Q':
+		if (op->count) {
+			if (!strcmp(memory, in))
+				return 0;
+		} else if (!strncmp(memory, in, STACK_MAXLEN))
+			return 0;
+		break;
+
+	case 'X':
+		{
+			int mpos, count, ipos, mleft;
+			char *inp;
+			const char *mp;
+			OP_POSITION(mpos, 0)
+			OP_POSITION(count, 1)
+			OP_POSITION(ipos, 2)
+			mleft = (int)(unsigned char)
+			    (rules_vars['m'] + 1) - mpos;
+			if (count > mleft)
+				count = mleft;
+			if (count <= 0)
+				break;
+			mp = memory + mpos;
+			if (ipos >= length) {
+				memcpy(&in[length], mp, count);
+				in[length += count] = 0;
+				break;
+			}
+			inp = in + ipos;
+			memmove(inp + count, inp, length - ipos);
+			in[length += count] = 0;
+			memcpy(inp, mp, count);
+		}
+		break;
+
+	case 'v':
+		{
+			unsigned char a, s;
+			rules_vars['l'] = length;
+			OP_POSITION(a, 0)
+			OP_POSITION(s, 1)
+			rules_vars[ARCH_INDEX(op->value[0])] = a - s;
+		}
+		break;
+
+	case '+':
+		{
+			unsigned char x;
+			OP_POSITION(x, 0)
+			if (x < length)
+				++in[x];
+		}
+		break;
+
+	case 'a':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			if (!rules_stacked_after) {
+				if (length + pos > rules_max_length)
+					return 0;
+				if (length + pos < min_length)
+					return 0;
+			}
+		}
+		break;
+
+	case 'b':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			if (!rules_stacked_after) {
+				if (length - pos > rules_max_length)
+					return 0;
+				if (length - pos < min_length)
+					return 0;
+			}
+		}
+		break;
+
+	case 'W':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			in[pos] = conv_shift[ARCH_INDEX(in[pos])];
+		}
+		break;
+
+	case 'U':
+		if (!valid_utf8((UTF8*)in))
+			return 0;
+		break;
+
+	case '_':
+		{
+			int pos;
+			OP_POSITION(pos, 0)
+			if (length != pos) return 0;
+		}
+		break;
+
+	case '-':
+		{
+			unsigned char x;
+			OP_POSITION(x, 0)
+			if (x < length)
+				--in[x];
+		}
+		break;
+
+	case 'k':
+		if (length > 1)
+			SWAP2(0,1)
+		break;
+
+	case 'K':
+		if (length > 1)
+			SWAP2((unsigned)length - 1,(unsigned)length - 2)
+		break;
+
+	case '*':
+		{
+			unsigned char x, y;
+			OP_POSITION(x, 0)
+			OP_POSITION(y, 1)
+			if (length > x && length > y)
+				SWAP2(x,y)
+		}
+		break;
+
+	case 'z':
+		{
+			unsigned char x;
+			int y;
+			OP_POSITION(x, 0)
+			if (!length)
+				break;
+			y = length;
+			while (y) {
+				in[y + x] = in[y];
+				--y;
+			}
+			length += x;
+			in[length] = 0;
+			while(x) {
+				in[x] = in[0];
+				--x;
+			}
+		}
+		break;
+
+	case 'Z':
+		{
+			unsigned char x;
+			OP_POSITION(x, 0)
+			if (!length)
+				break;
+			while (x) {
+				in[length] = in[length - 1];
+				++length;
+				--x;
+			}
+			in[length] = 0;
+		}
+		break;
+
+	case 'q':
+		{
+			int x = length << 1;
+			in[x--] = 0;
+			while (x>0) {
+				in[x] = in[x - 1] = in[x >> 1];
+				x -= 2;
+			}
+			length <<= 1;
+		}
+		break;
+
+	case '.':
+		{
+			unsigned char n;
+			OP_POSITION(n, 0)
+			if (n < length - 1 && length > 1)
+				in[n] = in[n + 1];
+		}
+		break;
+
+	case ',':
+		{
+			unsigned char n;
+			OP_POSITION(n, 0)
+			if (n >= 1 && length > 1 && n < length)
+				in[n] = in[n - 1];
+		}
+		break;
+
+	case 'y':
+		{
+			unsigned char n;
+			OP_POSITION(n, 0)
+			if (n <= length) {
+				memmove(&in[n], in, length);
+				length += n;
+				in[length] = 0;
+			}
+		}
+		break;
+
+	case 'Y':
+		{
+			unsigned char n;
+			OP_POSITION(n, 0)
+			if (n <= length) {
+				memmove(&in[length], &in[length - n], n);
+				length += n;
+				in[length] = 0;
+			}
+		}
+		break;
+
+	case '4':
+		{
+			int m = rules_vars['m'] + 1;
+			memcpy(&in[length], memory, m);
+			in[length += m] = 0;
+		}
+		break;
+
+	case '6':
+		{
+			int m = rules_vars['m'] + 1;
+			memmove(&in[m], in, length);
+			memcpy(in, memory, m);
+			in[length += m] = 0;
+		}
+		break;
+
+	case 'O':
+		{
+			int pos, pos2;
+			OP_POSITION(pos, 0)
+			OP_POSITION(pos2, 1)
+			if (pos < length && pos+pos2 <= length) {
+				char *out;
+				GET_OUT
+				strncpy(out, in, pos);
+				in += pos + pos2;
+				strnzcpy(out + pos, in, length - (pos + pos2) + 1);
+				length -= pos2;
+				in = out;
+			}
+		}
+		break;
+
+	case 'E':
+		{
+			int up=1, idx=0;
+			while (in[idx]) {
+				if (up) {
+					if (in[idx] != ' ') {
+						if (in[idx] >= 'a' &&
+						    in[idx] <= 'z')
+							in[idx] -= 0x20;
+						up = 0;
+					}
+				} else {
+					if (in[idx] == ' ')
+						up = 1;
+					else if (in[idx] >= 'A' &&
+					         in[idx] <= 'Z')
+						in[idx] += 0x20;
+				}
+				++idx;
+			}
+		}
+		break;
+
+	case 'e':
+		{
+			int up=1;
+			OP_CLASS(0,
+			      up=1,
+			      if (up) in[pos] = conv_toupper[ARCH_INDEX(in[pos])];
+			      else   in[pos] = conv_tolower[ARCH_INDEX(in[pos])];
+			      up=0)
+		}
+		break;
+	}
+
+	*in_p = in;
+	*alt_p = alt;
+	*length_p = length;
+	*memory_p = memory;
+	return 1;
+
+out_ERROR_POSITION:
+	return -1;
+}
+
+char *rules_apply_compiled(char *word_in, const struct rules_prog *prog,
+	char *last)
+{
+	union {
+		char aligned[PLAINTEXT_BUFFER_SIZE];
+		ARCH_WORD dummy;
+	} convbuf;
+	char *cpword = convbuf.aligned;
+	const struct rules_op *op;
+	char *word;
+	char *in, *alt, *memory;
+	int length;
+
+	if (!(options.flags & FLG_SINGLE_CHK) && options.internal_cp != UTF_8 &&
+	    options.internal_cp != ENC_RAW && options.target_enc == UTF_8)
+		memory = word = utf8_to_cp_r(word_in, cpword,
+		                             PLAINTEXT_BUFFER_SIZE - 1);
+	else
+		memory = word = word_in;
+
+	in = buffer[0][STAGE];
+	if (in == last)
+		in = buffer[2][STAGE];
+
+	length = 0;
+	while (length < RULE_WORD_SIZE) {
+		if (!(in[length] = word[length]))
+			break;
+		length++;
+	}
+
+	if (prog->empty)
+		goto out_OK;
+
+	if (!length && !prog->hc_logic)
+		return NULL;
+
+	alt = buffer[1][STAGE];
+	if (alt == last)
+		alt = buffer[2][STAGE];
+
+	rules_vars['l'] = length;
+	rules_vars['m'] = (unsigned char)length - 1;
+
+	if (rules_stacked_after != length_initiated_as)
+		rules_init_stacked_vars();
+
+	for (op = prog->op; op->cmd; op++) {
+		int result;
+
+		if (length >= RULE_WORD_SIZE)
+			in[length = RULE_WORD_SIZE - 1] = 0;
+
+		if ((result = rules_run_op(op, &in, &alt, &length,
+		    &memory)) <= 0) {
+			if (result < 0)
+				rules_errno = RULES_ERROR_POSITION;
+			return NULL;
+		}
+		if (!length && !prog->hc_logic)
+			return NULL;
+	}
+
+out_OK:
+	return rules_out(in, length, last);
+}
+
+struct rules_prog *rules_prog_dup(const struct rules_prog *prog)
+{
+	const struct rules_op *op;
+	struct rules_op *copy_op;
+	struct rules_prog *copy;
+	size_t size, strings = 0;
+	char *string;
+
+	for (op = prog->op; op->cmd; op++)
+	if (op->string)
+		strings += op->count;
+
+	size = offsetof(struct rules_prog, op) +
+		(op - prog->op + 1) * sizeof(*op);
+	copy = mem_alloc(size + strings);
+	memcpy(copy, prog, size);
+
+	string = (char *)copy + size;
+	for (copy_op = copy->op; copy_op->cmd; copy_op++)
+	if (copy_op->string) {
+		memcpy(string, copy_op->string, copy_op->count);
+		copy_op->string = string;
+		string += copy_op->count;
+	}
+
+	return copy;
+}
+
+/*
+ * Helpers for rules_apply_block().  Words shorter than BLOCK_CHUNK are
+ * processed BLOCK_CHUNK characters at a time with loops of a fixed length,
+ * which the compiler turns into a few vector instructions, no matter where
+ * the word ends.  What's past the NUL in the block buffers is garbage anyway.
+ */
+
+/*
+ * Same as CONV(conv) for an ASCII case conversion table, unless there's an
+ * 8-bit character around.
+ */
+static MAYBE_INLINE void block_conv(char *in, int length, const char *conv,
+	int lower, int upper)
+{
+	unsigned char *p = (unsigned char *)in;
+	unsigned char high = 0;
+	int pos;
+
+	if (length < BLOCK_CHUNK) {
+		for (pos = 0; pos < BLOCK_CHUNK; pos++)
+			high |= p[pos];
+		if (!(high & 0x80)) {
+			for (pos = 0; pos < BLOCK_CHUNK; pos++) {
+				unsigned char flip = 0;
+
+				if (lower && (unsigned char)(p[pos] - 'A') < 26)
+					flip = 0x20;
+				if (upper && (unsigned char)(p[pos] - 'a') < 26)
+					flip = 0x20;
+				p[pos] ^= flip;
+			}
+			return;
+		}
+	}
+
+	for (pos = 0; (in[pos] = conv[ARCH_INDEX(in[pos])]); pos++);
+}
+
+/*
+ * Same as "s" with a character (not a class) to replace.
+ */
+static MAYBE_INLINE void block_replace(char *in, int length, char from,
+	char to)
+{
+	int pos;
+
+	if (length < BLOCK_CHUNK) {
+		for (pos = 0; pos < BLOCK_CHUNK; pos++)
+			in[pos] = in[pos] == from ? to : in[pos];
+		return;
+	}
+
+	for (pos = 0; in[pos]; pos++)
+		if (in[pos] == from)
+			in[pos] = to;
+}
+
+/*
+ * Whether op has a shortcut in rules_block_op().
+ */
+static MAYBE_INLINE int rules_block_has_op(const struct rules_op *op)
+{
+	switch (op->cmd) {
+	case 'l':
+	case 'c':
+		return conv_ascii_lower;
+	case 'u':
+	case 'C':
+		return conv_ascii_upper;
+	case 't':
+		return conv_ascii_invert;
+	case 's':
+		return !op->class;
+	}
+
+	return 0;
+}
+
+/*
+ * Applies op, which rules_block_has_op() accepted, to the words in a block
+ * with the helpers above.
+ */
+static MAYBE_INLINE void rules_block_op(const struct rules_op *op, char **in,
+	int *length, unsigned char *alive, int count)
+{
+	const char *conv;
+	int lower, upper, first, i;
+
+	switch (op->cmd) {
+	case 'l':
+		for (i = 0; i < count; i++)
+			block_conv(in[alive[i]], length[alive[i]],
+			    conv_tolower, 1, 0);
+		return;
+
+	case 'u':
+		for (i = 0; i < count; i++)
+			block_conv(in[alive[i]], length[alive[i]],
+			    conv_toupper, 0, 1);
+		return;
+
+	case 't':
+		for (i = 0; i < count; i++)
+			block_conv(in[alive[i]], length[alive[i]],
+			    conv_invert, 1, 1);
+		return;
+
+	case 's':
+		for (i = 0; i < count; i++)
+			block_replace(in[alive[i]], length[alive[i]],
+			    op->value[0], op->value[1]);
+		return;
+
+	case 'c':
+		conv = conv_toupper;
+		lower = 1; upper = 0;
+		break;
+
+	default: /* 'C' */
+		conv = conv_tolower;
+		lower = 0; upper = 1;
+	}
+
+/* "c" and "C": convert the whole word one way, then the first character */
+	for (i = 0; i < count; i++) {
+		char *word = in[alive[i]];
+
+		if (!(first = ARCH_INDEX(word[0])))
+			continue;
+		block_conv(word, length[alive[i]],
+		    lower ? conv_tolower : conv_toupper, lower, upper);
+		word[0] = conv[first];
+	}
+}
+
+/*
+ * Copies a candidate of length characters to its slot in rules_apply_block()'s
+ * keys, truncated to key_size - 1 characters.  The words are short, so this is
+ * cheaper than a call to strnzcpy() or memcpy().
+ */
+static MAYBE_INLINE void rules_block_key(char *key, const char *word,
+	int length, int key_size)
+{
+	int pos;
+
+	if (length >= key_size)
+		length = key_size - 1;
+	if (length < BLOCK_CHUNK && key_size >= BLOCK_CHUNK) {
+		memcpy(key, word, BLOCK_CHUNK);
+		key[length] = 0;
+		return;
+	}
+	for (pos = 0; pos < length; pos++)
+		key[pos] = word[pos];
+	key[length] = 0;
+}
+
+void rules_apply_block(const struct rules_prog *prog, char **words,
+	int count, char *keys, int key_size, char *ok)
+{
+	char *in[RULES_BLOCK_WORDS], *alt[RULES_BLOCK_WORDS];
+	char *memory[RULES_BLOCK_WORDS];
+	int length[RULES_BLOCK_WORDS], initial[RULES_BLOCK_WORDS];
+	unsigned char alive[RULES_BLOCK_WORDS];
+	const struct rules_op *op, *end;
+	char *last;
+	int i, n, alive_count, too_long, last_length;
+
+/*
+ * Rules with commands that leave state for later ones or without any command
+ * rules_block_op() has a shortcut for, and words that need converting from
+ * UTF-8 first, are done one word at a time.
+ */
+	for (op = prog->op; op->cmd && !rules_block_has_op(op); op++);
+	if (!prog->block || (!op->cmd && !prog->empty) ||
+	    (!(options.flags & FLG_SINGLE_CHK) && options.internal_cp != UTF_8 &&
+	    options.internal_cp != ENC_RAW && options.target_enc == UTF_8)) {
+		last = NULL;
+		for (i = 0; i < count; i++) {
+			char *word;
+
+			ok[i] = 0;
+			if (words[i] && (word =
+			    rules_apply_compiled(words[i], prog, last))) {
+				rules_block_key(&keys[i * key_size], word,
+				    strlen(word), key_size);
+				ok[i] = 1;
+				last = word;
+			}
+		}
+		return;
+	}
+
+	if (rules_stacked_after != length_initiated_as)
+		rules_init_stacked_vars();
+
+	if (!block_buffer)
+		block_buffer = mem_alloc_align(RULES_BLOCK_WORDS *
+		    sizeof(*block_buffer), MEM_ALIGN_CACHE);
+
+	alive_count = too_long = 0;
+	for (i = 0; i < count; i++) {
+		char *word = words[i];
+		int len;
+
+		ok[i] = 0;
+		if (!word)
+			continue;
+
+		in[i] = block_buffer[i][0];
+		alt[i] = block_buffer[i][1];
+		memory[i] = word;
+		for (len = 0; len < RULE_WORD_SIZE; len++)
+			if (!(block_buffer[i][0][len] = word[len]))
+				break;
+		if (!len && !prog->hc_logic && !prog->empty)
+			continue;
+		length[i] = initial[i] = len;
+		too_long |= len >= RULE_WORD_SIZE;
+		alive[alive_count++] = i;
+	}
+
+/*
+ * Commands with a shortcut are applied to the whole block at once.  Runs of
+ * other commands are applied one word at a time, like rules_apply_compiled()
+ * does, which keeps each word's buffers and branch history hot.
+ */
+	if (!prog->empty)
+	for (op = prog->op; op->cmd && alive_count; op = end) {
+		if (too_long)
+		for (i = too_long = 0; i < alive_count; i++) {
+			n = alive[i];
+			if (length[n] >= RULE_WORD_SIZE)
+				in[n][length[n] = RULE_WORD_SIZE - 1] = 0;
+		}
+
+		if (rules_block_has_op(op)) {
+			rules_block_op(op, in, length, alive, alive_count);
+			end = op + 1;
+			continue;
+		}
+
+		for (end = op + 1; end->cmd && !rules_block_has_op(end); end++);
+
+		for (i = n = 0; i < alive_count; i++) {
+			const struct rules_op *cur;
+			int k = alive[i], result = 1;
+			char *word_in = in[k], *word_alt = alt[k];
+			char *word_memory = memory[k];
+			int word_length = length[k];
+
+			rules_vars['l'] = initial[k];
+			rules_vars['m'] = (unsigned char)initial[k] - 1;
+			for (cur = op; cur < end; cur++) {
+				if (word_length >= RULE_WORD_SIZE)
+					word_in[word_length =
+					    RULE_WORD_SIZE - 1] = 0;
+				if ((result = rules_run_op(cur, &word_in,
+				    &word_alt, &word_length,
+				    &word_memory)) <= 0)
+					break;
+				if (!word_length && !prog->hc_logic) {
+					result = 0;
+					break;
+				}
+			}
+			if (result <= 0) {
+				if (result < 0)
+					rules_errno = RULES_ERROR_POSITION;
+				continue;
+			}
+			in[k] = word_in;
+			alt[k] = word_alt;
+			memory[k] = word_memory;
+			length[k] = word_length;
+			too_long |= word_length >= RULE_WORD_SIZE;
+			alive[n++] = k;
+		}
+		alive_count = n;
+	}
+
+	last = NULL;
+	last_length = 0;
+	for (i = 0; i < alive_count; i++) {
+		char *word;
+		int len;
+
+		n = alive[i];
+		if (!(word = rules_out(in[n], length[n], NULL)))
+			continue;
+		len = length[n] < STACK_MAXLEN ? length[n] : STACK_MAXLEN;
+		if (last && len == last_length && !memcmp(word, last, len))
+			continue;
+		rules_block_key(&keys[n * key_size], word, len, key_size);
+		ok[n] = 1;
+		last = word;
+		last_length = len;
+	}
+}
+
+/*
+ * Rule optimizer.  Rules are compared by what their compiled programs do
+ * rather than by their text, after these are broken down to one command per
+ * entry ("$a$b" is the same as "$a $b") and commands that can't make a
+ * difference are dropped or merged.  Case conversions are only merged if
+ * they're plain ASCII, as otherwise e.g. "lu" could differ from "u".
+ */
+#define OPT_CASE_ALL(cmd) \
+	((cmd) == 'l' || (cmd) == 'u' || (cmd) == 'c' || (cmd) == 'C' || \
+	(cmd) == 'E')
+#define OPT_CASE(op) \
+	(OPT_CASE_ALL((op)->cmd) || (op)->cmd == 't' || \
+	((op)->cmd == 'T' && !(op)->var[0]))
+
+/*
+ * Breaks prog down to one command per entry of unit[], returning how many.
+ * Each of these takes at least one character of the rule, so unit[] needs
+ * no more than RULE_BUFFER_SIZE entries.
+ */
+static int rules_opt_units(const struct rules_prog *prog,
+	struct rules_op *unit)
+{
+	const struct rules_op *op;
+	int count = 0;
+
+	for (op = prog->op; op->cmd; op++)
+	switch (op->cmd) {
+	case '$':
+	case '^':
+	case '[':
+	case ']':
+	case '{':
+	case '}':
+		{
+			int i;
+
+			for (i = 0; i < op->count; i++) {
+				struct rules_op *cur = &unit[count++];
+
+				*cur = *op;
+				cur->count = 1;
+				memset(cur->value, 0, sizeof(cur->value));
+/* Prefixes are kept in the order they end up in, so undo that */
+				if (op->cmd == '^')
+					cur->value[0] =
+					    op->value[op->count - 1 - i];
+				else if (op->cmd == '$')
+					cur->value[0] = op->value[i];
+			}
+		}
+		break;
+
+	default:
+		unit[count++] = *op;
+	}
+
+	return count;
+}
+
+/*
+ * Drops and merges commands that don't make a difference.  Returns the new
+ * number of entries in unit[].
+ */
+static int rules_opt_simplify(struct rules_op *unit, int count)
+{
+	static const char lucC[] = "lucC";
+	int ascii = conv_ascii_lower && conv_ascii_upper && conv_ascii_invert;
+	int i;
+
+	for (i = 1; i < count; i++) {
+		struct rules_op *prev = &unit[i - 1], *op = &unit[i];
+		char *conv;
+		int first, drop;
+
+		if (ascii && OPT_CASE(prev) && OPT_CASE_ALL(op->cmd)) {
+/* A conversion that sets the case of every letter hides the ones before it */
+			first = i - 1; drop = 1;
+		} else
+		if (ascii && (conv = strchr(lucC, prev->cmd)) &&
+		    (op->cmd == 't' ||
+		    (op->cmd == 'T' && !op->var[0] && !op->pos[0]))) {
+/* "lt" is "u", "lT0" is "c", and so on */
+			prev->cmd = (op->cmd == 't' ? "ulCc" : "cClu")
+			    [conv - lucC];
+			first = i; drop = 1;
+		} else
+		if (op->cmd == prev->cmd &&
+		    (((op->cmd == 't' || op->cmd == 'T') && ascii) ||
+		    op->cmd == 'r' || op->cmd == 'k' || op->cmd == 'K') &&
+		    (op->cmd != 'T' ||
+		    (!op->var[0] && !prev->var[0] &&
+		    op->pos[0] == prev->pos[0]))) {
+/* These undo themselves */
+			first = i - 1; drop = 2;
+		} else
+		if ((op->cmd == '{' && prev->cmd == '}') ||
+		    (op->cmd == '}' && prev->cmd == '{')) {
+			first = i - 1; drop = 2;
+		} else
+			continue;
+
+		memmove(&unit[first], &unit[first + drop],
+		    (count - first - drop) * sizeof(*unit));
+		count -= drop;
+		i = first > 0 ? first - 1 : 0;
+	}
+
+	return count;
+}
+
+/*
+ * Returns zero if the commands in unit[] can never leave a word whose length
+ * rules_out() accepts, based on the bounds of the length after each command.
+ */
+static int rules_opt_length(const struct rules_op *unit, int count, int hc)
+{
+	int lo = hc ? 0 : 1, hi = RULE_WORD_SIZE;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		const struct rules_op *op = &unit[i];
+		int pos = op->var[0] ? -1 : op->pos[0];
+
+/* The word is truncated before each command */
+		if (hi > RULE_WORD_SIZE - 1)
+			hi = RULE_WORD_SIZE - 1;
+		if (lo > hi)
+			lo = hi;
+
+		switch (op->cmd) {
+		case '<':
+			if (pos >= 0 && hi >= pos)
+				hi = pos - 1;
+			break;
+
+		case '>':
+			if (pos >= 0 && lo <= pos)
+				lo = pos + 1;
+			break;
+
+		case '_':
+			if (pos >= 0) {
+				if (lo < pos)
+					lo = pos;
+				if (hi > pos)
+					hi = pos;
+			}
+			break;
+
+		case '\'':
+			if (pos >= 0) {
+				if (hi > pos)
+					hi = pos;
+				if (lo > pos)
+					lo = pos;
+			} else
+				lo = 0;
+			break;
+
+/* Same length */
+		case 'l': case 'u': case 'c': case 'C': case 't': case 'T':
+		case 'E': case 'e': case 'S': case 'V': case 'R': case 'L':
+		case 'W': case 'r': case 'k': case 'K': case '{': case '}':
+		case 's': case 'o': case '+': case '-': case '.': case ',':
+		case '*': case '!': case '/': case '(': case ')': case '=':
+		case '%': case 'M': case 'Q': case 'v': case 'U': case 'a':
+		case 'b':
+			break;
+
+		case '$':
+		case '^':
+			lo++; hi++;
+			break;
+
+/* Truncated to RULE_WORD_SIZE - 1 here */
+		case 'A':
+			if ((lo += op->count) > RULE_WORD_SIZE - 1)
+				lo = RULE_WORD_SIZE - 1;
+			if ((hi += op->count) > RULE_WORD_SIZE - 1)
+				hi = RULE_WORD_SIZE - 1;
+			break;
+
+		case 'i':
+			if (!op->count)
+				lo++;
+			hi++;
+			break;
+
+		case 'd':
+		case 'f':
+		case 'q':
+			lo <<= 1; hi <<= 1;
+			break;
+
+		case '[':
+		case ']':
+		case 'D':
+			if (lo)
+				lo--;
+			if (op->cmd != 'D' && hi)
+				hi--;
+			break;
+
+		case 'x':
+			lo = 0;
+			if (!op->count && !op->var[1] && hi > op->pos[1])
+				hi = op->pos[1];
+			break;
+
+		case 'O':
+		case '@':
+			lo = 0;
+			break;
+
+/* Only ever longer */
+		case 'y': case 'Y': case 'z': case 'Z': case 'p': case 'P':
+		case 'I': case 'X': case '4': case '6':
+			hi = RULE_WORD_SIZE * 2;
+			break;
+
+		default:
+			lo = 0; hi = RULE_WORD_SIZE * 2;
+		}
+
+		if (lo > hi || (!hc && !hi))
+			return 0;
+		if (!hc && !lo)
+			lo = 1;
+	}
+
+	if (min_length && hi < min_length)
+		return 0;
+	if (skip_length && lo > skip_length)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Writes a key for the commands in unit[] to key, returning its length.
+ * Rules with the same key produce the same candidates.
+ */
+static int rules_opt_key(const struct rules_prog *prog,
+	const struct rules_op *unit, int count, unsigned char *key)
+{
+	unsigned char *p = key;
+	int i;
+
+/* An empty rule doesn't reject empty words, unlike e.g. "rr" */
+	*p++ = 1 + prog->hc_logic + 2 * prog->empty;
+	for (i = 0; i < count; i++) {
+		const struct rules_op *op = &unit[i];
+		int c = 0;
+
+		if (op->class)
+			while (c < 0x100 && rules_classes[c] != op->class)
+				c++;
+
+		*p++ = op->cmd;
+		*p++ = op->count;
+		*p++ = op->count >> 8;
+		memcpy(p, op->pos, 3); p += 3;
+		memcpy(p, op->var, 3); p += 3;
+		memcpy(p, op->value, 3); p += 3;
+		*p++ = c;
+		if (op->string) {
+			memcpy(p, op->string, op->count);
+			p += op->count;
+		}
+	}
+
+	return p - key;
+}
+
+/* A rule kept by rules_optimize(), with its key in a shared buffer */
+struct rules_opt_entry {
+	size_t offset;
+	int length;
+	int number;
+};
+
+int rules_optimize(struct rpp_context *start, struct db_main *db,
+	int count, int *same)
+{
+	struct rpp_context ctx;
+	struct rules_prog *prog;
+	struct rules_op *unit;
+	struct rules_opt_entry *entries;
+	unsigned char *keys, *key;
+	size_t keys_size, keys_used;
+	int *table;
+	unsigned int table_mask;
+	int saved_hc_logic, saved_real_run, check_length;
+	int number, entry_count, dupes, useless;
+	char *rule;
+
+	memset(same, 0, count * sizeof(*same));
+
+	table_mask = 0xff;
+	while (table_mask < 2U * count)
+		table_mask = (table_mask << 1) | 1;
+	table = mem_alloc((table_mask + 1) * sizeof(*table));
+	memset(table, 0xff, (table_mask + 1) * sizeof(*table));
+	entries = mem_alloc(count * sizeof(*entries));
+	keys = mem_alloc(keys_size = 0x10000);
+	keys_used = 0;
+	key = mem_alloc(RULE_BUFFER_SIZE * (sizeof(struct rules_op) + 1));
+	unit = mem_alloc(RULE_BUFFER_SIZE * sizeof(*unit));
+	prog = mem_alloc(sizeof(*prog));
+
+/* Same checks as in rules_out() */
+	check_length = !rules_stacked_after;
+
+	saved_hc_logic = hc_logic;
+	saved_real_run = rpp_real_run;
+	rpp_real_run = 0;
+
+	memcpy(&ctx, start, sizeof(ctx));
+	number = entry_count = dupes = useless = 0;
+	while (number < count && (rule = rpp_next(&ctx))) {
+		char *accepted;
+		int length, units, i;
+		unsigned int hash;
+
+		number++;
+		if (!(accepted = rules_reject(rule, -1, NULL, db)))
+			continue;
+
+		if (rules_compile(accepted, prog)) {
+			units = rules_opt_units(prog, unit);
+			units = rules_opt_simplify(unit, units);
+			if (check_length &&
+			    !rules_opt_length(unit, units, prog->hc_logic)) {
+				same[number - 1] = -1;
+				useless++;
+				continue;
+			}
+			length = rules_opt_key(prog, unit, units, key);
+		} else {
+/* Only the exact same (accepted part of the) rule for these */
+			key[0] = 0;
+			strcpy((char *)key + 1, accepted);
+			length = strlen(accepted) + 1;
+		}
+
+		hash = 0;
+		for (i = 0; i < length; i++)
+			hash = hash * 31 + key[i];
+		hash &= table_mask;
+
+		while (table[hash] >= 0) {
+			struct rules_opt_entry *entry = &entries[table[hash]];
+
+			if (entry->length == length &&
+			    !memcmp(keys + entry->offset, key, length))
+				break;
+			hash = (hash + 1) & table_mask;
+		}
+
+		if (table[hash] >= 0) {
+			same[number - 1] = entries[table[hash]].number;
+			dupes++;
+			continue;
+		}
+
+		if (keys_used + length > keys_size)
+			keys = mem_realloc(keys,
+			    keys_size = (keys_size + length) * 2);
+		memcpy(keys + keys_used, key, length);
+		entries[entry_count].offset = keys_used;
+		entries[entry_count].length = length;
+		entries[entry_count].number = number;
+		table[hash] = entry_count++;
+		keys_used += length;
+	}
+
+	hc_logic = saved_hc_logic;
+	rpp_real_run = saved_real_run;
+	rules_errno = RULES_ERROR_NONE;
+
+	MEM_FREE(prog);
+	MEM_FREE(unit);
+	MEM_FREE(key);
+	MEM_FREE(keys);
+	MEM_FREE(entries);
+	MEM_FREE(table);
+
+	if (dupes || useless)
+		log_event("- %d rules do the same as an earlier one and %d "
+		          "can't produce a candidate of acceptable length, "
+		          "saving %d passes", dupes, useless, dupes + useless);
+
+	return dupes + useless;
+}
+
 /*
  * Advance stacked rules. We iterate main rules first and only then we
  * advance the stacked rules (and rewind the main rules). Repeat until
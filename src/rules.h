@@ -51,6 +51,16 @@ typedef struct {
  */
 extern void rules_init(struct db_main *db, int max_length);
 
+#ifdef _OPENMP
+/*
+ * Copies the rules engine state set up by rules_init() to the calling OpenMP
+ * thread, after which that thread may call rules_apply() concurrently with
+ * others.  Must be called at the start of each parallel region that applies
+ * rules, and is a no-op for the main thread.  Stacked rules are not supported.
+ */
+extern void rules_init_thread(void);
+#endif
+
 /*
  * Processes rule reject flags, based on information from the database.
  * Returns a pointer to the first command in the rule if it's accepted,
@@ -81,6 +91,83 @@ extern char *rules_reject(char *rule, int split, char *last,
  */
 extern char *rules_apply(char *word, char *rule, int split, char *last);
 
+/*
+ * A rule pre-decoded by rules_compile(): one entry per command, with the
+ * positions that are constant resolved to numbers, character classes resolved
+ * to their lookup tables, and runs of commands that rules_apply() handles as
+ * one (such as "$a$b" or "[[") merged.
+ */
+struct rules_op {
+	char cmd;		/* rule command, or 0 at the end */
+	unsigned short count;	/* repeat count, or number of characters */
+	unsigned char pos[3];	/* positions known at compile time */
+	char var[3];		/* position variables, or 0 if in pos[] */
+	char value[3];		/* characters, or literal class character */
+	const char *class;	/* character class, or NULL for value[0] */
+	const char *string;	/* string for the 'A' command */
+};
+
+struct rules_prog {
+	int empty;		/* the rule is a no-op */
+	int hc_logic;		/* compiled in hashcat mode */
+	int block;		/* no per-word state for later commands */
+	struct rules_op op[RULE_BUFFER_SIZE];
+	char strings[RULE_BUFFER_SIZE];
+};
+
+/*
+ * Compiles a rule returned by rules_reject() (with split < 0) into prog.
+ * Returns zero if the rule can't be compiled (it has "single crack" mode
+ * commands, or an error), in which case rules_apply() should be used instead.
+ */
+extern int rules_compile(char *rule, struct rules_prog *prog);
+
+/*
+ * Same as rules_apply(word, rule, -1, last) for the rule prog was compiled
+ * from, without decoding the rule again.  prog is not modified, so it may be
+ * shared by threads (see rules_init_thread()).
+ */
+extern char *rules_apply_compiled(char *word, const struct rules_prog *prog,
+	char *last);
+
+/*
+ * Returns a copy of prog, allocated with mem_alloc() and just as large as its
+ * commands need (a struct rules_prog is mostly unused space).  The copy may
+ * be passed to rules_apply_compiled(), but not to rules_compile().
+ */
+extern struct rules_prog *rules_prog_dup(const struct rules_prog *prog);
+
+/*
+ * Maximum number of words rules_apply_block() takes at once.
+ */
+#define RULES_BLOCK_WORDS		64
+
+/*
+ * Applies prog to up to RULES_BLOCK_WORDS words at once.  Case conversions
+ * and character substitutions are done across the whole block with
+ * fixed-length loops the compiler vectorizes, other commands one word at a
+ * time.  words[i] may be NULL to skip it.  The candidate for words[i] is
+ * copied to keys + i * key_size (truncated to key_size - 1 characters) and
+ * ok[i] is set if there is one, unless it's the same as the previous
+ * candidate in the block.  Comparing the block's first candidate against
+ * what came before is up to the caller.  Like rules_apply_compiled(), this
+ * may be called from several threads at once.
+ */
+extern void rules_apply_block(const struct rules_prog *prog, char **words,
+	int count, char *keys, int key_size, char *ok);
+
+/*
+ * Goes through the count rules of context start the way wordlist mode will,
+ * and finds the ones that are no use: those that do the same as an earlier
+ * rule once compiled and simplified (such as "c", "c:" and "lT0"), and those
+ * that can never produce a candidate of a length --min-length and
+ * --max-length allow.  same[n] (for rule n + 1) is set to the
+ * number of the earlier rule, to -1 for a rule of the latter kind, or to 0.
+ * Returns the number of rules that may be skipped, and logs it.
+ */
+extern int rules_optimize(struct rpp_context *start, struct db_main *db,
+	int count, int *same);
+
 /*
  * Similar to rules_check(), but displays a message and does not return on
  * error.  Also performs 'dupe' rule removal, and lists if any rules were removed.
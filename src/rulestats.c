@@ -0,0 +1,352 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 700 /* for fdopen(3) and ftruncate(2) */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "arch.h"
+#include "jumbo.h"
+#include "misc.h"
+#include "params.h"
+#include "memory.h"
+#include "path.h"
+#include "config.h"
+#include "logger.h"
+#include "john.h"
+#include "rulestats.h"
+
+#define SECTION_SUFFIX			"-ranked"
+#define HC_LOGIC_ON			"!! hashcat logic ON"
+#define HC_LOGIC_OFF			"!! hashcat logic OFF"
+
+struct rule_stat {
+	char *rule;		/* as written to the file */
+	int hc_logic;
+	int order;		/* for a stable sort */
+	uint64_t guesses, cands, nsec;
+};
+
+static struct rule_stat *stats;
+static int stats_count;
+static char *file_name, *section;
+
+/*
+ * Escapes a preprocessed rule so that the preprocessor and the config file
+ * parser give it back unchanged.  Hashcat mode rules bypass the preprocessor
+ * and are written as they are.
+ */
+static char *escape(const char *rule, int hc_logic)
+{
+	char *out = mem_alloc(strlen(rule) * 4 + 1), *p = out;
+	const unsigned char *s = (const unsigned char *)rule;
+
+	if (hc_logic)
+		return strcpy(out, rule);
+
+	while (*s) {
+		if (*s == '\\' || *s == '[') {
+			*p++ = '\\';
+			*p++ = *s;
+		} else if (*s < ' ' || *s == 0x7f ||
+		    (s == (const unsigned char *)rule && strchr("#;.", *s)) ||
+		    (*s == ' ' && !s[1])) {
+			p += sprintf(p, "\\x%02x", *s);
+		} else
+			*p++ = *s;
+		s++;
+	}
+	*p = 0;
+
+	return out;
+}
+
+void rulestats_init(const char *rules, struct rpp_context *start, int count)
+{
+	extern int hc_logic;
+	struct rpp_context ctx;
+	int saved_hc_logic = hc_logic, number;
+	const char *name;
+	char *prerule, *p;
+	size_t len;
+
+	if (stats)
+		return;
+
+	if (!(name = cfg_get_param(SECTION_OPTIONS, NULL, "PerRuleStatsFile")) ||
+	    !*name)
+		return;
+
+	if (*rules == ':') {
+		log_event("- Not saving statistics for command line rules");
+		return;
+	}
+
+	file_name = str_alloc_copy(path_expand(name));
+
+/* Rank "Jumbo" in "Jumbo-ranked", and keep ranking that one in place */
+	len = strlen(rules);
+	section = mem_alloc(len + sizeof(SECTION_SUFFIX));
+	strcpy(section, rules);
+	if (len < sizeof(SECTION_SUFFIX) - 1 ||
+	    strcasecmp(section + len - (sizeof(SECTION_SUFFIX) - 1),
+	    SECTION_SUFFIX))
+		strcat(section, SECTION_SUFFIX);
+	for (p = section; *p; p++)
+		if (*p == ',' || *p == ']')
+			*p = '_';
+
+	stats_count = count;
+	stats = mem_calloc(count, sizeof(*stats));
+
+	memcpy(&ctx, start, sizeof(ctx));
+	for (number = 0; number < count && (prerule = rpp_next(&ctx));
+	    number++) {
+		if (!strcmp(prerule, HC_LOGIC_ON))
+			hc_logic = 1;
+		else if (!strcmp(prerule, HC_LOGIC_OFF))
+			hc_logic = 0;
+		if (!strncmp(prerule, "!!", 2))
+			continue;
+		stats[number].rule = escape(prerule, hc_logic);
+		stats[number].hc_logic = hc_logic;
+		stats[number].order = number;
+	}
+
+	hc_logic = saved_hc_logic;
+}
+
+void rulestats_add(int number, unsigned int guesses, uint64_t cands,
+                   uint64_t nsec)
+{
+	struct rule_stat *rs;
+
+	if (!stats || number < 0 || number >= stats_count ||
+	    !(rs = &stats[number])->rule)
+		return;
+
+	rs->guesses += guesses;
+	rs->cands += cands;
+	rs->nsec += nsec;
+}
+
+static int cmp_rule(const void *a, const void *b)
+{
+	const struct rule_stat *x = a, *y = b;
+	int c;
+
+	if (x->hc_logic != y->hc_logic)
+		return x->hc_logic - y->hc_logic;
+	if ((c = strcmp(x->rule, y->rule)))
+		return c;
+	return x->order - y->order;
+}
+
+/*
+ * Most guesses per second first, then most guesses per candidate, then as
+ * the rules were.  Rules that never ran go last.
+ */
+static int cmp_rank(const void *a, const void *b)
+{
+	const struct rule_stat *x = a, *y = b;
+	double rx, ry;
+
+	if (!x->cands != !y->cands)
+		return !x->cands - !y->cands;
+
+	rx = x->nsec ? (double)x->guesses / x->nsec : 0;
+	ry = y->nsec ? (double)y->guesses / y->nsec : 0;
+	if (rx != ry)
+		return rx < ry ? 1 : -1;
+
+	rx = x->cands ? (double)x->guesses / x->cands : 0;
+	ry = y->cands ? (double)y->guesses / y->cands : 0;
+	if (rx != ry)
+		return rx < ry ? 1 : -1;
+
+	return x->order - y->order;
+}
+
+static void save(void)
+{
+	struct rule_stat *all;
+	char **lines = NULL, line[LINE_BUFFER_SIZE], header[LINE_BUFFER_SIZE];
+	int nlines = 0, alloc = 0, sect_at = -1, in_section = 0;
+	int hc_mode = 0, hc_section = 0, have_stats = 0, i, n, count;
+	uint64_t guesses = 0, cands = 0;
+	double seconds = 0;
+	FILE *file = NULL;
+	int fd;
+
+	all = mem_alloc(stats_count * sizeof(*all));
+	for (i = n = 0; i < stats_count; i++)
+		if (stats[i].rule)
+			all[n++] = stats[i];
+	count = n;
+
+	if ((fd = open(file_name, O_RDWR | O_CREAT, 0600)) < 0 ||
+	    !(file = fdopen(fd, "r+"))) {
+		log_event("! Could not open %.100s: %s",
+		          file_name, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		MEM_FREE(all);
+		return;
+	}
+	jtr_lock(fd, F_SETLKW, F_WRLCK, file_name);
+
+	snprintf(header, sizeof(header), "[List.Rules:%s]", section);
+
+/*
+ * Keep everything but our section as it is, and pick up the statistics in
+ * our section, which are then merged with this session's.
+ */
+	while (fgetl(line, sizeof(line), file)) {
+		char *l = rtrim(ltrim(line));
+
+		if (!strcmp(l, HC_LOGIC_ON))
+			hc_mode = 1;
+		else if (!strcmp(l, HC_LOGIC_OFF))
+			hc_mode = 0;
+
+		if (*l == '[' && !hc_mode) {
+			in_section = !strcasecmp(l, header);
+			if (in_section) {
+				sect_at = nlines;
+				hc_section = have_stats = 0;
+				continue;
+			}
+		}
+
+		if (!in_section) {
+			if (nlines >= alloc) {
+				alloc = alloc ? alloc * 2 : 256;
+				lines = mem_realloc(lines,
+				                    alloc * sizeof(*lines));
+			}
+			lines[nlines++] = xstrdup(line);
+			continue;
+		}
+
+		if (!strcmp(l, HC_LOGIC_ON) || !strcmp(l, HC_LOGIC_OFF)) {
+			hc_section = hc_mode;
+			continue;
+		}
+		if (*l == '#') {
+			have_stats = sscanf(l, "# %" SCNu64 " guesses, %" SCNu64
+			                    " candidates, %lf s",
+			                    &guesses, &cands, &seconds) == 3;
+			continue;
+		}
+		if (!*l || *l == ';')
+			continue;
+
+		all = mem_realloc(all, (n + 1) * sizeof(*all));
+		all[n].rule = xstrdup(l);
+		all[n].hc_logic = hc_section;
+		all[n].order = stats_count + n;
+		all[n].guesses = have_stats ? guesses : 0;
+		all[n].cands = have_stats ? cands : 0;
+		all[n].nsec = have_stats ? seconds * 1e9 : 0;
+		have_stats = 0;
+		n++;
+	}
+	if (ferror(file))
+		log_event("! Error reading %.100s: %s",
+		          file_name, strerror(errno));
+
+	if (sect_at < 0) {
+		if (!nlines) {
+			lines = mem_alloc(sizeof(*lines));
+			lines[nlines++] = xstrdup(
+"# Per-rule statistics from wordlist mode (see PerRuleStats in john.conf)");
+		}
+		sect_at = nlines;
+	}
+
+/* Sum up the statistics for each rule */
+	qsort(all, n, sizeof(*all), cmp_rule);
+	for (i = 0, count = 0; i < n; i++) {
+		if (count && all[count - 1].hc_logic == all[i].hc_logic &&
+		    !strcmp(all[count - 1].rule, all[i].rule)) {
+			all[count - 1].guesses += all[i].guesses;
+			all[count - 1].cands += all[i].cands;
+			all[count - 1].nsec += all[i].nsec;
+			if (all[i].order >= stats_count)
+				MEM_FREE(all[i].rule);
+			continue;
+		}
+		all[count++] = all[i];
+	}
+	qsort(all, count, sizeof(*all), cmp_rank);
+
+	rewind(file);
+	for (i = 0; i < sect_at; i++)
+		fprintf(file, "%s\n", lines[i]);
+
+	fprintf(file, "%s%s\n", sect_at && *lines[sect_at - 1] ? "\n" : "",
+	        header);
+	hc_mode = 0;
+	for (i = 0; i < count; i++) {
+		if (all[i].hc_logic != hc_mode) {
+			hc_mode = all[i].hc_logic;
+			fprintf(file, "%s\n", hc_mode ? HC_LOGIC_ON : HC_LOGIC_OFF);
+		}
+		fprintf(file, "# %" PRIu64 " guesses, %" PRIu64 " candidates, "
+		        "%.3f s\n%s\n", all[i].guesses, all[i].cands,
+		        all[i].nsec / 1e9, all[i].rule);
+		if (all[i].order >= stats_count)
+			MEM_FREE(all[i].rule);
+	}
+	if (hc_mode)
+		fprintf(file, "%s\n", HC_LOGIC_OFF);
+
+	for (i = sect_at; i < nlines; i++)
+		fprintf(file, "%s%s\n", i == sect_at && *lines[i] ? "\n" : "",
+		        lines[i]);
+
+	if (fflush(file) || ftruncate(fd, ftell(file)))
+		log_event("! Could not write %.100s: %s",
+		          file_name, strerror(errno));
+	else
+		log_event("- Saved statistics for %d rules to %.100s [%.100s]",
+		          count, file_name, section);
+
+	jtr_lock(fd, F_SETLK, F_UNLCK, file_name);
+	fclose(file);
+
+	for (i = 0; i < nlines; i++)
+		MEM_FREE(lines[i]);
+	MEM_FREE(lines);
+	MEM_FREE(all);
+}
+
+void rulestats_done(void)
+{
+	int i;
+
+	if (!stats)
+		return;
+
+	save();
+
+	for (i = 0; i < stats_count; i++)
+		MEM_FREE(stats[i].rule);
+	MEM_FREE(stats);
+	MEM_FREE(section);
+	stats_count = 0;
+}
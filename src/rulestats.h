@@ -0,0 +1,40 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ */
+
+/*
+ * Per-rule statistics for wordlist mode (PerRuleStats), accumulated over
+ * sessions in a rule file (PerRuleStatsFile) with the rules ranked by yield.
+ */
+
+#ifndef _JOHN_RULESTATS_H
+#define _JOHN_RULESTATS_H
+
+#include <stdint.h>
+
+#include "rpp.h"
+
+/*
+ * Starts collecting statistics for the count rules of context start, which
+ * was set up from the rules section(s) named rules.  Does nothing if there's
+ * no PerRuleStatsFile or if the rules came from the command line.
+ */
+extern void rulestats_init(const char *rules, struct rpp_context *start,
+                           int count);
+
+/*
+ * Adds the results of running rule number (as counted by rpp_next()) over
+ * some or all of the words.
+ */
+extern void rulestats_add(int number, unsigned int guesses, uint64_t cands,
+                          uint64_t nsec);
+
+/*
+ * Merges what was collected into PerRuleStatsFile and frees it all.
+ */
+extern void rulestats_done(void);
+
+#endif
@@ -899,7 +899,7 @@ struct fmt_main fmt_cryptsha256 = {
 		SALT_ALIGN,
 		MIN_KEYS_PER_CRYPT,
 		MAX_KEYS_PER_CRYPT,
-		FMT_CASE | FMT_8_BIT | FMT_OMP,
+		FMT_CASE | FMT_8_BIT | FMT_OMP | FMT_FLAT_SALT,
 		{
 			"iteration count",
 		},
@@ -79,6 +79,12 @@
  * WARNING, SHA224 requires a FULL SHA256 width output buffer, and SHA384
  * requires a full SHA512 width output buffer.  This is to allow proper
  * reloading and doing multi-limb crypts.
+ *
+ * SSEi_EARLY_STEPS(n)
+ * MD4 and MD5 only. Stop after n (1..15) steps of the last round and write
+ * the state as it is then, with no final addition. This is for formats
+ * comparing against hashes with the remaining steps reversed ("meet in the
+ * middle"). Only valid if not doing reload.
  */
 
 typedef enum {
@@ -102,5 +108,8 @@ typedef enum {
 	SSEi_OUTPUT_AS_2BUF_INP_FMT  = 0x2000 | SSEi_OUTPUT_AS_INP_FMT
 } SSEi_FLAGS;
 
+#define SSEi_EARLY_STEPS(n)          ((n) << 16)
+#define SSEi_EARLY_STEPS_MASK        SSEi_EARLY_STEPS(0xf)
+
 
 #endif /* __SSE_INTRINS_LOAD_FLAGS__  */
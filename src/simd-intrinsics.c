@@ -276,6 +276,51 @@ void SIMDmd5body(vtype* _data, unsigned int *out,
 	MD5_STEP_r16(MD5_H, c, d, a, b, 15, 0x1fa27cf8, 16)
 	MD5_STEP(MD5_H2, b, c, d, a, 2, 0xc4ac5665, 23)
 
+	if (SSEi_flags & SSEi_EARLY_STEPS_MASK)
+	{
+		const unsigned int early =
+			(SSEi_flags & SSEi_EARLY_STEPS_MASK) >> 16;
+
+		MD5_STEP(MD5_I, a, b, c, d, 0, 0xf4292244, 6)
+		if (early == 1) goto md5_early;
+		MD5_STEP(MD5_I, d, a, b, c, 7, 0x432aff97, 10)
+		if (early == 2) goto md5_early;
+		MD5_STEP(MD5_I, c, d, a, b, 14, 0xab9423a7, 15)
+		if (early == 3) goto md5_early;
+		MD5_STEP(MD5_I, b, c, d, a, 5, 0xfc93a039, 21)
+		if (early == 4) goto md5_early;
+		MD5_STEP(MD5_I, a, b, c, d, 12, 0x655b59c3, 6)
+		if (early == 5) goto md5_early;
+		MD5_STEP(MD5_I, d, a, b, c, 3, 0x8f0ccc92, 10)
+		if (early == 6) goto md5_early;
+		MD5_STEP(MD5_I, c, d, a, b, 10, 0xffeff47d, 15)
+		if (early == 7) goto md5_early;
+		MD5_STEP(MD5_I, b, c, d, a, 1, 0x85845dd1, 21)
+		if (early == 8) goto md5_early;
+		MD5_STEP(MD5_I, a, b, c, d, 8, 0x6fa87e4f, 6)
+		if (early == 9) goto md5_early;
+		MD5_STEP(MD5_I, d, a, b, c, 15, 0xfe2ce6e0, 10)
+		if (early == 10) goto md5_early;
+		MD5_STEP(MD5_I, c, d, a, b, 6, 0xa3014314, 15)
+		if (early == 11) goto md5_early;
+		MD5_STEP(MD5_I, b, c, d, a, 13, 0x4e0811a1, 21)
+		if (early == 12) goto md5_early;
+		MD5_STEP(MD5_I, a, b, c, d, 4, 0xf7537e82, 6)
+		if (early == 13) goto md5_early;
+		MD5_STEP(MD5_I, d, a, b, c, 11, 0xbd3af235, 10)
+		if (early == 14) goto md5_early;
+		MD5_STEP(MD5_I, c, d, a, b, 2, 0x2ad7d2bb, 15)
+md5_early:
+		MD5_PARA_DO(i)
+		{
+			vstore((vtype*)&out[i*4*VS32+0*VS32], a[i]);
+			vstore((vtype*)&out[i*4*VS32+1*VS32], b[i]);
+			vstore((vtype*)&out[i*4*VS32+2*VS32], c[i]);
+			vstore((vtype*)&out[i*4*VS32+3*VS32], d[i]);
+		}
+		return;
+	}
+
 /* Round 4 */
 	MD5_STEP(MD5_I, a, b, c, d, 0, 0xf4292244, 6)
 	MD5_STEP(MD5_I, d, a, b, c, 7, 0x432aff97, 10)
@@ -923,6 +968,52 @@ void SIMDmd4body(vtype* _data, unsigned int *out, uint32_t *reload_state,
 
 /* Round 3 */
 	cst = vset1_epi32(0x6ED9EBA1L);
+
+	if (SSEi_flags & SSEi_EARLY_STEPS_MASK)
+	{
+		const unsigned int early =
+			(SSEi_flags & SSEi_EARLY_STEPS_MASK) >> 16;
+
+		MD4_STEP(MD4_H, a, b, c, d, 0, cst, 3)
+		if (early == 1) goto md4_early;
+		MD4_STEP(MD4_H2, d, a, b, c, 8, cst, 9)
+		if (early == 2) goto md4_early;
+		MD4_STEP(MD4_H, c, d, a, b, 4, cst, 11)
+		if (early == 3) goto md4_early;
+		MD4_STEP(MD4_H2, b, c, d, a, 12, cst, 15)
+		if (early == 4) goto md4_early;
+		MD4_STEP(MD4_H, a, b, c, d, 2, cst, 3)
+		if (early == 5) goto md4_early;
+		MD4_STEP(MD4_H2, d, a, b, c, 10, cst, 9)
+		if (early == 6) goto md4_early;
+		MD4_STEP(MD4_H, c, d, a, b, 6, cst, 11)
+		if (early == 7) goto md4_early;
+		MD4_STEP(MD4_H2, b, c, d, a, 14, cst, 15)
+		if (early == 8) goto md4_early;
+		MD4_STEP(MD4_H, a, b, c, d, 1, cst, 3)
+		if (early == 9) goto md4_early;
+		MD4_STEP(MD4_H2, d, a, b, c, 9, cst, 9)
+		if (early == 10) goto md4_early;
+		MD4_STEP(MD4_H, c, d, a, b, 5, cst, 11)
+		if (early == 11) goto md4_early;
+		MD4_STEP(MD4_H2, b, c, d, a, 13, cst, 15)
+		if (early == 12) goto md4_early;
+		MD4_STEP(MD4_H, a, b, c, d, 3, cst, 3)
+		if (early == 13) goto md4_early;
+		MD4_STEP(MD4_H2, d, a, b, c, 11, cst, 9)
+		if (early == 14) goto md4_early;
+		MD4_STEP(MD4_H, c, d, a, b, 7, cst, 11)
+md4_early:
+		MD4_PARA_DO(i)
+		{
+			vstore((vtype*)&out[i*4*VS32+0*VS32], a[i]);
+			vstore((vtype*)&out[i*4*VS32+1*VS32], b[i]);
+			vstore((vtype*)&out[i*4*VS32+2*VS32], c[i]);
+			vstore((vtype*)&out[i*4*VS32+3*VS32], d[i]);
+		}
+		return;
+	}
+
 	MD4_STEP(MD4_H, a, b, c, d, 0, cst, 3)
 	MD4_STEP(MD4_H2, d, a, b, c, 8, cst, 9)
 	MD4_STEP(MD4_H, c, d, a, b, 4, cst, 11)
@@ -463,6 +463,7 @@ void status_print(int level)
 	char s_gps[32], s_pps[32], s_crypts_ps[32], s_combs_ps[32];
 	char s_combs[32], s_combs_new[32];
 	char s_when[64], s_mps[32], s_hps[32], s_tps[32];
+	unsigned long long word_total;
 	s_when[0] = 0;
 	if (status.suppressor_start) {
 		sprintf(s_when, " since accepted candidate %llu", status.suppressor_start);
@@ -509,6 +510,14 @@ void status_print(int level)
 	    status_get_c(s_combs, status.combs, status.combs_ehi),
 	    status.combs_ehi ? "N/A" : status_get_c(s_combs_new, status.combs - prev.combs, 0),
 	    status.combs_ehi ? "N/A" : status_get_cps(s_combs_ps, status.combs - prev.combs, 0, new_time));
+
+	word_total = status.suppressor_word_hit + status.suppressor_word_miss;
+	if (word_total)
+		fprintf(stderr,
+		    " same-word set      rejected %llu of %llu (%.2f%%, vs. %.2f%% globally)\n",
+		    status.suppressor_word_hit, word_total, 100.0 * status.suppressor_word_hit / word_total,
+		    100.0 * status.suppressor_hit / (suppressor_total ? suppressor_total : 1));
+
 	prev = status;
 	prev_time = time;
 }
@@ -46,6 +46,7 @@ struct status_main {
 	unsigned long long suppressor_start, suppressor_end;
 	unsigned int suppressor_start_time, suppressor_end_time;
 	unsigned long long suppressor_hit, suppressor_miss;
+	unsigned long long suppressor_word_hit, suppressor_word_miss;
 };
 
 extern struct status_main status;
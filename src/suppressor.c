@@ -4,6 +4,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #include "common.h"
 #include "memory.h"
@@ -16,6 +17,7 @@
 
 #define DEFAULT_SIZE 256 /* MiB */
 #define K 8
+#define DEFAULT_WORD_SIZE 4096 /* candidates per word */
 
 static uint32_t N, Klock;
 static uint64_t (*filter)[K];
@@ -23,15 +25,30 @@ static unsigned int flags;
 
 static int (*old_process_key)(char *key);
 
+/*
+ * Word-scoped layer: the candidates made from the current base word (by all
+ * of the rules applied to it in a row), in a small open addressing table
+ * that is emptied between words by bumping the generation number.
+ */
+struct word_entry {
+	uint64_t hash2;
+	uint32_t hash1, generation;
+};
+
+static struct word_entry *word_set;
+static uint32_t word_mask, word_generation, word_count;
+
 static int suppressor_process_key(char *key);
 
 void suppressor_init(unsigned int new_flags)
 {
 	if (!flags) {
+		int size, word_size;
+
 		if (!(new_flags & SUPPRESSOR_UPDATE))
 			return;
 
-		int size = options.suppressor_size;
+		size = options.suppressor_size;
 		if (size < 0)
 			size = cfg_get_int(SECTION_OPTIONS, ":Suppressor", "Size");
 		if (size <= 0) {
@@ -59,6 +76,18 @@ void suppressor_init(unsigned int new_flags)
 
 		filter = mem_calloc_align(N, sizeof(*filter), MEM_ALIGN_CACHE);
 
+		word_size = cfg_get_int(SECTION_OPTIONS, ":Suppressor", "WordSize");
+		if (word_size < 0)
+			word_size = DEFAULT_WORD_SIZE;
+		if (word_size > 0) {
+			word_mask = 0xff;
+			while (word_mask < word_size - 1)
+				word_mask = (word_mask << 1) | 1;
+			word_set = mem_calloc_align(word_mask + 1, sizeof(*word_set), MEM_ALIGN_CACHE);
+			word_generation = 1;
+			word_count = 0;
+		}
+
 		status.suppressor_start = status.cands + 1;
 		status.suppressor_start_time = status_get_time();
 	}
@@ -74,12 +103,16 @@ static void suppressor_done(void)
 {
 	const char *msg = "Disabling duplicate candidate password suppressor";
 	log_event("%s (accepted %llu, rejected %llu)", msg, status.suppressor_miss, status.suppressor_hit);
+	if (word_set)
+		log_event("- Same-word candidates: accepted %llu, rejected %llu",
+		    status.suppressor_word_miss, status.suppressor_word_hit);
 	if (NODES > 1)
 		fprintf(stderr, "%d: %s\n", NODE, msg);
 	else
 		fprintf(stderr, "%s\n", msg);
 
 	MEM_FREE(filter);
+	MEM_FREE(word_set);
 
 	flags = SUPPRESSOR_OFF;
 	status.suppressor_end = status.cands;
@@ -127,12 +160,62 @@ static MAYBE_INLINE uint32_t key_hash(const char *key, uint64_t *hash2)
 	return hash1;
 }
 
-static int suppressor_process_key(char *key)
+void suppressor_new_word(void)
+{
+	if (!word_set)
+		return;
+
+	if (!++word_generation) {
+		memset(word_set, 0, (word_mask + 1) * sizeof(*word_set));
+		word_generation = 1;
+	}
+	word_count = 0;
+}
+
+int suppressor_word_dupe(const char *key)
+{
+	struct word_entry *entry;
+	uint64_t hash2;
+	uint32_t hash1, i;
+
+	if (!word_set)
+		return 0;
+
+	hash1 = key_hash(key, &hash2);
+	for (i = hash1 & word_mask;
+	    (entry = &word_set[i])->generation == word_generation;
+	    i = (i + 1) & word_mask) {
+		if (entry->hash1 == hash1 && entry->hash2 == hash2) {
+			status.suppressor_word_hit++;
+			return 1;
+		}
+	}
+
+	/* keep at least a quarter of the table free, so that lookups stay short */
+	if (word_count < word_mask - (word_mask >> 2)) {
+		entry->hash2 = hash2;
+		entry->hash1 = hash1;
+		entry->generation = word_generation;
+		word_count++;
+	}
+
+	status.suppressor_word_miss++;
+	return 0;
+}
+
+/*
+ * Looks key up in the global filter, and adds it there if it's not a dupe.
+ * The keys of one kind (such as the stacked rules' candidates vs. the base
+ * words they're made from) have their hashes mixed with a different salt, so
+ * that they're only ever seen as dupes of their own kind.
+ */
+static int filter_dupe(char *key, uint64_t salt)
 {
 	uint64_t hash;
 	unsigned int i, j;
 
-	i = ((uint64_t)key_hash(key, &hash) * N) >> 32;
+	i = ((uint64_t)(key_hash(key, &hash) ^ (uint32_t)salt) * N) >> 32;
+	hash ^= salt;
 
 	/* lookup */
 	for (j = 0; j < K && filter[i][j]; j++) {
@@ -142,7 +225,7 @@ static int suppressor_process_key(char *key)
 				filter[i][j + 1] = hash; /* postpone eviction of this hash */
 			}
 			status.suppressor_hit++;
-			return 0;
+			return 1;
 		}
 	}
 
@@ -169,5 +252,21 @@ static int suppressor_process_key(char *key)
 			suppressor_done();
 	}
 
+	return 0;
+}
+
+int suppressor_dupe(char *key)
+{
+	if (!filter)
+		return 0;
+
+	return filter_dupe(key, 0x9e3779b97f4a7c15ULL);
+}
+
+static int suppressor_process_key(char *key)
+{
+	if (filter_dupe(key, 0))
+		return 0;
+
 	return old_process_key(key);
 }
@@ -24,4 +24,24 @@
  */
 extern void suppressor_init(unsigned int flags);
 
+/*
+ * Word-scoped layer, for code that applies a number of rules to one base word
+ * before moving on to the next.  suppressor_new_word() starts a new word.
+ * suppressor_word_dupe() returns non-zero if key was already made from the
+ * current word, or else remembers it.  Keys are compared by 96-bit hashes in
+ * a small table, so unlike the global filter this doesn't miss duplicates
+ * because of evictions.  Both do nothing when the suppressor is disabled.
+ */
+extern void suppressor_new_word(void);
+extern int suppressor_word_dupe(const char *key);
+
+/*
+ * Returns non-zero if the global filter has seen key, or else remembers it,
+ * for keys made past crk_process_key (such as by --rules-stack).  Those are
+ * kept apart from the keys the suppressor itself sees, since a stacked rule
+ * may well produce its very base word.  Does nothing when the suppressor is
+ * disabled.
+ */
+extern int suppressor_dupe(char *key);
+
 #endif
@@ -0,0 +1,266 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+/*
+ * Benchmark of the compact hash table (hashtab.c) against the hash table and
+ * next_hash chains the loader otherwise builds behind the bitmap, for each
+ * PASSWORD_HASH_SIZE_* tier.
+ *
+ * Usage: hashtab-bench [hashes [lookups [hit percentage]]]
+ *
+ * Both lookups mimic what crk_process_results() does: prefetch the bitmap for
+ * a batch of CRK_PREFETCH computed hashes, then prefetch the table entries for
+ * the bitmap hits, and finally compare the binary of every candidate entry.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "../params.h"
+#include "../hashtab.h"
+
+#ifndef CRK_PREFETCH
+#define CRK_PREFETCH			64
+#endif
+
+#ifdef __SSE__
+#define PREFETCH(p)			_mm_prefetch((const char *)(p), _MM_HINT_NTA)
+#else
+#define PREFETCH(p)			(void)*(volatile char *)(p)
+#endif
+
+struct bench_pw {
+	struct bench_pw *next_hash;
+	uint64_t binary;
+};
+
+static unsigned int sizes[] = {
+	PASSWORD_HASH_SIZE_0, PASSWORD_HASH_SIZE_1, PASSWORD_HASH_SIZE_2,
+	PASSWORD_HASH_SIZE_3, PASSWORD_HASH_SIZE_4, PASSWORD_HASH_SIZE_5,
+	PASSWORD_HASH_SIZE_6
+};
+
+static unsigned int thresholds[] = {
+	PASSWORD_HASH_THRESHOLD_0, PASSWORD_HASH_THRESHOLD_1,
+	PASSWORD_HASH_THRESHOLD_2, PASSWORD_HASH_THRESHOLD_3,
+	PASSWORD_HASH_THRESHOLD_4, PASSWORD_HASH_THRESHOLD_5,
+	PASSWORD_HASH_THRESHOLD_6
+};
+
+static uint64_t rng_state = 0x0123456789abcdefULL;
+
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void *alloc(size_t size)
+{
+	void *p = calloc(1, size);
+
+	if (!p) {
+		fprintf(stderr, "Out of memory allocating %llu bytes\n",
+		    (unsigned long long)size);
+		exit(1);
+	}
+	return p;
+}
+
+static unsigned int bench_classic(struct bench_pw *pws, unsigned int count,
+    uint64_t *queries, unsigned int lookups, int tier)
+{
+	unsigned int mask = sizes[tier] - 1;
+	unsigned int *bitmap;
+	struct bench_pw **hash;
+	unsigned int i, index, found = 0;
+	double start;
+
+	bitmap = alloc(sizes[tier] / 8 + sizeof(*bitmap));
+	hash = alloc((sizes[tier] >> PASSWORD_HASH_SHR) * sizeof(*hash) +
+	    sizeof(*hash));
+	for (i = 0; i < count; i++) {
+		unsigned int h = pws[i].binary & mask;
+		bitmap[h / 32] |= 1U << (h % 32);
+		pws[i].next_hash = hash[h >> PASSWORD_HASH_SHR];
+		hash[h >> PASSWORD_HASH_SHR] = &pws[i];
+	}
+
+	start = now();
+	for (index = 0; index < lookups; index += CRK_PREFETCH) {
+		unsigned int slot, lucky = 0, h[CRK_PREFETCH];
+		struct bench_pw **pwp[CRK_PREFETCH];
+		unsigned int target = index + CRK_PREFETCH;
+		if (target > lookups)
+			target = lookups;
+		for (slot = 0, i = index; i < target; slot++, i++) {
+			h[slot] = queries[i] & mask;
+			PREFETCH(&bitmap[h[slot] / 32]);
+		}
+		for (slot = 0, i = index; i < target; slot++, i++)
+		if (bitmap[h[slot] / 32] & (1U << (h[slot] % 32))) {
+			pwp[lucky] = &hash[h[slot] >> PASSWORD_HASH_SHR];
+			PREFETCH(pwp[lucky]);
+			h[lucky++] = i;
+		}
+		for (slot = 0; slot < lucky; slot++)
+			PREFETCH(&(*pwp[slot])->binary);
+		for (slot = 0; slot < lucky; slot++) {
+			struct bench_pw *pw = *pwp[slot];
+			do {
+				if (pw->binary == queries[h[slot]])
+					found++;
+			} while ((pw = pw->next_hash));
+		}
+	}
+	start = now() - start;
+
+	printf("bitmap + chains,  tier %d%-10s: %7.2f ns/lookup, %5llu MiB, "
+	    "%u found\n", tier, count >= thresholds[tier] &&
+	    (tier == 6 || count < thresholds[tier + 1]) ? " (default)" : "",
+	    start * 1e9 / lookups,
+	    (unsigned long long)((sizes[tier] / 8 +
+	    (sizes[tier] >> PASSWORD_HASH_SHR) * sizeof(*hash)) >> 20), found);
+
+	free(hash);
+	free(bitmap);
+	return found;
+}
+
+static unsigned int bench_compact(struct bench_pw *pws, unsigned int count,
+    uint64_t *queries, unsigned int lookups, int tier)
+{
+	unsigned int mask = sizes[tier] - 1;
+	unsigned int buckets = hashtab_buckets(count, sizes[tier]);
+	unsigned int *bitmap;
+	struct db_hash_bucket *table;
+	unsigned int i, index, found = 0;
+	void *mem;
+	double start;
+
+	if (!buckets) {
+		printf("bitmap + compact, tier %d: hash space too small\n", tier);
+		return 0;
+	}
+
+	bitmap = alloc(sizes[tier] / 8 + sizeof(*bitmap));
+/* The values of a bucket need to be in one cache line, like with
+ * mem_calloc_tiny(..., MEM_ALIGN_CACHE) in the loader */
+	mem = alloc((size_t)buckets * sizeof(*table) + 64);
+	table = (struct db_hash_bucket *)(((uintptr_t)mem + 63) & ~(uintptr_t)63);
+	for (i = 0; i < count; i++) {
+		unsigned int h = pws[i].binary & mask;
+		bitmap[h / 32] |= 1U << (h % 32);
+		hashtab_insert(table, buckets - 1, h, &pws[i]);
+	}
+
+	start = now();
+	for (index = 0; index < lookups; index += CRK_PREFETCH) {
+		unsigned int slot, lucky = 0, h[CRK_PREFETCH], q[CRK_PREFETCH];
+		int pos[CRK_PREFETCH];
+		unsigned int target = index + CRK_PREFETCH;
+		if (target > lookups)
+			target = lookups;
+		for (slot = 0, i = index; i < target; slot++, i++) {
+			h[slot] = queries[i] & mask;
+			PREFETCH(&bitmap[h[slot] / 32]);
+		}
+		for (slot = 0, i = index; i < target; slot++, i++)
+		if (bitmap[h[slot] / 32] & (1U << (h[slot] % 32))) {
+			PREFETCH(table[h[slot] & (buckets - 1)].value);
+			q[lucky] = i;
+			h[lucky++] = h[slot];
+		}
+		for (slot = 0; slot < lucky; slot++) {
+			pos[slot] = hashtab_next(table, buckets - 1, h[slot], -1);
+			if (pos[slot] >= 0)
+				PREFETCH(&HASHTAB_PTR(table, pos[slot]));
+		}
+		for (slot = 0; slot < lucky; slot++)
+			if (pos[slot] >= 0)
+				PREFETCH(&((struct bench_pw *)
+				    HASHTAB_PTR(table, pos[slot]))->binary);
+		for (slot = 0; slot < lucky; slot++)
+		while (pos[slot] >= 0) {
+			if (((struct bench_pw *)HASHTAB_PTR(table, pos[slot]))->
+			    binary == queries[q[slot]])
+				found++;
+			pos[slot] = hashtab_next(table, buckets - 1, h[slot],
+			    pos[slot]);
+		}
+	}
+	start = now() - start;
+
+	printf("bitmap + compact, tier %d%-10s: %7.2f ns/lookup, %5llu MiB, "
+	    "%u found\n", tier, "", start * 1e9 / lookups,
+	    (unsigned long long)((sizes[tier] / 8 +
+	    (size_t)buckets * sizeof(*table)) >> 20), found);
+
+	free(mem);
+	free(bitmap);
+	return found;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int count = 4000000, lookups = 20000000, hits = 1;
+	struct bench_pw *pws;
+	uint64_t *queries;
+	unsigned int i;
+	int tier, first;
+
+	if (argc > 1)
+		count = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		lookups = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		hits = strtoul(argv[3], NULL, 0);
+	if (!count || !lookups || hits > 100) {
+		fprintf(stderr,
+		    "Usage: %s [hashes [lookups [hit percentage]]]\n", argv[0]);
+		return 1;
+	}
+
+	printf("%u hashes, %u lookups, %u%% hits\n", count, lookups, hits);
+
+	pws = alloc((size_t)count * sizeof(*pws));
+	for (i = 0; i < count; i++)
+		pws[i].binary = rng();
+	queries = alloc((size_t)lookups * sizeof(*queries));
+	for (i = 0; i < lookups; i++)
+		queries[i] = (rng() % 100 < hits) ?
+		    pws[rng() % count].binary : rng();
+
+	for (first = 0; first < 6 && count >= thresholds[first + 1]; first++)
+		;
+	for (tier = first; tier < 7; tier++)
+		bench_classic(pws, count, queries, lookups, tier);
+	for (tier = first; tier < 7; tier++)
+		bench_compact(pws, count, queries, lookups, tier);
+
+	free(queries);
+	free(pws);
+	return 0;
+}
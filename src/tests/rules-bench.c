@@ -0,0 +1,308 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+/*
+ * Benchmark of compiled rules (rules_compile() and rules_apply_compiled(),
+ * and rules_apply_block() on blocks of words) against rules_apply() on
+ * john.conf rule sections.  Every accepted rule is applied to a set of
+ * generated words the way wordlist mode does it, passing the previous
+ * candidate as "last" or comparing against it, and the compiled rule is timed
+ * including its compilation.  The candidates of all three are then
+ * checksummed, outside of the timed loops, and compared.
+ *
+ * Usage: rules-bench [words [section ...]]
+ *
+ * Run it from the run directory, so that john.conf and the files it includes
+ * are found.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../params.h"
+#include "../path.h"
+#include "../config.h"
+#include "../options.h"
+#include "../unicode.h"
+#include "../rpp.h"
+#include "../rules.h"
+
+/* What the rules code needs from the rest of john */
+struct options_main options;
+int john_main_process = 1;
+int mask_add_len;
+
+void log_event(const char *format, ...)
+{
+}
+
+void log_done(void)
+{
+}
+
+int ext_has_function(const char *mode, const char *function)
+{
+	return 0;
+}
+
+static const char *default_sections[] = {
+	"Wordlist", "Single", "best64", "d3ad0ne", "Jumbo",
+	"OneRuleToRuleThemStill", "hashcat", NULL
+};
+
+static uint64_t rng_state = 0x0123456789abcdefULL;
+
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Lowercase words of 3 to 10 letters, some of them capitalized and some
+ * with digits or a special character appended, roughly like a wordlist.
+ */
+static char **make_words(int count)
+{
+	static const char specials[] = "!@#$%&*.";
+	char **words = malloc(count * sizeof(*words));
+	int i;
+
+	if (!words) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < count; i++) {
+		char word[32];
+		int length = 3 + rng() % 8, j;
+
+		for (j = 0; j < length; j++)
+			word[j] = 'a' + rng() % 26;
+		if (rng() % 4 == 0)
+			word[0] -= 0x20;
+		switch (rng() % 8) {
+		case 0:
+		case 1:
+			word[length++] = '0' + rng() % 10;
+			word[length++] = '0' + rng() % 10;
+			break;
+		case 2:
+			word[length++] = specials[rng() % (sizeof(specials) - 1)];
+			break;
+		}
+		word[length] = 0;
+		if (!(words[i] = strdup(word))) {
+			perror("strdup");
+			exit(1);
+		}
+	}
+
+	return words;
+}
+
+static uint64_t checksum(uint64_t sum, const char *word)
+{
+	while (*word)
+		sum = (sum ^ (unsigned char)*word++) * 0x100000001b3ULL;
+	return (sum ^ 0xff) * 0x100000001b3ULL;
+}
+
+/*
+ * Applies rule (or prog, if non-NULL) to all words.  Returns the number of
+ * candidates, and a checksum of them in *sum unless sum is NULL.
+ */
+static unsigned int apply_all(char **words, int count, char *rule,
+	struct rules_prog *prog, uint64_t *sum)
+{
+	char first_last[2] = "\n";
+	char *word, *last = first_last;
+	unsigned int candidates = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (prog)
+			word = rules_apply_compiled(words[i], prog, last);
+		else
+			word = rules_apply(words[i], rule, -1, last);
+		if (word) {
+			if (sum)
+				*sum = checksum(*sum, word);
+			candidates++;
+			last = word;
+		}
+	}
+
+	return candidates;
+}
+
+/*
+ * Same as apply_all() with prog, RULES_BLOCK_WORDS words at a time.  Only a
+ * block's first candidate needs comparing against the previous one.
+ */
+static unsigned int apply_block(char **words, int count,
+	struct rules_prog *prog, uint64_t *sum)
+{
+	static char keys[RULES_BLOCK_WORDS][PLAINTEXT_BUFFER_SIZE];
+	char ok[RULES_BLOCK_WORDS], last[PLAINTEXT_BUFFER_SIZE] = "\n";
+	unsigned int candidates = 0;
+	int i, j, prev;
+
+	for (i = 0; i < count; i += RULES_BLOCK_WORDS) {
+		int n = count - i;
+
+		if (n > RULES_BLOCK_WORDS)
+			n = RULES_BLOCK_WORDS;
+		rules_apply_block(prog, &words[i], n, keys[0], sizeof(keys[0]),
+		    ok);
+		for (j = 0, prev = -1; j < n; j++) {
+			if (!ok[j])
+				continue;
+			if (prev < 0 && !strcmp(keys[j], last)) {
+				prev = j;
+				continue;
+			}
+			if (sum)
+				*sum = checksum(*sum, keys[j]);
+			candidates++;
+			prev = j;
+		}
+/* The next block overwrites keys[] */
+		if (prev >= 0)
+			strcpy(last, keys[prev]);
+	}
+
+	return candidates;
+}
+
+static void bench_section(const char *section, char **words, int count,
+	struct db_main *db, struct rules_prog *prog)
+{
+	struct rpp_context ctx;
+	char *prerule, *rule;
+	double interpreted = 0, compiled = 0, block = 0, start;
+	uint64_t sum_interpreted = 0, sum_compiled = 0, sum_block = 0;
+	int rules = 0, fallback = 0, pass;
+
+	if (rpp_init(&ctx, section)) {
+		printf("%-24s no rules found\n", section);
+		return;
+	}
+
+	while ((prerule = rpp_next(&ctx))) {
+		if (!(rule = rules_reject(prerule, -1, NULL, db)))
+			continue;
+		rules++;
+
+/* Rotate which one goes first, as the later ones run with warmer caches */
+		for (pass = 0; pass < 3; pass++) {
+			start = now();
+			switch ((pass + rules) % 3) {
+			case 0:
+				apply_all(words, count, rule, NULL, NULL);
+				interpreted += now() - start;
+				break;
+			case 1:
+				if (rules_compile(rule, prog))
+					apply_all(words, count, rule, prog, NULL);
+				else
+					apply_all(words, count, rule, NULL, NULL);
+				compiled += now() - start;
+				break;
+			default:
+				if (rules_compile(rule, prog))
+					apply_block(words, count, prog, NULL);
+				else
+					apply_all(words, count, rule, NULL, NULL);
+				block += now() - start;
+			}
+		}
+
+		if (rules_compile(rule, prog)) {
+			apply_all(words, count, rule, prog, &sum_compiled);
+			apply_block(words, count, prog, &sum_block);
+		} else {
+			fallback++;
+			apply_all(words, count, rule, NULL, &sum_compiled);
+			apply_all(words, count, rule, NULL, &sum_block);
+		}
+		apply_all(words, count, rule, NULL, &sum_interpreted);
+	}
+
+	if (!rules) {
+		printf("%-24s no rules accepted\n", section);
+		return;
+	}
+
+	printf("%-24s %6d rules %6d fallback %7.2f %7.2f %7.2f M/s "
+	    "%5.2fx %5.2fx%s\n",
+	    section, rules, fallback,
+	    (double)rules * count / interpreted / 1000000,
+	    (double)rules * count / compiled / 1000000,
+	    (double)rules * count / block / 1000000,
+	    interpreted / compiled, interpreted / block,
+	    sum_interpreted == sum_compiled && sum_compiled == sum_block ?
+	    "" : " MISMATCH");
+}
+
+int main(int argc, char **argv)
+{
+	static struct rules_prog prog;
+	struct fmt_main format;
+	struct db_options db_options;
+	struct db_main db;
+	const char **sections = default_sections;
+	char **words;
+	int count = 10000;
+
+	if (argc > 1)
+		count = atoi(argv[1]);
+	if (count <= 0) {
+		fprintf(stderr, "Usage: %s [words [section ...]]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		sections = (const char **)&argv[2];
+
+	path_init(argv);
+	cfg_init(CFG_FULL_NAME, 0);
+
+	options.internal_cp = options.target_enc = options.input_enc = ENC_RAW;
+
+	memset(&format, 0, sizeof(format));
+	format.params.flags = FMT_CASE | FMT_8_BIT;
+	memset(&db_options, 0, sizeof(db_options));
+	memset(&db, 0, sizeof(db));
+	db.format = &format;
+	db.options = &db_options;
+
+	rules_init(&db, RULE_WORD_SIZE - 1);
+	rpp_real_run = 1;
+
+	words = make_words(count);
+
+	printf("%d words, interpreted vs. compiled vs. block rules\n", count);
+	for (; *sections; sections++)
+		bench_section(*sections, words, count, &db, &prog);
+
+	return 0;
+}
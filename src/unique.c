@@ -24,6 +24,10 @@
 #include <string.h>
 #include <stdint.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #ifdef _MSC_VER
 #include <io.h>
 #pragma warning ( disable : 4996 )
@@ -36,6 +40,7 @@
 #include "memory.h"
 #include "common.h"
 #include "jumbo.h"
+#include "timer.h"
 
 typedef size_t uq_idx;
 typedef size_t uq_hash;
@@ -63,6 +68,7 @@ static FILE *ex_file;
 
 static int ex_file_only;
 static int verbose, cut_len, lm_split, slow, mlc;
+static int shards, keep_order;
 
 static size_t tot_lines, written_lines;
 static size_t unique_hash_size = UNIQUE_HASH_SIZE;
@@ -351,6 +357,9 @@ static void unique_init(char *name)
 {
 	int fd;
 
+	if (shards)
+		goto open_output;
+
 	if (verbose)
 		fprintf(stderr,
 	        "Hash size %d (%s/%sB), input buffer %sB. Total alloc. %sB\n",
@@ -363,6 +372,7 @@ static void unique_init(char *name)
 	buffer.hash = mem_alloc(unique_hash_size * sizeof(*buffer.hash));
 	buffer.data = mem_alloc(unique_buffer_size);
 
+open_output:
 #if defined (_MSC_VER) || defined(__MINGW32__)
 	fd = open(name, O_RDWR | O_CREAT | O_EXCL | O_BINARY, 0600);
 #else
@@ -400,6 +410,370 @@ static void unique_done(void)
 		pexit("fclose");
 }
 
+/*
+ * Sharded mode (-shards=N).  Instead of slow passes that re-read the whole
+ * output file, all lines are split by hash into N temporary files next to
+ * OUTPUT-FILE.  Each shard is then read into a single arena and deduped on
+ * its own, in parallel when built with OpenMP, and finally the shards are
+ * concatenated - or merged back into input order with -keep-order, using
+ * the line numbers stored with each line.  Each shard (and its table) must
+ * fit in memory, once per thread.
+ */
+#define SHARDS_MAX			1024
+#define SHARD_EXCLUDE			0x80000000U
+
+struct shard_rec {
+	uint64_t hash;
+	uint64_t seq;		/* input line number, for -keep-order */
+	uint32_t len;		/* | SHARD_EXCLUDE for -ex_file lines */
+};
+
+static char *shard_base;
+static FILE **shard_file;
+static uint64_t shard_bytes;
+
+static void shard_name(char *name, int n, const char *ext)
+{
+	snprintf(name, PATH_BUFFER_SIZE + 32, "%s.%d.%s", shard_base, n, ext);
+}
+
+static uint64_t shard_hash(const char *line, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	while (len--) {
+		hash ^= (uint8_t)*line++;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash ^ (hash >> 29);
+}
+
+static MAYBE_INLINE size_t shard_key_len(size_t len)
+{
+	return (mlc && len > mlc) ? mlc : len;
+}
+
+static void shard_put(char *line, uint64_t seq, uint32_t flags)
+{
+	struct shard_rec rec;
+	size_t len = strlen(line);
+	FILE *file;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.hash = shard_hash(line, shard_key_len(len));
+	rec.seq = seq;
+	rec.len = len | flags;
+
+	file = shard_file[(rec.hash >> 32) % shards];
+	if (fwrite(&rec, sizeof(rec), 1, file) != 1 ||
+	    (len && fwrite(line, len, 1, file) != 1))
+		pexit("fwrite");
+
+	shard_bytes += len + 1;
+}
+
+static void shard_split(void)
+{
+	char line[LINE_BUFFER_SIZE];
+	char name[PATH_BUFFER_SIZE + 32];
+	uint64_t seq = 0;
+	int n;
+
+	shard_file = mem_alloc(shards * sizeof(*shard_file));
+	for (n = 0; n < shards; n++) {
+		shard_name(name, n, "shard");
+		if (!(shard_file[n] = fopen(name, "wb")))
+			pexit("fopen: %s", name);
+	}
+
+/* Lines to exclude go first, so they are in each table before any input */
+	if (ex_file) {
+		while (fgetl(line, sizeof(line), ex_file)) {
+			if (cut_len)
+				line[cut_len] = 0;
+			shard_put(line, 0, SHARD_EXCLUDE);
+		}
+		if (ferror(ex_file))
+			pexit("fgets");
+	}
+
+	while (fgetl(line, sizeof(line), input)) {
+		char lm_buf[8];
+
+		*lm_buf = 0;
+		if (lm_split) {
+			if (strlen(line) > 7) {
+				strncpy(lm_buf, &line[7], 7);
+				lm_buf[7] = 0;
+				upcase(lm_buf);
+				++tot_lines;
+			}
+			line[7] = 0;
+			upcase(line);
+		} else if (cut_len)
+			line[cut_len] = 0;
+		++tot_lines;
+
+		shard_put(line, seq++, 0);
+		if (*lm_buf)
+			shard_put(lm_buf, seq++, 0);
+	}
+
+	if (ferror(input))
+		pexit("fgets");
+
+	for (n = 0; n < shards; n++)
+		if (fclose(shard_file[n]))
+			pexit("fclose");
+	MEM_FREE(shard_file);
+}
+
+/* Dedupes one shard into its ".uniq" file, returns the number of lines kept */
+static size_t shard_dedupe(int n)
+{
+	char name[PATH_BUFFER_SIZE + 32];
+	FILE *file;
+	char *arena;
+	size_t *table, mask, size, pos, count, written;
+	int64_t file_size;
+
+	shard_name(name, n, "shard");
+	if (!(file = fopen(name, "rb")))
+		pexit("fopen: %s", name);
+	if (jtr_fseek64(file, 0, SEEK_END) ||
+	    (file_size = jtr_ftell64(file)) < 0 ||
+	    jtr_fseek64(file, 0, SEEK_SET))
+		pexit("fseek: %s", name);
+	if ((uint64_t)file_size > (size_t)~0)
+		error_msg("Error: Shard %s is too large for this build, "
+		          "use more shards\n", name);
+	size = file_size;
+	arena = mem_alloc(size + 1);
+	if (size && fread(arena, size, 1, file) != 1)
+		pexit("fread: %s", name);
+	if (fclose(file))
+		pexit("fclose");
+	remove(name);
+
+	count = 0;
+	for (pos = 0; pos < size; count++) {
+		struct shard_rec rec;
+
+		memcpy(&rec, &arena[pos], sizeof(rec));
+		pos += sizeof(rec) + (rec.len & ~SHARD_EXCLUDE);
+	}
+
+/* Slots hold offsets into the arena plus one, with zero meaning empty */
+	mask = 15;
+	while (mask < 2 * count)
+		mask = mask << 1 | 1;
+	table = mem_calloc(mask + 1, sizeof(*table));
+
+	shard_name(name, n, "uniq");
+	if (!(file = fopen(name, "wb")))
+		pexit("fopen: %s", name);
+
+	written = 0;
+	for (pos = 0; pos < size; ) {
+		struct shard_rec rec;
+		char *line = &arena[pos + sizeof(rec)];
+		size_t len, key_len, slot;
+
+		memcpy(&rec, &arena[pos], sizeof(rec));
+		len = rec.len & ~SHARD_EXCLUDE;
+		key_len = shard_key_len(len);
+
+		slot = rec.hash & mask;
+		while (table[slot]) {
+			struct shard_rec old;
+			size_t old_pos = table[slot] - 1;
+
+			memcpy(&old, &arena[old_pos], sizeof(old));
+			if (old.hash == rec.hash &&
+			    shard_key_len(old.len & ~SHARD_EXCLUDE) == key_len &&
+			    !memcmp(&arena[old_pos + sizeof(old)], line, key_len))
+				break;
+			slot = (slot + 1) & mask;
+		}
+
+		if (!table[slot]) {
+			table[slot] = pos + 1;
+			if (!(rec.len & SHARD_EXCLUDE)) {
+				written++;
+				if (keep_order ?
+				    fwrite(&rec, sizeof(rec), 1, file) != 1 ||
+				    (len && fwrite(line, len, 1, file) != 1) :
+				    (len && fwrite(line, len, 1, file) != 1) ||
+				    putc('\n', file) == EOF)
+					pexit("fwrite");
+			}
+		}
+
+		pos += sizeof(rec) + len;
+	}
+
+	if (fclose(file))
+		pexit("fclose");
+	MEM_FREE(table);
+	MEM_FREE(arena);
+
+	return written;
+}
+
+static void shard_concat(void)
+{
+	char name[PATH_BUFFER_SIZE + 32];
+	char buf[0x10000];
+	int n;
+
+	for (n = 0; n < shards; n++) {
+		FILE *file;
+		size_t len;
+
+		shard_name(name, n, "uniq");
+		if (!(file = fopen(name, "rb")))
+			pexit("fopen: %s", name);
+		while ((len = fread(buf, 1, sizeof(buf), file)))
+			if (fwrite(buf, len, 1, output) != 1)
+				pexit("fwrite");
+		if (ferror(file))
+			pexit("fread: %s", name);
+		fclose(file);
+		remove(name);
+	}
+}
+
+struct shard_head {
+	FILE *file;
+	struct shard_rec rec;
+	char line[LINE_BUFFER_SIZE];
+};
+
+static int shard_next(struct shard_head *head)
+{
+	size_t len;
+
+	if (fread(&head->rec, sizeof(head->rec), 1, head->file) != 1) {
+		if (ferror(head->file))
+			pexit("fread");
+		return 0;
+	}
+	len = head->rec.len;
+	if (len && fread(head->line, len, 1, head->file) != 1)
+		pexit("fread");
+	head->line[len] = '\n';
+
+	return 1;
+}
+
+/* Merges the shards back into input order, using a heap keyed on seq */
+static void shard_merge(void)
+{
+	char name[PATH_BUFFER_SIZE + 32];
+	struct shard_head *heads = mem_alloc(shards * sizeof(*heads));
+	struct shard_head **heap = mem_alloc(shards * sizeof(*heap));
+	int n, count = 0;
+
+	for (n = 0; n < shards; n++) {
+		shard_name(name, n, "uniq");
+		if (!(heads[n].file = fopen(name, "rb")))
+			pexit("fopen: %s", name);
+		if (shard_next(&heads[n])) {
+			int i = count++;
+
+			while (i && heap[(i - 1) / 2]->rec.seq > heads[n].rec.seq) {
+				heap[i] = heap[(i - 1) / 2];
+				i = (i - 1) / 2;
+			}
+			heap[i] = &heads[n];
+		}
+	}
+
+	while (count) {
+		struct shard_head *top = heap[0];
+		int i = 0;
+
+		if (fwrite(top->line, top->rec.len + 1, 1, output) != 1)
+			pexit("fwrite");
+
+		if (!shard_next(top))
+			top = heap[--count];
+
+		for (;;) {
+			int child = 2 * i + 1;
+
+			if (child >= count)
+				break;
+			if (child + 1 < count &&
+			    heap[child + 1]->rec.seq < heap[child]->rec.seq)
+				child++;
+			if (heap[child]->rec.seq >= top->rec.seq)
+				break;
+			heap[i] = heap[child];
+			i = child;
+		}
+		heap[i] = top;
+	}
+
+	for (n = 0; n < shards; n++) {
+		fclose(heads[n].file);
+		shard_name(name, n, "uniq");
+		remove(name);
+	}
+	MEM_FREE(heap);
+	MEM_FREE(heads);
+}
+
+static double shard_rate(uint64_t amount, uint64_t nanos)
+{
+	return nanos ? amount * 1000000000.0 / nanos : 0;
+}
+
+static void shard_run(void)
+{
+	uint64_t start, split, dedupe, done;
+	size_t written = 0;
+	int n, threads = 1;
+
+	start = john_get_nano();
+	shard_split();
+	split = john_get_nano();
+	if (verbose)
+		fprintf(stderr,
+		        "Split "Zu" lines (%sB) into %d shards in %.2f s, %sB/s\n",
+		        tot_lines, human_prefix(shard_bytes), shards,
+		        (split - start) / 1e9,
+		        human_prefix(shard_rate(shard_bytes, split - start)));
+
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#pragma omp parallel for schedule(dynamic) reduction(+:written)
+#endif
+	for (n = 0; n < shards; n++)
+		written += shard_dedupe(n);
+	written_lines = written;
+	dedupe = john_get_nano();
+	if (verbose)
+		fprintf(stderr,
+		        "Deduped %d shards with %d thread%s in %.2f s, %.0f lines/s\n",
+		        shards, threads, threads > 1 ? "s" : "",
+		        (dedupe - split) / 1e9,
+		        shard_rate(tot_lines, dedupe - split));
+
+	if (keep_order)
+		shard_merge();
+	else
+		shard_concat();
+	done = john_get_nano();
+	if (verbose)
+		fprintf(stderr,
+		        "%s "Zu" unique lines in %.2f s, %.0f lines/s\n",
+		        keep_order ? "Merged" : "Concatenated", written_lines,
+		        (done - dedupe) / 1e9,
+		        shard_rate(written_lines, done - dedupe));
+}
+
 static void pop_arg(int arg, int *argc, char **argv)
 {
 	int i;
@@ -501,6 +875,19 @@ int unique(int argc, char **argv)
 			pop_arg(i, &argc, argv);
 			continue;
 		}
+		if (!strncmp(argv[i], "-shards=", 8)) {
+			char nul = 0;
+			if (sscanf(argv[i], "-shards=%d%c", &shards, &nul) < 1 || nul ||
+			    shards < 1 || shards > SHARDS_MAX)
+				error_msg("Error, -shards=N must be 1..%d\n", SHARDS_MAX);
+			pop_arg(i, &argc, argv);
+			continue;
+		}
+		if (!strcmp(argv[i], "-keep-order")) {
+			keep_order = 1;
+			pop_arg(i, &argc, argv);
+			continue;
+		}
 		if (!ex_file && !strncmp(argv[i], "-ex_file=", 9)) {
 			ex_file = fopen(&argv[i][9], "rb");
 			if (ex_file)
@@ -562,6 +949,11 @@ int unique(int argc, char **argv)
 "                   nothing is ever written to FILE\n"
 "-ex_file_only=FILE assumes the input is already unique, and only checks\n"
 "                   against FILE (again the latter is not written to)\n"
+"-shards=N          split the input by hash into N temporary files next to\n"
+"                   OUTPUT-FILE and dedupe those in parallel, instead of using\n"
+"                   slow passes. Each shard must fit in memory, per thread\n"
+"-keep-order        with -shards, keep the order of first occurrences (the\n"
+"                   default is to output the lines grouped by shard)\n"
 "\n"
 "NOTE that if you try to use more memory than actually available physical\n"
 "memory, performance will just drop.\n\n",
@@ -579,14 +971,20 @@ int unique(int argc, char **argv)
 		input = stdin;
 
 	unique_init(argv[1]);
-	unique_run();
+	if (shards) {
+		shard_base = argv[1];
+		shard_run();
+	} else
+		unique_run();
 	unique_done();
 
 	fprintf(stderr,
 	        "Total lines read: "Zu", unique lines written: "Zu" (%u%%), ",
 	        tot_lines, written_lines, tot_lines ?
 	        (uint32_t)(100 * written_lines / tot_lines) : 0);
-	if (slow)
+	if (shards)
+		fprintf(stderr, "%d shards\n", shards);
+	else if (slow)
 		fprintf(stderr, "%d slow passes\n", slow);
 	else
 		fprintf(stderr, "no slow passes\n");
@@ -0,0 +1 @@
+#define JTR_GIT_VERSION JUMBO_VERSION "-8fc6512742" " 2026-10-17 03:01:53 +0000"
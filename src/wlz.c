@@ -0,0 +1,571 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * Compressed wordlist input, see wlz.h.
+ *
+ * John's own format is made by run/wlz.py.  All numbers are little-endian:
+ *
+ *	"JtRwlz\0\1"			8 bytes
+ *	block...			zlib streams, each of whole lines
+ *	per block: csize, usize		64-bit compressed and uncompressed sizes
+ *	count, index offset		64-bit
+ *	"JtRwlz\0\2"			8 bytes
+ *
+ * For .xz, only single-stream files with LZMA2-only blocks are supported,
+ * which is what xz(1) makes by default.  "xz -T0" splits the data in blocks
+ * that can be decompressed in parallel, plain "xz" makes a single block,
+ * which is then decompressed as a stream.  Integrity checks are not verified.
+ */
+
+#if AC_BUILT
+#include "autoconfig.h"
+#endif
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1 /* for fopencookie() */
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include "arch.h"
+#include "jumbo.h"
+#include "misc.h"
+#include "common.h"
+#include "memory.h"
+#include "logger.h"
+#include "john.h"
+#include "lzma/Lzma2Dec.h"
+#include "wlz.h"
+
+#if defined(__GLIBC__)
+#define WLZ_FOPENCOOKIE			1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || \
+	defined(__NetBSD__) || defined(__DragonFly__)
+#define WLZ_FUNOPEN			1
+#endif
+
+#define WLZ_MAGIC			"JtRwlz\0\1"
+#define WLZ_MAGIC_END			"JtRwlz\0\2"
+#define XZ_MAGIC			"\xFD" "7zXZ\0"
+
+/* Blocks larger than this are decompressed as a stream, not in one go */
+#define WLZ_BLOCK_MAX			(64 << 20)
+/* Upper bound on the blocks decompressed at once, all threads together */
+#define WLZ_BATCH_MAX			(256 << 20)
+#define WLZ_WINDOW			(1 << 20)
+#define WLZ_STREAM_IN			(1 << 16)
+
+struct wlz_block {
+	uint64_t coff, csize;		/* compressed data */
+	uint64_t uoff, usize;		/* where it goes in the output */
+	unsigned char prop;		/* LZMA2 dictionary size, for .xz */
+};
+
+struct wlz {
+	FILE *file;
+	const char *name;
+	int xz;
+	int64_t count;
+	struct wlz_block *block;
+	uint64_t size, pos;
+
+/* Small blocks, decompressed a batch at a time */
+	int64_t first;
+	int loaded, slots;
+	unsigned char **data, **cdata;
+
+/* A large block, decompressed as a stream into a window */
+	int64_t stream;
+	CLzma2Dec dec;
+	uint64_t stream_cpos;
+	unsigned char *in;
+	size_t in_pos, in_len;
+	unsigned char *win;
+	uint64_t win_start;
+	size_t win_len;
+};
+
+static void *SzAlloc(ISzAllocPtr p, size_t size) { return mem_alloc(size); }
+static void SzFree(ISzAllocPtr p, void *address) { MEM_FREE(address); }
+static const ISzAlloc g_Alloc = { SzAlloc, SzFree };
+
+static void wlz_fail(struct wlz *w, const char *what)
+{
+	if (john_main_process)
+		fprintf(stderr, "Error: Compressed wordlist %s: %s\n",
+		        w->name, what);
+	error();
+}
+
+static uint64_t get_le(const unsigned char *p, int bytes)
+{
+	uint64_t v = 0;
+
+	while (bytes--)
+		v = (v << 8) | p[bytes];
+
+	return v;
+}
+
+static void read_at(struct wlz *w, uint64_t pos, void *buf, size_t len)
+{
+	if (jtr_fseek64(w->file, pos, SEEK_SET))
+		pexit("fseek");
+	if (len && fread(buf, len, 1, w->file) != 1)
+		wlz_fail(w, ferror(w->file) ? "read error" : "truncated file");
+}
+
+static void wlz_open_jtr(struct wlz *w, uint64_t file_size)
+{
+	unsigned char tail[24], *index;
+	uint64_t i, coff = 8, uoff = 0, index_pos;
+
+	if (file_size < 8 + 24)
+		wlz_fail(w, "truncated file");
+	read_at(w, file_size - 24, tail, 24);
+	if (memcmp(&tail[16], WLZ_MAGIC_END, 8))
+		wlz_fail(w, "bad trailer");
+	w->count = get_le(tail, 8);
+	index_pos = get_le(&tail[8], 8);
+	if (index_pos + w->count * 16 != file_size - 24)
+		wlz_fail(w, "bad index");
+
+	index = mem_alloc(w->count * 16 + 1);
+	read_at(w, index_pos, index, w->count * 16);
+	w->block = mem_calloc(w->count + 1, sizeof(*w->block));
+	for (i = 0; i < w->count; i++) {
+		struct wlz_block *b = &w->block[i];
+
+		b->csize = get_le(&index[i * 16], 8);
+		b->usize = get_le(&index[i * 16 + 8], 8);
+		b->coff = coff;
+		b->uoff = uoff;
+		coff += b->csize;
+		uoff += b->usize;
+		if (coff > index_pos || b->usize > WLZ_BLOCK_MAX)
+			wlz_fail(w, "bad index");
+	}
+	MEM_FREE(index);
+	w->size = uoff;
+}
+
+static int get_varint(const unsigned char **p, const unsigned char *end,
+                      uint64_t *v)
+{
+	int shift = 0;
+
+	*v = 0;
+	while (*p < end && shift < 63) {
+		unsigned char c = *(*p)++;
+
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return 0;
+		shift += 7;
+	}
+
+	return -1;
+}
+
+static void wlz_open_xz(struct wlz *w, uint64_t file_size)
+{
+	static const unsigned char check_size[16] = {
+		0, 4, 4, 4, 8, 8, 8, 16, 16, 16, 32, 32, 32, 64, 64, 64
+	};
+	unsigned char head[12], foot[12], *index, bh[1024];
+	const unsigned char *p, *end;
+	uint64_t index_size, index_pos, n, i, pos = 12, uoff = 0;
+	unsigned int check;
+
+	read_at(w, 0, head, 12);
+	if (head[6] || head[7] > 15)
+		wlz_fail(w, "unsupported .xz flags");
+	check = check_size[head[7]];
+
+/* Skip stream padding */
+	while (file_size > 24) {
+		read_at(w, file_size - 4, foot, 4);
+		if (get_le(foot, 4))
+			break;
+		file_size -= 4;
+	}
+	read_at(w, file_size - 12, foot, 12);
+	if (memcmp(&foot[10], "YZ", 2) || memcmp(&foot[8], &head[6], 2))
+		wlz_fail(w, "bad .xz stream footer");
+	index_size = (get_le(&foot[4], 4) + 1) * 4;
+	if (index_size > file_size - 24)
+		wlz_fail(w, "bad .xz index");
+	index_pos = file_size - 12 - index_size;
+
+	index = mem_alloc(index_size);
+	read_at(w, index_pos, index, index_size);
+	p = index + 1;
+	end = index + index_size - 4;
+	if (index[0] || get_varint(&p, end, &n) || n > index_size)
+		wlz_fail(w, "bad .xz index");
+
+	w->count = n;
+	w->block = mem_calloc(n + 1, sizeof(*w->block));
+	for (i = 0; i < n; i++) {
+		struct wlz_block *b = &w->block[i];
+		uint64_t unpadded, usize, hsize, filters, id, psize;
+		const unsigned char *q, *qend;
+
+		if (get_varint(&p, end, &unpadded) ||
+		    get_varint(&p, end, &usize))
+			wlz_fail(w, "bad .xz index");
+
+/* Read the block header for the filter properties */
+		read_at(w, pos, bh, 1);
+		hsize = (bh[0] + 1) * 4;
+		if (!bh[0] || hsize > sizeof(bh) || unpadded < hsize + check)
+			wlz_fail(w, "bad .xz block header");
+		read_at(w, pos, bh, hsize);
+		q = bh + 2;
+		qend = bh + hsize - 4;
+		filters = (bh[1] & 3) + 1;
+		if ((bh[1] & 0x40) && get_varint(&q, qend, &id))
+			wlz_fail(w, "bad .xz block header");
+		if ((bh[1] & 0x80) && get_varint(&q, qend, &id))
+			wlz_fail(w, "bad .xz block header");
+		if (filters != 1 || get_varint(&q, qend, &id) ||
+		    get_varint(&q, qend, &psize) || id != 0x21 || psize != 1 ||
+		    q >= qend || *q > 40)
+			wlz_fail(w, "only LZMA2 compressed .xz files are supported");
+
+		b->prop = *q;
+		b->coff = pos + hsize;
+		b->csize = unpadded - hsize - check;
+		b->uoff = uoff;
+		b->usize = usize;
+		pos += (unpadded + 3) & ~(uint64_t)3;
+		uoff += usize;
+	}
+	MEM_FREE(index);
+
+	if (pos != index_pos)
+		wlz_fail(w, "multi-stream .xz files are not supported");
+	w->size = uoff;
+}
+
+static int wlz_decode(struct wlz *w, struct wlz_block *b,
+                      unsigned char *dst, const unsigned char *src)
+{
+	if (w->xz) {
+		CLzma2Dec dec;
+		ELzmaStatus status;
+		SizeT dlen = b->usize, slen = b->csize;
+		int ok;
+
+		Lzma2Dec_Construct(&dec);
+		if (Lzma2Dec_Allocate(&dec, b->prop, &g_Alloc) != SZ_OK)
+			return 0;
+		Lzma2Dec_Init(&dec);
+		ok = Lzma2Dec_DecodeToBuf(&dec, dst, &dlen, src, &slen,
+		                          LZMA_FINISH_END, &status) == SZ_OK &&
+			dlen == b->usize;
+		Lzma2Dec_Free(&dec, &g_Alloc);
+		return ok;
+	}
+#if HAVE_LIBZ
+	{
+		uLongf dlen = b->usize;
+
+		return uncompress(dst, &dlen, src, b->csize) == Z_OK &&
+			dlen == b->usize;
+	}
+#else
+	return 0;
+#endif
+}
+
+/* Decompresses blocks from n on, as many as there are threads */
+static void wlz_load(struct wlz *w, int64_t n)
+{
+	uint64_t total = 0;
+	int i, bad = 0;
+
+	for (i = 0; i < w->slots && n + i < w->count; i++) {
+		struct wlz_block *b = &w->block[n + i];
+
+		if (b->usize > WLZ_BLOCK_MAX ||
+		    (i && total + b->usize > WLZ_BATCH_MAX))
+			break;
+		total += b->usize;
+		w->data[i] = mem_realloc(w->data[i], b->usize + 1);
+		w->cdata[i] = mem_realloc(w->cdata[i], b->csize + 1);
+		read_at(w, b->coff, w->cdata[i], b->csize);
+	}
+	w->first = n;
+	w->loaded = i;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(|:bad)
+#endif
+	for (i = 0; i < w->loaded; i++)
+		bad |= !wlz_decode(w, &w->block[n + i], w->data[i], w->cdata[i]);
+
+	if (bad)
+		wlz_fail(w, "corrupt data");
+}
+
+/* Moves the stream decoder's window forward to (or back to and then to) pos */
+static void wlz_stream_to(struct wlz *w, int64_t n, uint64_t pos)
+{
+	struct wlz_block *b = &w->block[n];
+
+	if (w->stream != n || pos < w->win_start) {
+		if (w->stream >= 0)
+			Lzma2Dec_Free(&w->dec, &g_Alloc);
+		Lzma2Dec_Construct(&w->dec);
+		if (Lzma2Dec_Allocate(&w->dec, b->prop, &g_Alloc) != SZ_OK)
+			wlz_fail(w, "out of memory");
+		Lzma2Dec_Init(&w->dec);
+		if (!w->win) {
+			w->win = mem_alloc(WLZ_WINDOW);
+			w->in = mem_alloc(WLZ_STREAM_IN);
+		}
+		w->stream = n;
+		w->stream_cpos = 0;
+		w->in_pos = w->in_len = 0;
+		w->win_start = b->uoff;
+		w->win_len = 0;
+	}
+
+	while (pos >= w->win_start + w->win_len) {
+		w->win_start += w->win_len;
+		w->win_len = 0;
+		while (w->win_len < WLZ_WINDOW &&
+		       w->win_start + w->win_len < b->uoff + b->usize) {
+			ELzmaStatus status;
+			SizeT dlen = WLZ_WINDOW - w->win_len;
+			SizeT slen;
+
+			if (w->in_pos == w->in_len) {
+				w->in_len = MIN(WLZ_STREAM_IN,
+				                b->csize - w->stream_cpos);
+				if (!w->in_len)
+					wlz_fail(w, "corrupt data");
+				read_at(w, b->coff + w->stream_cpos, w->in,
+				        w->in_len);
+				w->stream_cpos += w->in_len;
+				w->in_pos = 0;
+			}
+			slen = w->in_len - w->in_pos;
+			if (Lzma2Dec_DecodeToBuf(&w->dec, &w->win[w->win_len],
+			                         &dlen, &w->in[w->in_pos],
+			                         &slen, LZMA_FINISH_ANY,
+			                         &status) != SZ_OK)
+				wlz_fail(w, "corrupt data");
+			w->in_pos += slen;
+			w->win_len += dlen;
+			if (!dlen && !slen)
+				wlz_fail(w, "corrupt data");
+		}
+		if (!w->win_len)
+			wlz_fail(w, "corrupt data");
+	}
+}
+
+static int64_t wlz_find(struct wlz *w, uint64_t pos)
+{
+	int64_t lo = 0, hi = w->count - 1;
+
+	while (lo < hi) {
+		int64_t mid = lo + (hi - lo + 1) / 2;
+
+		if (w->block[mid].uoff <= pos)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return lo;
+}
+
+static size_t wlz_read(struct wlz *w, char *buf, size_t size)
+{
+	size_t done = 0;
+
+	while (done < size && w->pos < w->size) {
+		int64_t n = wlz_find(w, w->pos);
+		struct wlz_block *b = &w->block[n];
+		const unsigned char *src;
+		uint64_t avail;
+
+		if (b->usize > WLZ_BLOCK_MAX) {
+			wlz_stream_to(w, n, w->pos);
+			src = &w->win[w->pos - w->win_start];
+			avail = w->win_start + w->win_len - w->pos;
+		} else {
+			if (n < w->first || n >= w->first + w->loaded)
+				wlz_load(w, n);
+			src = &w->data[n - w->first][w->pos - b->uoff];
+			avail = b->uoff + b->usize - w->pos;
+		}
+		if (avail > size - done)
+			avail = size - done;
+		memcpy(buf + done, src, avail);
+		done += avail;
+		w->pos += avail;
+	}
+
+	return done;
+}
+
+static int wlz_seek(struct wlz *w, int64_t *offset, int whence)
+{
+	int64_t pos = *offset;
+
+	if (whence == SEEK_CUR)
+		pos += w->pos;
+	else if (whence == SEEK_END)
+		pos += w->size;
+	if (pos < 0)
+		return -1;
+
+	*offset = w->pos = pos;
+	return 0;
+}
+
+static int wlz_close(struct wlz *w)
+{
+	int i, ret = fclose(w->file);
+
+	if (w->stream >= 0)
+		Lzma2Dec_Free(&w->dec, &g_Alloc);
+	for (i = 0; i < w->slots; i++) {
+		MEM_FREE(w->data[i]);
+		MEM_FREE(w->cdata[i]);
+	}
+	MEM_FREE(w->data);
+	MEM_FREE(w->cdata);
+	MEM_FREE(w->win);
+	MEM_FREE(w->in);
+	MEM_FREE(w->block);
+	MEM_FREE(w);
+
+	return ret;
+}
+
+#if WLZ_FOPENCOOKIE
+static ssize_t cookie_read(void *cookie, char *buf, size_t size)
+{
+	return wlz_read(cookie, buf, size);
+}
+
+static int cookie_seek(void *cookie, off64_t *offset, int whence)
+{
+	int64_t pos = *offset;
+	int ret = wlz_seek(cookie, &pos, whence);
+
+	*offset = pos;
+	return ret;
+}
+
+static int cookie_close(void *cookie)
+{
+	return wlz_close(cookie);
+}
+#elif WLZ_FUNOPEN
+static int cookie_read(void *cookie, char *buf, int size)
+{
+	return wlz_read(cookie, buf, size);
+}
+
+static fpos_t cookie_seek(void *cookie, fpos_t offset, int whence)
+{
+	int64_t pos = offset;
+
+	return wlz_seek(cookie, &pos, whence) ? -1 : pos;
+}
+
+static int cookie_close(void *cookie)
+{
+	return wlz_close(cookie);
+}
+#endif
+
+int wlz_probe(FILE *file)
+{
+	char magic[8];
+	int ret;
+
+	ret = fread(magic, 1, 8, file) == 8 &&
+		(!memcmp(magic, WLZ_MAGIC, 8) || !memcmp(magic, XZ_MAGIC, 6));
+	if (jtr_fseek64(file, 0, SEEK_SET))
+		pexit("fseek");
+
+	return ret;
+}
+
+FILE *wlz_open(FILE *file, const char *name)
+{
+	struct wlz *w = mem_calloc(1, sizeof(*w));
+	char magic[8];
+	int64_t file_size;
+	FILE *stream = NULL;
+
+	w->file = file;
+	w->name = name;
+	w->stream = -1;
+
+	if (fread(magic, 1, 8, file) != 8 ||
+	    jtr_fseek64(file, 0, SEEK_END) ||
+	    (file_size = jtr_ftell64(file)) < 0)
+		wlz_fail(w, "read error");
+
+	if ((w->xz = !memcmp(magic, XZ_MAGIC, 6))) {
+		wlz_open_xz(w, file_size);
+	} else {
+#if !HAVE_LIBZ
+		wlz_fail(w, "this build has no zlib support");
+#endif
+		wlz_open_jtr(w, file_size);
+	}
+
+#ifdef _OPENMP
+	w->slots = omp_get_max_threads();
+#else
+	w->slots = 1;
+#endif
+	w->data = mem_calloc(w->slots, sizeof(*w->data));
+	w->cdata = mem_calloc(w->slots, sizeof(*w->cdata));
+
+#if WLZ_FOPENCOOKIE
+	{
+		cookie_io_functions_t io = {
+			cookie_read, NULL, cookie_seek, cookie_close
+		};
+
+		stream = fopencookie(w, "rb", io);
+	}
+#elif WLZ_FUNOPEN
+	stream = funopen(w, cookie_read, NULL, cookie_seek, cookie_close);
+#else
+	wlz_fail(w, "not supported on this platform");
+#endif
+	if (!stream)
+		pexit("fopencookie");
+	setvbuf(stream, NULL, _IOFBF, WLZ_WINDOW);
+
+	log_event("- Compressed (%s) wordlist: %"PRId64" blocks, "
+	          "%"PRIu64" bytes uncompressed",
+	          w->xz ? "xz" : "JtR", w->count, w->size);
+
+	return stream;
+}
@@ -0,0 +1,33 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ */
+
+/*
+ * Compressed wordlists: .xz files (decoded with the bundled lzma/ code) and
+ * John's own block-compressed format (see run/wlz.py), read through a
+ * seekable stdio stream so that wordlist mode sees a plain file.
+ */
+
+#ifndef _JOHN_WLZ_H
+#define _JOHN_WLZ_H
+
+#include <stdio.h>
+
+/*
+ * Returns non-zero if file, which must be at offset 0, looks like a
+ * compressed wordlist.  Leaves the file at offset 0.
+ */
+extern int wlz_probe(FILE *file);
+
+/*
+ * Returns a read-only stream of the uncompressed contents of file, which it
+ * takes over (closing the stream closes the file).  Seeking works, so does
+ * ftell(), and SEEK_END gives the uncompressed size.  Blocks are decompressed
+ * in parallel when built with OpenMP.  Errors out on unsupported files.
+ */
+extern FILE *wlz_open(FILE *file, const char *name);
+
+#endif
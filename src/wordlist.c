@@ -49,6 +49,9 @@
 
 #include <errno.h>
 #include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "arch.h"
 #include "mem_map.h"
@@ -75,6 +78,10 @@
 #include "mask.h"
 #include "pseudo_intrinsics.h"
 #include "mgetl.h"
+#include "wlz.h"
+#include "rulestats.h"
+#include "workq.h"
+#include "timer.h"
 
 static int dist_rules;
 
@@ -99,6 +106,183 @@ static int64_t nWordFileLines;
 
 static int file_is_fifo;
 
+/*
+ * With --rules-word-major, the active rules are loaded once, and applied to
+ * each word in turn.  rule_number is then the number of the next rule for the
+ * current word, line_number is that word's (so we resume at a word, not after
+ * it) and word_pos is where its line starts, for fix_state().
+ */
+struct word_major_rule {
+	int number;		/* rule number, as counted by rpp_next() */
+	int hc_logic;		/* for rules_apply() */
+	char *rule;		/* as returned by rules_reject() */
+	struct rules_prog *prog;	/* or NULL if it can't be compiled */
+};
+
+static int word_major;
+static struct word_major_rule *wm_rules;
+static int wm_count;
+static int64_t word_pos;
+
+/*
+ * With --work-stealing, the words of a rule (or of word major mode, as rule 0)
+ * are taken by the --fork processes in blocks of this many lines, after the
+ * reassembled LM halves in blocks of as many.  Whole rules, when those are
+ * distributed, are units of their own.
+ */
+#define WORDLIST_STEAL_LINES		1024
+
+static MAYBE_INLINE int steal_skip(int rule, int lmloop, int64_t n)
+{
+	return !workq_mine((uint64_t)rule << 32 | (lmloop ? 0 : 1U << 31) |
+	                   (uint64_t)(n / WORDLIST_STEAL_LINES));
+}
+
+/*
+ * Optional line index (WordlistIndex in john.conf) kept in a file next to the
+ * wordlist: the offset of every WORDLIST_INDEX_LINES'th line, so skip_lines()
+ * (as used when restoring a session) can seek close to its target instead of
+ * reading every line before it.  It is extended as lines are read, and only
+ * trusted while the wordlist's size and mtime, and the way it is read (mgetl()
+ * and fgetl() differ on overlong lines), stay the same.
+ */
+#define WORDLIST_INDEX_LINES		0x100000
+#define WORDLIST_INDEX_SUFFIX		".jtr-index"
+
+struct wordlist_index_header {
+	char magic[16];
+	uint64_t order;		/* 0x0102030405060708, in host byte order */
+	int64_t size, mtime;
+	int64_t lines;		/* WORDLIST_INDEX_LINES */
+	int64_t mapped;		/* read with mgetl() */
+	int64_t count;
+};
+
+static struct {
+	char *name;
+	struct wordlist_index_header header;
+	int64_t *pos;		/* where line (n + 1) * lines starts */
+	int64_t alloc, saved, next;
+} idx;
+
+static void idx_init(const char *name)
+{
+	struct wordlist_index_header *h = &idx.header;
+	struct stat st;
+	FILE *file;
+
+	if (!cfg_get_bool(SECTION_OPTIONS, NULL, "WordlistIndex", 0))
+		return;
+
+/* The file we opened, for "$JOHN/" or "~/" names */
+	name = path_expand(name);
+	if (stat(name, &st))
+		return;
+
+	idx.name = mem_alloc(strlen(name) + sizeof(WORDLIST_INDEX_SUFFIX));
+	strcpy(idx.name, name);
+	strcat(idx.name, WORDLIST_INDEX_SUFFIX);
+
+	if ((file = fopen(idx.name, "rb"))) {
+		if (fread(h, sizeof(*h), 1, file) == 1 &&
+		    !strcmp(h->magic, "JtR-wl-index-1") &&
+		    h->order == 0x0102030405060708ULL &&
+		    h->size == st.st_size && h->mtime == st.st_mtime &&
+		    h->lines == WORDLIST_INDEX_LINES &&
+		    h->mapped == (mem_map != NULL) &&
+		    h->count > 0 && h->count <= h->size / h->lines + 1) {
+			idx.pos = mem_alloc(h->count * sizeof(*idx.pos));
+			if (fread(idx.pos, sizeof(*idx.pos), h->count, file) ==
+			    h->count) {
+				idx.alloc = idx.saved = h->count;
+				log_event("- Using line index %.100s "
+				          "(%"PRId64" lines)", idx.name,
+				          h->count * h->lines);
+			} else
+				MEM_FREE(idx.pos);
+		}
+		fclose(file);
+	}
+
+	if (!idx.pos) {
+		memset(h, 0, sizeof(*h));
+		strcpy(h->magic, "JtR-wl-index-1");
+		h->order = 0x0102030405060708ULL;
+		h->size = st.st_size;
+		h->mtime = st.st_mtime;
+		h->lines = WORDLIST_INDEX_LINES;
+		h->mapped = (mem_map != NULL);
+	}
+	idx.next = (h->count + 1) * h->lines;
+}
+
+/* Notes where the next line, which will be line number n, starts */
+static void idx_add(int64_t n)
+{
+	int64_t pos = mem_map ? map_pos - mem_map : jtr_ftell64(word_file);
+
+	if (pos < 0)
+		return;
+	if (idx.header.count >= idx.alloc) {
+		idx.alloc = idx.alloc ? 2 * idx.alloc : 1024;
+		idx.pos = mem_realloc(idx.pos, idx.alloc * sizeof(*idx.pos));
+	}
+	idx.pos[idx.header.count++] = pos;
+	idx.next = n + idx.header.lines;
+}
+
+#define idx_note(n)	  \
+	do { if (idx.name && (n) == idx.next) idx_add(n); } while (0)
+
+/* Seeks to the last indexed line after from and up to to, returns its number */
+static int64_t idx_seek(int64_t from, int64_t to)
+{
+	int64_t n;
+
+	if (!idx.name || !(n = MIN(to / idx.header.lines, idx.header.count)) ||
+	    n * idx.header.lines <= from)
+		return from;
+
+	if (mem_map)
+		map_pos = mem_map + idx.pos[n - 1];
+	else if (jtr_fseek64(word_file, idx.pos[n - 1], SEEK_SET))
+		pexit(STR_MACRO(jtr_fseek64));
+
+	return n * idx.header.lines;
+}
+
+static void idx_save(void)
+{
+	FILE *file;
+
+	if (!idx.name || idx.header.count <= idx.saved)
+		return;
+
+	if (!(file = fopen(idx.name, "wb")) ||
+	    fwrite(&idx.header, sizeof(idx.header), 1, file) != 1 ||
+	    fwrite(idx.pos, sizeof(*idx.pos), idx.header.count, file) !=
+	    idx.header.count || fclose(file)) {
+		log_event("! Could not write line index %.100s: %s",
+		          idx.name, strerror(errno));
+		if (file)
+			remove(idx.name);
+		MEM_FREE(idx.name);
+		return;
+	}
+
+	log_event("- Saved line index %.100s (%"PRId64" lines)",
+	          idx.name, idx.header.count * idx.header.lines);
+	idx.saved = idx.header.count;
+}
+
+static void idx_done(void)
+{
+	idx_save();
+	MEM_FREE(idx.name);
+	MEM_FREE(idx.pos);
+	idx.alloc = idx.saved = idx.header.count = 0;
+}
+
 static void save_state(FILE *file)
 {
 	fprintf(file, "%d\n%" PRId64 "\n%" PRId64 "\n",
@@ -121,13 +305,19 @@ static int restore_rule_number(void)
 static MAYBE_INLINE int skip_lines(int64_t n, char *line)
 {
 	if (n) {
+		int64_t current = line_number;
+
 		line_number += n;
 
-		if (!nWordFileLines)
-		do {
-			if (!GET_LINE(line, word_file))
-				return 1;
-		} while (--n);
+		if (!nWordFileLines) {
+			current = idx_seek(current, line_number);
+			while (current < line_number) {
+				if (!GET_LINE(line, word_file))
+					return 1;
+				current++;
+				idx_note(current);
+			}
+		}
 	}
 
 	return 0;
@@ -192,12 +382,10 @@ static int restore_state(FILE *file)
 			rec_pos = 0;
 		} else if (rec_line && !rec_pos) {
 			/* from mem_map build does not have rec_pos */
-			int64_t i = rec_line;
 			char line[LINE_BUFFER_SIZE];
 			jtr_fseek64(word_file, 0, SEEK_SET);
-			while (i--)
-				if (!fgetl(line, sizeof(line), word_file))
-					pexit(STR_MACRO(jtr_fseek64));
+			if (skip_lines(rec_line, line))
+				pexit(STR_MACRO(jtr_fseek64));
 			rec_pos = jtr_ftell64(word_file);
 		} else
 		if (jtr_fseek64(word_file, rec_pos, SEEK_SET))
@@ -212,6 +400,8 @@ static int restore_state(FILE *file)
 
 static void fix_state(void)
 {
+	workq_fix_state();
+
 	if (hybrid_rec_rule || hybrid_rec_line || hybrid_rec_pos) {
 		rec_rule = hybrid_rec_rule;
 		rec_line = hybrid_rec_line;
@@ -227,6 +417,12 @@ static void fix_state(void)
 	rec_rule = rule_number;
 	rec_line = line_number;
 
+	if (word_major) {
+		rec_pos = (word_file == stdin || file_is_fifo) ? line_number :
+			word_pos;
+		return;
+	}
+
 	if (word_file == stdin || file_is_fifo)
 		rec_pos = line_number;
 	else
@@ -262,7 +458,6 @@ void wordlist_hybrid_fix_state(void)
 
 static double get_progress(void)
 {
-	struct stat file_stat;
 	int64_t pos;
 	uint64_t size;
 	uint64_t mask_mult = mask_tot_cand ? mask_tot_cand : 1;
@@ -275,15 +470,17 @@ static double get_progress(void)
 	if (!word_file || word_file == stdin || file_is_fifo)
 		return -1;
 
-	if (nWordFileLines) {
+	if (nWordFileLines && word_major) {
+		pos = line_number * rule_count + rule_number;
+		size = nWordFileLines * rule_count;
+		return 100.0 * pos / size;
+	} else if (nWordFileLines) {
 		pos = line_number;
 		size = nWordFileLines;
 	} else if (mem_map) {
 		pos = map_pos - mem_map;
 		size = map_end - mem_map;
 	} else {
-		if (fstat(fileno(word_file), &file_stat))
-			pexit("fstat");
 		pos = jtr_ftell64(word_file);
 		jtr_fseek64(word_file, 0, SEEK_END);
 		size = jtr_ftell64(word_file);
@@ -299,6 +496,9 @@ static double get_progress(void)
 		}
 	}
 
+	if (word_major)
+		return 100.0 * pos / size;
+
 	return (100.0 * ((rule_number * size * mask_mult) + pos * mask_mult) /
 	        (rule_count * size * mask_mult));
 }
@@ -308,6 +508,22 @@ static char *dummy_rules_apply(char *word, char *rule, int split, char *last)
 	return word;
 }
 
+/*
+ * The current rule as compiled by rules_compile(), if CompileRules is enabled.
+ */
+static struct rules_prog *rule_prog;
+
+/*
+ * What rules_optimize() found about each rule, if OptimizeRules is enabled.
+ */
+static int *rule_same;
+
+static char *compiled_rules_apply(char *word, char *rule, int split,
+                                  char *last)
+{
+	return rules_apply_compiled(word, rule_prog, last);
+}
+
 /*
  * There should be legislation against adding a BOM to UTF-8, not to
  * mention calling UTF-16 a "text file".
@@ -375,6 +591,154 @@ static MAYBE_INLINE char *convert(char *line)
 	return line;
 }
 
+static void wm_done(void)
+{
+	while (wm_count--) {
+		MEM_FREE(wm_rules[wm_count].rule);
+		MEM_FREE(wm_rules[wm_count].prog);
+	}
+	wm_count = 0;
+	MEM_FREE(wm_rules);
+}
+
+/*
+ * Loads the rules of context start that wordlist mode would accept (and that
+ * rules_optimize() didn't find useless) for --rules-word-major.
+ */
+static void wm_load(struct rpp_context *start, struct db_main *db)
+{
+	extern int hc_logic;
+	struct rpp_context ctx;
+	int saved_hc_logic = hc_logic, number = 0;
+	char *prerule;
+
+	wm_done();
+	wm_rules = mem_alloc(rule_count * sizeof(*wm_rules));
+
+	memcpy(&ctx, start, sizeof(ctx));
+	while (number < rule_count && (prerule = rpp_next(&ctx))) {
+		struct word_major_rule *wm = &wm_rules[wm_count];
+		char *rule;
+
+		number++;
+		if (rule_same && rule_same[number - 1])
+			continue;
+		if (!(rule = rules_reject(prerule, -1, NULL, db))) {
+			if (!rules_mute && strncmp(prerule, "!!", 2))
+				log_event("- Rule #%d: '%.100s' rejected",
+				          number, prerule);
+			continue;
+		}
+		if (!rules_mute)
+			log_event("- Rule #%d: '%.100s' accepted as '%.100s'",
+			          number, prerule, rule);
+
+		wm->number = number - 1;
+		wm->hc_logic = hc_logic;
+		wm->rule = strcpy(mem_alloc(strlen(rule) + 1), rule);
+		wm->prog = NULL;
+		if (rule_prog && rules_compile(rule, rule_prog))
+			wm->prog = rules_prog_dup(rule_prog);
+		wm_count++;
+	}
+
+	hc_logic = saved_hc_logic;
+
+	log_event("- Applying %d rules to each word in turn", wm_count);
+}
+
+/*
+ * The --rules-word-major counterpart of the per-rule loops in
+ * do_wordlist_crack(): reads the words once, from memory or from the file,
+ * and feeds the candidates of all rules for a word to the cracker before
+ * reading the next.  Returns non-zero if the cracker asked us to stop.
+ */
+static int wm_crack(char *line, char **last_p, int skip_nodes, int conv)
+{
+	extern int hc_logic;
+	char *last = *last_p;
+	int first = 0, abort = 0;
+
+/* A restored session resumes at rule_number, for the word at line_number */
+	while (first < wm_count && wm_rules[first].number < rule_number)
+		first++;
+
+	for (;;) {
+		int i;
+
+		if (nWordFileLines) {
+			if (line_number >= nWordFileLines)
+				break;
+#if ARCH_ALLOWS_UNALIGNED
+			line = words[line_number];
+#else
+			strcpy(line, words[line_number]);
+#endif
+		} else {
+			idx_note(line_number);
+			if (word_file == stdin || file_is_fifo)
+				word_pos = line_number;
+			else if (mem_map)
+				word_pos = map_pos - mem_map;
+			else if ((word_pos = jtr_ftell64(word_file)) < 0)
+				pexit(STR_MACRO(jtr_ftell64));
+			if (!GET_LINE(line, word_file))
+				break;
+			check_bom(line);
+			if (!strncmp(line, "#!comment", 9)) {
+				line_number++;
+				continue;
+			}
+			if (conv) {
+				char *conv_line = convert(line);
+				memmove(line, conv_line, strlen(conv_line) + 1);
+			}
+		}
+
+		if (skip_nodes) {
+			int for_node = line_number % options.node_count + 1;
+			if (workq_active() ? steal_skip(0, 0, line_number) :
+			    for_node < options.node_min ||
+			    for_node > options.node_max) {
+				line_number++;
+				continue;
+			}
+		}
+
+		suppressor_new_word();
+		for (i = first; i < wm_count; i++) {
+			struct word_major_rule *wm = &wm_rules[i];
+			char *word;
+
+			rule_number = wm->number + 1;
+			if (wm->prog) {
+				word = rules_apply_compiled(line, wm->prog, last);
+			} else {
+				hc_logic = wm->hc_logic;
+				word = rules_apply(line, wm->rule, -1, last);
+			}
+			if (!word)
+				continue;
+			last = word;
+			if (suppressor_word_dupe(word))
+				continue;
+			if (ext_filter(word) && crk_process_key(word)) {
+				abort = 1;
+				break;
+			}
+		}
+		if (abort)
+			break;
+
+		first = 0;
+		rule_number = 0;
+		line_number++;
+	}
+
+	*last_p = last;
+	return abort;
+}
+
 static unsigned int hash_log, hash_size, hash_mask;
 #define ENTRY_END_HASH	0xFFFFFFFF
 #define ENTRY_END_LIST	0xFFFFFFFE
@@ -456,6 +820,437 @@ static MAYBE_INLINE int wbuf_unique(char *line)
 	return 1;
 }
 
+/* Number of '\n', '\r' and NUL bytes, ie. an upper bound on lines */
+static int64_t count_eol(const char *p, const char *end, int64_t *lf)
+{
+	int64_t eol = 0, nl = 0;
+#if MGETL_HAS_SIMD
+	const vtype vnl = vset1_epi8('\n');
+	const vtype vcr = vset1_epi8('\r');
+	const vtype vnul = vsetzero();
+
+	while (p + VSCANSZ <= end) {
+		vtype x = vloadu((vtype const *)p);
+		uint64_t n = vcmpeq_epi8_mask(vnl, x);
+
+		nl += __builtin_popcountll(n);
+		eol += __builtin_popcountll(n | vcmpeq_epi8_mask(vcr, x) |
+		                            vcmpeq_epi8_mask(vnul, x));
+		p += VSCANSZ;
+	}
+#endif
+	while (p < end) {
+		nl += (*p == '\n');
+		eol += (*p == '\n' || *p == '\r' || !*p);
+		p++;
+	}
+
+	*lf = nl;
+	return eol;
+}
+
+static MAYBE_INLINE char *find_eol(char *p, char *end)
+{
+#if MGETL_HAS_SIMD
+	const vtype vnl = vset1_epi8('\n');
+	const vtype vcr = vset1_epi8('\r');
+	const vtype vnul = vsetzero();
+
+	while (p + VSCANSZ <= end) {
+		vtype x = vloadu((vtype const *)p);
+		uint64_t v = vcmpeq_epi8_mask(vnl, x) |
+			vcmpeq_epi8_mask(vcr, x) | vcmpeq_epi8_mask(vnul, x);
+
+		if (v)
+			return p + __builtin_ctzll(v);
+		p += VSCANSZ;
+	}
+#endif
+	while (p < end && *p && *p != '\n' && *p != '\r')
+		p++;
+
+	return p;
+}
+
+/*
+ * Splits cp up to end into out[], returning the number of words kept.  This
+ * is how all wordlists loaded to memory are split, by one thread or many.
+ */
+static int64_t index_chunk(char *cp, char *end, char **out, int rules,
+                           int loopBack, int conv)
+{
+	int min_length = options.eff_minlength;
+	int skip_length = options.force_maxlength;
+	int64_t n = 0;
+
+	while (cp < end) {
+		char *ep = find_eol(cp, end);
+		char ec = *ep;
+
+		*ep = 0;
+		if (conv) {
+			if (((unsigned char*)cp)[0] >= 0xef) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+				check_bom(cp);
+			}
+			cp = convert(cp);
+		}
+		if (strncmp(cp, "#!comment", 9)) {
+			if (!rules) {
+				if (min_length && ep - cp < min_length)
+					goto skip;
+				if (skip_length && ep - cp > skip_length)
+					goto skip;
+				if (ep - cp >= length)
+					cp[length] = 0;
+			} else
+				if (ep - cp >= LINE_BUFFER_SIZE)
+					cp[LINE_BUFFER_SIZE-1] = 0;
+			if (loopBack || !n || strcmp(cp, out[n - 1]))
+				out[n++] = cp;
+		}
+skip:
+		cp = ep + 1;
+		if (ec == '\r' && *cp == '\n') cp++;
+		if (ec == '\n' && *cp == '\r') cp++;
+	}
+
+	return n;
+}
+
+/*
+ * Number of lines as the single-threaded loop used to count them, for the
+ * log: the LFs, or the CRs if there are none, and a last line without.
+ */
+static int64_t count_lines(int64_t eol, int64_t lf, char *aep)
+{
+	if (lf)
+		return lf + (aep[-1] != '\n');
+	return eol + (aep[-1] != '\r' && aep[-1]);
+}
+
+/*
+ * Splits a wordlist loaded to memory into words[] with one thread, setting
+ * nWordFileLines and returning the number of words kept.
+ */
+static int64_t seq_index(char *start, char *aep, int rules, int loopBack,
+                         int conv)
+{
+	int64_t eol, lf, i;
+
+	eol = count_eol(start, aep, &lf);
+	nWordFileLines = count_lines(eol, lf, aep);
+	words = mem_alloc((eol + 2) * sizeof(char*));
+	log_event("- wordfile had %"PRId64" lines and required %"PRId64
+	          " bytes for index.",
+	          (int64_t)nWordFileLines,
+	          (int64_t)(nWordFileLines * sizeof(char*)));
+
+	if (lf)
+		while (*start == '\r')
+			start++;
+	i = index_chunk(start, aep, words, rules, loopBack, conv);
+
+	if (loopBack) {
+		int64_t n, j;
+
+		hash_log = 1;
+		while (((1 << hash_log) < i) && hash_log < 27)
+			hash_log++;
+		hash_size = (1 << hash_log);
+		hash_mask = (hash_size - 1);
+		log_event("- dupe suppression: hash size %u, "
+		          "temporarily allocating %"PRId64" bytes",
+		          hash_size, (hash_size * sizeof(unsigned int)) +
+		          ((int64_t)i * sizeof(element_st)));
+		buffer.hash = mem_alloc(hash_size * sizeof(unsigned int));
+		buffer.data = mem_alloc(i * sizeof(element_st));
+		memset(buffer.hash, 0xff, hash_size * sizeof(unsigned int));
+		/* Full suppression of dupes after truncation */
+		for (n = j = 0; n < i; n++)
+			if (wbuf_unique(words[n]))
+				words[j++] = words[n];
+		i = j;
+	}
+
+	return i;
+}
+
+#ifdef _OPENMP
+/*
+ * Parallel candidate generation.  When rules are applied to a wordlist held
+ * in memory, each OpenMP thread applies the current rule to its share of a
+ * block of words, filling a fixed-stride key buffer.  The main thread then
+ * feeds that block to the cracker in the original order, so the candidate
+ * stream, and thus line_number as recorded by fix_state(), is exactly what
+ * the single-threaded loop would produce.
+ */
+#define PAR_KEYS_PER_THREAD		0x400
+#define PAR_KEY_SIZE			(PLAINTEXT_BUFFER_SIZE + ARCH_SIZE)
+
+static int par_threads, par_block;
+static char *par_keys, *par_ok;
+
+static void par_init(void)
+{
+	if (par_keys)
+		return;
+
+	par_threads = cfg_get_int(SECTION_OPTIONS, NULL, "WordlistRulesThreads");
+	if (par_threads <= 0 || par_threads > omp_get_max_threads())
+		par_threads = omp_get_max_threads();
+	if (par_threads < 2) {
+		par_threads = 0;
+		return;
+	}
+
+	par_block = par_threads * PAR_KEYS_PER_THREAD;
+	par_keys = mem_alloc((size_t)par_block * PAR_KEY_SIZE);
+	par_ok = mem_alloc(par_block);
+
+	log_event("- Applying rules using %d threads", par_threads);
+}
+
+static void par_done(void)
+{
+	MEM_FREE(par_keys);
+	MEM_FREE(par_ok);
+	par_threads = 0;
+}
+
+/*
+ * Whether line n is some other node's, with --node and rules applied to the
+ * whole wordlist.
+ */
+static MAYBE_INLINE int par_skip(int64_t n)
+{
+	int for_node = n % options.node_count + 1;
+
+	return for_node < options.node_min || for_node > options.node_max;
+}
+
+/*
+ * Applies rule (or prog, if it was compiled) to words[start] up to (not
+ * including) words[end], skipping other nodes' lines if skip_nodes is set.
+ * Results are left in par_keys[] with par_ok[] telling which ones were
+ * accepted.  Compiled rules go through rules_apply_block(), so par_ok[] is
+ * already clear for repeats within each RULES_BLOCK_WORDS words.
+ */
+static void par_apply(char *rule, const struct rules_prog *prog,
+                      int64_t start, int64_t end, int skip_nodes)
+{
+#pragma omp parallel num_threads(par_threads)
+	{
+		int64_t n;
+#if !ARCH_ALLOWS_UNALIGNED
+		union {
+			char buffer[LINE_BUFFER_SIZE];
+			ARCH_WORD dummy;
+		} aligned;
+#endif
+
+		rules_init_thread();
+
+		if (prog) {
+#pragma omp for schedule(static)
+			for (n = start; n < end; n += RULES_BLOCK_WORDS) {
+				char *block[RULES_BLOCK_WORDS];
+				int i = n - start, j;
+				int count = MIN(RULES_BLOCK_WORDS, end - n);
+
+				for (j = 0; j < count; j++)
+					block[j] = words[n + j];
+				if (skip_nodes)
+				for (j = 0; j < count; j++)
+					if (par_skip(n + j))
+						block[j] = NULL;
+				rules_apply_block(prog, block, count,
+				                  &par_keys[i * PAR_KEY_SIZE],
+				                  PAR_KEY_SIZE, &par_ok[i]);
+			}
+		} else {
+#pragma omp for schedule(static)
+			for (n = start; n < end; n++) {
+				int i = n - start;
+				char *line, *word;
+
+				par_ok[i] = 0;
+				if (skip_nodes && par_skip(n))
+					continue;
+#if ARCH_ALLOWS_UNALIGNED
+				line = words[n];
+#else
+				line = strcpy(aligned.buffer, words[n]);
+#endif
+				if ((word = rules_apply(line, rule, -1,
+				                        NULL))) {
+					strnzcpy(&par_keys[i * PAR_KEY_SIZE],
+					         word, PAR_KEY_SIZE);
+					par_ok[i] = 1;
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Parallel indexing of a wordlist loaded to memory.  The buffer is cut in
+ * chunks at line starts, each chunk's line terminators are counted, and each
+ * thread then splits its chunks into words[] at the offset given by the line
+ * counts before it.  The chunks are finally compacted in order, so words[]
+ * ends up the same as with seq_index().
+ */
+#define PAR_INDEX_MIN			(1 << 20)
+#define PAR_INDEX_CHUNKS		4	/* per thread */
+
+/*
+ * Full dupe suppression for loopback, as wbuf_unique() does it: hashes are
+ * computed in parallel, then each thread owns the buckets that are equal to
+ * its number modulo the thread count, so first occurrences still win.
+ */
+static void par_unique(int64_t count)
+{
+	unsigned int *hashes = mem_alloc(count * sizeof(*hashes));
+	int64_t n;
+
+#pragma omp parallel for schedule(static)
+	for (n = 0; n < count; n++)
+		hashes[n] = line_hash(words[n]);
+
+#pragma omp parallel private(n)
+	{
+		unsigned int t = omp_get_thread_num();
+		unsigned int threads = omp_get_num_threads();
+
+		for (n = 0; n < count; n++) {
+			unsigned int current, linehash = hashes[n];
+
+			if (linehash % threads != t)
+				continue;
+			current = buffer.hash[linehash];
+			while (current != ENTRY_END_HASH) {
+				if (!strcmp(words[n], words[current]))
+					break;
+				current = buffer.data[current].next;
+			}
+			if (current != ENTRY_END_HASH) {
+				words[n] = NULL;
+				continue;
+			}
+			buffer.data[n].next = buffer.hash[linehash];
+			buffer.hash[linehash] = n;
+		}
+	}
+
+	MEM_FREE(hashes);
+}
+
+/*
+ * Returns 0 if the buffer is better left to the single-threaded loop,
+ * otherwise sets nWordFileLines and *kept like that loop would.
+ */
+static int par_index(char *start, char *aep, int rules, int loopBack,
+                     int conv, int64_t *kept)
+{
+	int threads = omp_get_max_threads();
+	int c, chunks = threads * PAR_INDEX_CHUNKS;
+	char **bound;
+	int64_t *base, *lf, *count, total = 0, lines = 0, i;
+
+	if (threads < 2 || aep - start < PAR_INDEX_MIN ||
+	    (conv && options.input_enc != options.target_enc) ||
+	    !memchr(start, '\n', aep - start))
+		return 0;
+
+/* Each chunk but the first starts right after a '\n' not followed by '\r' */
+	bound = mem_alloc((chunks + 1) * sizeof(*bound));
+	bound[0] = start;
+	bound[chunks] = aep;
+	for (c = 1; c < chunks; c++) {
+		char *p = start + (aep - start) / chunks * c;
+
+		if (p < bound[c - 1])
+			p = bound[c - 1];
+		while (p < aep && (p[-1] != '\n' || *p == '\r'))
+			p++;
+		bound[c] = p;
+	}
+	if (*start == '\r')
+		while (*bound[0] == '\r' && bound[0] < bound[1])
+			bound[0]++;
+
+	base = mem_alloc((chunks + 1) * sizeof(*base));
+	lf = mem_alloc(chunks * sizeof(*lf));
+	count = mem_alloc(chunks * sizeof(*count));
+
+#pragma omp parallel for schedule(static)
+	for (c = 0; c < chunks; c++)
+		count[c] = count_eol(bound[c], bound[c + 1], &lf[c]);
+
+	for (c = 0; c < chunks; c++) {
+		base[c] = total;
+		total += count[c] + 1;
+		lines += lf[c];
+	}
+	base[chunks] = total;
+
+	nWordFileLines = count_lines(total - chunks, lines, aep);
+	words = mem_alloc((MAX(total, nWordFileLines) + 1) * sizeof(char*));
+	log_event("- wordfile had %"PRId64" lines and required %"PRId64
+	          " bytes for index, indexing with %d threads.",
+	          (int64_t)nWordFileLines,
+	          (int64_t)(nWordFileLines * sizeof(char*)), threads);
+
+#pragma omp parallel for schedule(dynamic)
+	for (c = 0; c < chunks; c++)
+		count[c] = index_chunk(bound[c], bound[c + 1],
+		                       &words[base[c]], rules, loopBack, conv);
+
+	for (i = 0, c = 0; c < chunks; c++) {
+		int64_t from = base[c], n = count[c];
+
+		if (!loopBack && n && i && !strcmp(words[from], words[i - 1])) {
+			from++;
+			n--;
+		}
+		memmove(&words[i], &words[from], n * sizeof(char*));
+		i += n;
+	}
+
+	if (loopBack) {
+		int64_t n, j;
+
+		hash_log = 1;
+		while (((1 << hash_log) < i) && hash_log < 27)
+			hash_log++;
+		hash_size = (1 << hash_log);
+		hash_mask = (hash_size - 1);
+		log_event("- dupe suppression: hash size %u, "
+		          "temporarily allocating %"PRId64" bytes",
+		          hash_size, (hash_size * sizeof(unsigned int)) +
+		          ((int64_t)i * sizeof(element_st)));
+		buffer.hash = mem_alloc(hash_size * sizeof(unsigned int));
+		buffer.data = mem_alloc(i * sizeof(element_st));
+		memset(buffer.hash, 0xff, hash_size * sizeof(unsigned int));
+		par_unique(i);
+		for (n = j = 0; n < i; n++)
+			if (words[n])
+				words[j++] = words[n];
+		i = j;
+	}
+
+	MEM_FREE(count);
+	MEM_FREE(lf);
+	MEM_FREE(base);
+	MEM_FREE(bound);
+
+	*kept = i;
+	return 1;
+}
+#endif
+
 void do_wordlist_crack(struct db_main *db, const char *name, int rules)
 {
 	union {
@@ -480,7 +1275,7 @@ void do_wordlist_crack(struct db_main *db, const char *name, int rules)
 	IPC_Item *pIPC=NULL;
 #endif
 	char msg_buf[128];
-	int forceLoad = 0, default_wordlist = 0;
+	int forceLoad = 0, default_wordlist = 0, compressed = 0;
 	int dupeCheck = (options.flags & FLG_DUPESUPP) ? 1 : 0;
 	int loopBack = (options.flags & FLG_LOOPBACK_CHK) ? 1 : 0;
 	int do_lmloop = loopBack && db->plaintexts->head;
@@ -537,6 +1332,7 @@ void do_wordlist_crack(struct db_main *db, const char *name, int rules)
 
 	static unsigned int prev_g;
 	static unsigned long long prev_p;
+	static uint64_t prev_t;
 	if (rules && cfg_get_bool(SECTION_OPTIONS, NULL, "PerRuleStats", 0) && !(options.flags & FLG_MASK_CHK) &&
 	    (!(options.flags & FLG_NOLOG) || options.log_stderr)) {
 		rules = 2;
@@ -577,6 +1373,11 @@ void do_wordlist_crack(struct db_main *db, const char *name, int rules)
 
 		file_is_fifo = ((st.st_mode & S_IFMT) == S_IFIFO);
 
+		if (!file_is_fifo && wlz_probe(word_file)) {
+			word_file = wlz_open(word_file, path_expand(name));
+			compressed = 1;
+		}
+
 #if OS_FORK
 		if (options.fork && file_is_fifo) {
 			if (john_main_process)
@@ -593,7 +1394,6 @@ void do_wordlist_crack(struct db_main *db, const char *name, int rules)
 		file_is_fifo = 0;
 
 	if (name && !file_is_fifo) {
-		char *cp, csearch;
 		int64_t ourshare = 0;
 #ifdef HAVE_MMAP
 		int mmap_max =
@@ -614,7 +1414,7 @@ void do_wordlist_crack(struct db_main *db, const char *name, int rules)
 		}
 
 #ifdef HAVE_MMAP
-		if (mmap_max && mmap_max >= (file_len >> 20)) {
+		if (mmap_max && mmap_max >= (file_len >> 20) && !compressed) {
 			if (john_main_process)
 				log_event("- memory mapping wordlist (%"PRId64" bytes)",
 				          (int64_t)file_len);
@@ -652,8 +1452,13 @@ void do_wordlist_crack(struct db_main *db, const char *name, int rules)
 		// Load only this node's share of words to memory
 		if (mem_map && options.node_count > 1 &&
 		    (file_len > options.node_count * (length * 100))) {
-			ourshare = (file_len / options.node_count) *
-				(options.node_max - options.node_min + 1);
+/* With work stealing, any of the lines may turn out to be ours */
+			if (workq_active())
+				log_event("- Work stealing: loading all of "
+				    "the file, not this node's share");
+			else
+				ourshare = (file_len / options.node_count) *
+					(options.node_max - options.node_min + 1);
 		}
 
 		if (ourshare <= options.max_wordfile_memory &&
@@ -776,106 +1581,16 @@ void do_wordlist_crack(struct db_main *db, const char *name, int rules)
 			}
 			aep = word_file_str + file_len;
 			*aep = 0;
-			csearch = '\n';
-			cp = memchr(word_file_str, csearch, (size_t)file_len);
-			if (!cp)
-			{
-				csearch = '\r';
-				cp = memchr(word_file_str, csearch, (size_t)file_len);
-			}
-			for (nWordFileLines = 0; cp; ++nWordFileLines)
-				cp = memchr(&cp[1], csearch, (size_t)(file_len -
-				            (cp - word_file_str) - 1));
-			if (aep[-1] != csearch)
-				++nWordFileLines;
-			words = mem_alloc((nWordFileLines + 1) * sizeof(char*));
-			log_event("- wordfile had %"PRId64" lines and required %"PRId64
-			          " bytes for index.",
-			          (int64_t)nWordFileLines,
-			          (int64_t)(nWordFileLines * sizeof(char*)));
-
-			i = 0;
-			cp = word_file_str;
-
-			if (csearch == '\n')
-				while (*cp == '\r') cp++;
-
-			if (loopBack) {
-				hash_log = 1;
-				while (((1 << hash_log) < (nWordFileLines))
-				       && hash_log < 27)
-					hash_log++;
-				hash_size = (1 << hash_log);
-				hash_mask = (hash_size - 1);
-				log_event("- dupe suppression: hash size %u, "
-					"temporarily allocating %"PRId64" bytes",
-					hash_size,
-					(hash_size * sizeof(unsigned int)) +
-					((int64_t)nWordFileLines *
-					 sizeof(element_st)));
-				buffer.hash = mem_alloc(hash_size *
-				                        sizeof(unsigned int));
-				buffer.data = mem_alloc(nWordFileLines *
-				                        sizeof(element_st));
-				memset(buffer.hash, 0xff, hash_size *
-				       sizeof(unsigned int));
-			}
-
-			do
-			{
-				char *ep, ec;
-				if (i > nWordFileLines) {
-					fprintf(stderr, "Warning: wordlist "
-					        "contains inconsequent "
-					        "newlines, some words may be "
-					        "skipped\n");
-					log_event("- Warning: wordlist contains"
-					          " inconsequent newlines, some"
-					          " words may be skipped");
-					i--;
-					break;
-				}
-				if (!myWordFileLines) {
-					check_bom(cp);
-					cp = convert(cp);
-				}
-				ep = cp;
-				while ((ep < aep) && *ep && *ep != '\n' && *ep != '\r')
-					ep++;
-				ec = *ep;
-				*ep = 0;
-				if (strncmp(cp, "#!comment", 9)) {
-					if (!rules) {
-						if (min_length && ep - cp < min_length)
-							goto skip;
-						/*
-						 * Over --max-length are always skipped, while over
-						 * format's length are truncated if FMT_TRUNC.
-						 */
-						if (skip_length && ep - cp > skip_length)
-							goto skip;
-						if (ep - cp >= length)
-							cp[length] = 0;
-					} else
-						if (ep - cp >= LINE_BUFFER_SIZE)
-							cp[LINE_BUFFER_SIZE-1] = 0;
-					if (loopBack) {
-						/* Full suppression of dupes
-						   after truncation */
-						if (wbuf_unique(cp))
-							words[i++] = cp;
-					} else {
-						/* Just suppress consecutive
-						   candidates */
-						if (!i || strcmp(cp, words[i-1]))
-							words[i++] = cp;
-					}
-				}
-skip:
-				cp = ep + 1;
-				if (ec == '\r' && *cp == '\n') cp++;
-				if (ec == '\n' && *cp == '\r') cp++;
-			} while (cp < aep);
+#ifdef _OPENMP
+			if (par_index(word_file_str, aep, rules, loopBack,
+			              !myWordFileLines, &i))
+				goto indexed;
+#endif
+			i = seq_index(word_file_str, aep, rules, loopBack,
+			              !myWordFileLines);
+#ifdef _OPENMP
+indexed:
+#endif
 			if ((int64_t)nWordFileLines - i > 0)
 				log_event("- suppressed %"PRId64" duplicate lines "
 				          "and/or comments from wordlist.",
@@ -1021,6 +1736,10 @@ SKIP_MEM_MAP_LOAD:
 		}
 	}
 
+	if (name && !nWordFileLines && word_file != stdin && !file_is_fifo &&
+	    !idx.name)
+		idx_init(name);
+
 REDO_AFTER_LMLOOP:
 
 	if (rules) {
@@ -1047,7 +1766,39 @@ REDO_AFTER_LMLOOP:
 		}
 
 
+		MEM_FREE(rule_same);
+		if (cfg_get_bool(SECTION_OPTIONS, NULL, "OptimizeRules", 1)) {
+			rule_same = mem_alloc(rule_count * sizeof(*rule_same));
+			rules_optimize(&ctx, db, rule_count, rule_same);
+		}
+
 		apply = rules_apply;
+		if (!rule_prog &&
+		    cfg_get_bool(SECTION_OPTIONS, NULL, "CompileRules", 1))
+			rule_prog = mem_alloc(sizeof(*rule_prog));
+
+		word_major = options.rules_word_major && !do_lmloop &&
+#if HAVE_REXGEN
+		    !regex &&
+#endif
+		    !f_new && !(options.flags & FLG_MASK_CHK);
+		if (word_major)
+			wm_load(&ctx, db);
+		else if (options.rules_word_major && john_main_process)
+			log_event("- Applying rules rule by rule, as required "
+			          "by the hybrid or loopback mode");
+		if (rules > 1 && !word_major)
+			rulestats_init(options.activewordlistrules, &ctx,
+			               rule_count);
+#ifdef _OPENMP
+		if (!word_major &&
+		    (nWordFileLines || pipe_input) && !options.rule_stack &&
+#if HAVE_REXGEN
+		    !regex &&
+#endif
+		    !f_new && !(options.flags & FLG_MASK_CHK))
+			par_init();
+#endif
 	} else {
 		rule_ctx = NULL;
 		rule_count = 1;
@@ -1085,12 +1836,27 @@ REDO_AFTER_LMLOOP:
 	prerule = rule = "";
 	if (rules)
 		prerule = rpp_next(&ctx);
+	if (rules > 1 && !word_major)
+		prev_t = john_get_nano();
 
 /* A string that can't be produced by fgetl(). */
 	last = aligned.buffer[1];
 	last[0] = '\n';
 	last[1] = 0;
 
+	if (word_major) {
+		if (options.node_count && !myWordFileLines && john_main_process)
+			log_event("- Will distribute words across nodes");
+		if (wm_crack(line, &last, options.node_count && !myWordFileLines,
+		             options.input_enc != options.target_enc || loopBack)) {
+			rules = 0;
+			pipe_input = 0;
+		}
+		if (ferror(word_file))
+			goto done;
+		goto word_major_done;
+	}
+
 	dist_rules = 0;
 	dist_switch = rule_count; /* never */
 	my_words = ~0UL; /* all */
@@ -1098,7 +1864,10 @@ REDO_AFTER_LMLOOP:
 	/* myWordFileLines indicates we already have OUR share of words in
 	   memory buffer, so no further skipping. */
 	if (options.node_count && !myWordFileLines) {
-		int rule_rem = rule_count % options.node_count;
+/* With work stealing, the last rules are split by words so all end together */
+		int rule_rem = workq_active() ?
+			MIN(rule_count, (int)options.fork) :
+			rule_count % options.node_count;
 		const char *now, *later = "";
 		dist_switch = rule_count - rule_rem;
 		if (!rule_rem || rule_number < dist_switch) {
@@ -1108,8 +1877,11 @@ REDO_AFTER_LMLOOP:
 				later = ", then switch to distributing words";
 		} else {
 			dist_switch = rule_count; /* never */
-			my_words = options.node_max - options.node_min + 1;
-			their_words = options.node_count - my_words;
+			if (!workq_active()) {
+				my_words =
+				    options.node_max - options.node_min + 1;
+				their_words = options.node_count - my_words;
+			}
 			now = "words";
 		}
 		if (john_main_process)
@@ -1148,11 +1920,32 @@ REDO_AFTER_LMLOOP:
 			if (dist_rules && strncmp(prerule, "!!", 2)) {
 				int for_node =
 				    rule_number % options.node_count + 1;
-				if (for_node < options.node_min ||
+				if (workq_active() ?
+				    !workq_mine((uint64_t)rule_number << 32) :
+				    for_node < options.node_min ||
 				    for_node > options.node_max)
 					goto next_rule;
 			}
+			if (rule_same && rule_number < rule_count &&
+			    rule_same[rule_number]) {
+				if (!rules_mute) {
+					if (rule_same[rule_number] > 0)
+					log_event("- Rule #%d: '%.100s' skipped,"
+						" same as #%d",
+						rule_number + 1, prerule,
+						rule_same[rule_number]);
+					else
+					log_event("- Rule #%d: '%.100s' skipped,"
+						" no candidate of acceptable"
+						" length",
+						rule_number + 1, prerule);
+				}
+				goto next_rule;
+			}
 			if ((rule = rules_reject(prerule, -1, last, db))) {
+				if (rule_prog)
+					apply = rules_compile(rule, rule_prog) ?
+						compiled_rules_apply : rules_apply;
 				if (strcmp(prerule, rule)) {
 					if (!rules_mute)
 					log_event("- Rule #%d: '%.100s'"
@@ -1179,7 +1972,9 @@ REDO_AFTER_LMLOOP:
 			if (options.node_count && !dist_rules) {
 				int for_node = loop_line_no %
 					options.node_count + 1;
-				int skip = for_node < options.node_min
+				int skip = workq_active() ?
+					steal_skip(rule_number, 1, loop_line_no) :
+					for_node < options.node_min
 					|| for_node > options.node_max;
 				if (skip) {
 					loop_line_no++;
@@ -1236,13 +2031,80 @@ REDO_AFTER_LMLOOP:
 			}
 		} while ((joined = joined->next));
 
+#ifdef _OPENMP
+		else if (rule && nWordFileLines && par_threads) {
+			int skip_nodes =
+				options.node_count && !myWordFileLines && !dist_rules;
+
+			while (line_number < nWordFileLines) {
+				int64_t n, start = line_number;
+				int64_t end = MIN(start + par_block, nWordFileLines);
+				const struct rules_prog *prog =
+					apply == compiled_rules_apply ?
+					rule_prog : NULL;
+				int first = 1;
+
+/*
+ * With work stealing, take one block of lines at a time, as we get to it,
+ * so that those we've taken and not done are still held when we save.
+ */
+				if (skip_nodes && workq_active()) {
+					int64_t block_end = start -
+					    start % WORDLIST_STEAL_LINES +
+					    WORDLIST_STEAL_LINES;
+
+					block_end = MIN(block_end, nWordFileLines);
+					if (steal_skip(rule_number, 0, start)) {
+						line_number = block_end;
+						continue;
+					}
+					end = MIN(end, block_end);
+				}
+
+				par_apply(rule, prog, start, end,
+				          skip_nodes && !workq_active());
+
+				for (n = start; n < end; n++) {
+					if (!((n - start) % RULES_BLOCK_WORDS))
+						first = 1;
+					if (!par_ok[n - start])
+						continue;
+					word = &par_keys[(n - start) * PAR_KEY_SIZE];
+/* rules_apply_block() already dropped repeats after a block's first one */
+					if ((first || !prog) && !strcmp(word, last)) {
+						first = 0;
+						continue;
+					}
+					first = 0;
+					last = word;
+					line_number = n + 1;
+					if (ext_filter(word))
+					if (crk_process_key(word)) {
+						rules = 0;
+						pipe_input = 0;
+						break;
+					}
+				}
+/* The next block overwrites par_keys[], so keep a copy of the last word */
+				if (last != aligned.buffer[1]) {
+					strcpy(aligned.buffer[1], last);
+					last = aligned.buffer[1];
+				}
+				if (n < end)
+					break;
+				line_number = end;
+			}
+		}
+#endif
 		else if (rule && nWordFileLines)
 		while (line_number < nWordFileLines) {
 			if (options.node_count && !myWordFileLines)
 			if (!dist_rules) {
 				int for_node = line_number %
 					options.node_count + 1;
-				int skip = for_node < options.node_min ||
+				int skip = workq_active() ?
+					steal_skip(rule_number, 0, line_number) :
+					for_node < options.node_min ||
 					for_node > options.node_max;
 				if (skip) {
 					line_number++;
@@ -1304,8 +2166,13 @@ REDO_AFTER_LMLOOP:
 		while (GET_LINE(line, word_file)) {
 
 			line_number++;
+			idx_note(line_number);
 			check_bom(line);
 
+			if (options.node_count && !dist_rules && workq_active() &&
+			    steal_skip(rule_number, 0, line_number - 1))
+				continue;
+
 			if (line[0] != '#') {
 process_word:
 				if (options.input_enc != options.target_enc
@@ -1406,13 +2273,16 @@ next_rule:
 					fake_p++;
 				} while (p == status.cands);
 				unsigned int g = status.guess_count - prev_g;
+				uint64_t t = john_get_nano() - prev_t;
 				p = status.cands - fake_p - prev_p;
 				double score = p ? (g ? (double)g * g : 1e-9) / (double)p : 0;
 				double pg = (double)(p ? p : 1e9) / (g ? g : 1e-9);
-				log_event("- Score %.18f for %.2f p/g %ug %llup during rule #%d :%.100s",
-					score, pg, g, p, rule_number + 1, prerule);
+				log_event("- Score %.18f for %.2f p/g %ug %llup %.3fs during rule #%d :%.100s",
+					score, pg, g, p, t / 1e9, rule_number + 1, prerule);
+				rulestats_add(rule_number, g, p, t);
 				prev_g = status.guess_count;
 				prev_p = status.cands;
+				prev_t = john_get_nano();
 			}
 
 			if (!(rule = rpp_next(&ctx))) break;
@@ -1422,13 +2292,17 @@ next_rule:
 				log_event("- Switching to distributing words");
 				dist_rules = 0;
 				dist_switch = rule_count; /* not anymore */
-				my_words =
-				    options.node_max - options.node_min + 1;
-				their_words = options.node_count - my_words;
+				if (!workq_active()) {
+					my_words = options.node_max -
+					    options.node_min + 1;
+					their_words =
+					    options.node_count - my_words;
+				}
 			}
 
 			line_number = 0;
 			if (!nWordFileLines && word_file != stdin && !file_is_fifo) {
+				idx_save();
 				if (mem_map)
 					map_pos = mem_map;
 				else
@@ -1443,6 +2317,7 @@ next_rule:
 		my_words_left = my_words;
 	} while (rules);
 
+word_major_done:
 	if (do_lmloop && !event_abort) {
 		log_event("- Done with reassembled LM halves");
 		do_lmloop = 0;
@@ -1456,6 +2331,21 @@ done:
 	crk_done();
 	rec_done(event_abort || (status.pass && db->salts));
 
+/* Count the rule we were interrupted in, a restored session does the rest */
+	if (prev_t && status.cands > prev_p)
+		rulestats_add(rule_number, status.guess_count - prev_g,
+		              status.cands - prev_p, john_get_nano() - prev_t);
+	prev_t = 0;
+	rulestats_done();
+
+#ifdef _OPENMP
+	par_done();
+#endif
+	MEM_FREE(rule_prog);
+	MEM_FREE(rule_same);
+	wm_done();
+	idx_done();
+
 	if (ferror(word_file)) pexit("fgets");
 
 	if (max_pipe_words)  // pipe_input was already cleared.
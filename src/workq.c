@@ -0,0 +1,386 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ */
+
+#define NEED_OS_FORK
+#include "os.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arch.h"
+#include "misc.h"
+#include "mem_map.h"
+#include "memory.h"
+#include "logger.h"
+#include "options.h"
+#include "recovery.h"
+#include "signals.h"
+#include "workq.h"
+
+#if OS_FORK && HAVE_MMAP && defined(MAP_ANON) && defined(__GNUC__)
+
+/* How long to wait for the other processes to restore, in seconds */
+#define WORKQ_RESTORE_WAIT		600
+
+/*
+ * The next unit that no process has taken yet, in memory shared by the
+ * "--fork" processes.  Units before it are either done or in someone's list
+ * of held units (which is saved with their session).
+ *
+ * When restoring, the processes resume at different units, so they also
+ * share the smallest unit any of them asked about first, the number that
+ * hasn't asked yet, and the number that has exited.
+ */
+struct workq_shared {
+	volatile uint64_t next;
+	volatile uint64_t first;
+	volatile int waiting;
+	volatile int exited;
+};
+
+static struct workq_shared *workq;
+
+/* The node numbers of the whole --fork group, for --node */
+static unsigned int group_min, group_max;
+
+/*
+ * Units we took since the last workq_fix_state(), and after a restore those
+ * we had taken before, in increasing order.
+ */
+static uint64_t *held;
+static int held_count, held_alloc;
+
+/* The last answer of workq_mine(), which is asked a lot about one unit */
+static uint64_t last_unit;
+static int last_mine = -1;
+
+/* The last unit that was ours, which is the one the mode is in */
+static uint64_t current;
+static int have_current;
+
+/*
+ * The first unit we asked about after a restore.  We may have skipped units
+ * before it that another process hasn't got to yet, so we don't move the
+ * counter until that process has moved it this far.
+ */
+static uint64_t first;
+
+/* Whether we're yet to ask about our first unit after a restore */
+static int restoring;
+
+/* Lets the others know they needn't wait for us anymore */
+static void workq_done(void)
+{
+	if (restoring) {
+		restoring = 0;
+		__sync_fetch_and_sub(&workq->waiting, 1);
+	}
+	__sync_fetch_and_add(&workq->exited, 1);
+}
+
+void workq_init(void)
+{
+	struct workq_shared *q;
+
+	if (!options.work_stealing || !options.fork)
+		return;
+
+/* The modes of a batch would need a queue each, at different times */
+	if (options.flags & FLG_BATCH_CHK) {
+		log_event("! Work stealing isn't supported in batch mode");
+		return;
+	}
+
+	q = mmap(NULL, sizeof(*q), PROT_READ | PROT_WRITE,
+	    MAP_ANON | MAP_SHARED, -1, 0);
+	if (q == MAP_FAILED) {
+		log_event("! Can't map work queue, using static node ranges: %s",
+		    strerror(errno));
+		return;
+	}
+
+/* Restored sessions lower this to the smallest counter they had saved */
+	q->next = rec_restoring_now ? UINT64_MAX : 0;
+	q->first = UINT64_MAX;
+	q->waiting = rec_restoring_now ? options.fork : 0;
+	q->exited = 0;
+	restoring = rec_restoring_now;
+	first = 0;
+	workq = q;
+	atexit(workq_done);
+	group_min = options.node_min;
+	group_max = options.node_max;
+	log_event("- Work stealing between forked processes");
+}
+
+int workq_active(void)
+{
+	return workq != NULL;
+}
+
+/* Returns the index of the first held unit not below unit */
+static int held_search(uint64_t unit)
+{
+	int lo = 0, hi = held_count;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (held[mid] < unit)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int held_find(uint64_t unit)
+{
+	int i;
+
+	if (!held_count || unit > held[held_count - 1])
+		return 0;
+
+	i = held_search(unit);
+	return i < held_count && held[i] == unit;
+}
+
+static void held_add(uint64_t unit)
+{
+	if (held_count >= held_alloc) {
+		held_alloc = held_alloc ? held_alloc * 2 : 64;
+		held = mem_realloc(held, held_alloc * sizeof(*held));
+	}
+	held[held_count++] = unit;
+}
+
+/*
+ * Called with the first unit we ask about after a restore.  Waits for all
+ * processes to have restored their state and asked about a unit, so that
+ * the counter is as low as it will get, then moves it up to the smallest
+ * unit any of them asked about (units before that aren't anyone's).
+ */
+static void wait_restored(uint64_t unit)
+{
+	uint64_t cur = workq->first, next;
+	time_t deadline = time(NULL) + WORKQ_RESTORE_WAIT;
+
+	while (cur > unit) {
+		uint64_t prev = __sync_val_compare_and_swap(&workq->first,
+			cur, unit);
+
+		if (prev == cur)
+			break;
+		cur = prev;
+	}
+	first = unit;
+	restoring = 0;
+	__sync_fetch_and_sub(&workq->waiting, 1);
+
+	while (workq->waiting > 0 && !event_abort) {
+		if (time(NULL) > deadline) {
+			log_event("! Gave up waiting for other processes to "
+			    "restore, some work may be skipped");
+			break;
+		}
+		usleep(10000);
+	}
+
+	cur = workq->next;
+	next = workq->first;
+	while (cur == UINT64_MAX || cur < next) {
+		uint64_t prev = __sync_val_compare_and_swap(&workq->next,
+			cur, next);
+
+		if (prev == cur)
+			break;
+		cur = prev;
+	}
+}
+
+/*
+ * Moves the counter past unit, unless someone else already did, and returns
+ * what it was.  We've asked about all units from first on, and those of them
+ * still at or past the counter are ours, so there are no others in between.
+ */
+static uint64_t take(uint64_t unit)
+{
+	uint64_t next;
+
+	while ((next = workq->next) < first && next <= unit &&
+	    !workq->exited && !event_abort)
+		usleep(10000);
+
+	while (next <= unit) {
+		uint64_t prev = __sync_val_compare_and_swap(&workq->next,
+			next, unit + 1);
+
+		if (prev == next)
+			break;
+		next = prev;
+	}
+
+	return next;
+}
+
+/* Like take(), for a unit we held, which mustn't wait or move the counter */
+static void take_held(uint64_t unit)
+{
+	uint64_t next = workq->next;
+
+	while (next >= first && next <= unit) {
+		uint64_t prev = __sync_val_compare_and_swap(&workq->next,
+			next, unit + 1);
+
+		if (prev == next)
+			break;
+		next = prev;
+	}
+}
+
+int workq_mine(uint64_t unit)
+{
+	if (last_mine >= 0 && unit == last_unit)
+		return last_mine;
+	last_unit = unit;
+	last_mine = 0;
+
+/* With --node, other machines' units aren't ours to take */
+	if (group_max - group_min + 1 < options.node_count) {
+		unsigned int for_node = unit % options.node_count + 1;
+
+		if (for_node < group_min || for_node > group_max)
+			return 0;
+	}
+
+	if (restoring)
+		wait_restored(unit);
+
+/*
+ * Units we held when saved may be past the counter of a process that saved
+ * before us, and could then be taken by others as well.  That's some work
+ * done twice, but none is skipped.
+ */
+	if (held_find(unit))
+		take_held(unit);
+	else if (take(unit) > unit)
+		return 0;
+	else
+		held_add(unit);
+
+	current = unit;
+	have_current = 1;
+	return last_mine = 1;
+}
+
+void workq_fix_state(void)
+{
+	int done;
+
+	if (!have_current || !(done = held_search(current)))
+		return;
+
+	memmove(held, &held[done], (held_count - done) * sizeof(*held));
+	held_count -= done;
+}
+
+void workq_save_state(FILE *file)
+{
+	int i;
+
+	if (!workq)
+		return;
+
+	fprintf(file, "%s\n%" PRIu64 "\n%d\n", WORKQ_REC_TAG, workq->next,
+	    held_count);
+	for (i = 0; i < held_count; i++)
+		fprintf(file, "%" PRIu64 "\n", held[i]);
+}
+
+int workq_restore_state(FILE *file)
+{
+	uint64_t next, unit, cur;
+	int count, i;
+
+	if (fscanf(file, "%" SCNu64 "\n%d\n", &next, &count) != 2 || count < 0)
+		return 1;
+
+	held_count = 0;
+	for (i = 0; i < count; i++) {
+		if (fscanf(file, "%" SCNu64 "\n", &unit) != 1)
+			return 1;
+		held_add(unit);
+	}
+	last_mine = -1;
+	have_current = 0;
+
+	if (!workq)
+		return 0;
+
+/*
+ * The processes saved at different times, and units taken after a save are
+ * in no one's list.  But all that was taken before the earliest save is done
+ * or in the list of a process that saved later, so we go on from there.
+ */
+	cur = workq->next;
+	while (cur > next) {
+		uint64_t prev = __sync_val_compare_and_swap(&workq->next, cur, next);
+
+		if (prev == cur)
+			break;
+		cur = prev;
+	}
+
+	return 0;
+}
+
+#else
+
+void workq_init(void)
+{
+}
+
+int workq_active(void)
+{
+	return 0;
+}
+
+int workq_mine(uint64_t unit)
+{
+	return 1;
+}
+
+void workq_fix_state(void)
+{
+}
+
+void workq_save_state(FILE *file)
+{
+}
+
+int workq_restore_state(FILE *file)
+{
+	uint64_t next, unit;
+	int count;
+
+	if (fscanf(file, "%" SCNu64 "\n%d\n", &next, &count) != 2)
+		return 1;
+	while (count-- > 0)
+		if (fscanf(file, "%" SCNu64 "\n", &unit) != 1)
+			return 1;
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ */
+
+/*
+ * Work stealing between "--fork" processes (--work-stealing).
+ *
+ * A cracking mode numbers its work units (wordlist lines or rules,
+ * incremental mode entries, mask chunks) in the order it goes through them,
+ * which is the same for all processes.  Instead of skipping the units that
+ * belong to other node numbers, each process asks workq_mine() about every
+ * unit it gets to, and the first one to ask takes it.  So a process that's
+ * ahead just takes more units, and all of them finish at about the same time.
+ */
+
+#ifndef _JOHN_WORKQ_H
+#define _JOHN_WORKQ_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Sets up the shared state.  Called by the main process before fork().
+ */
+extern void workq_init(void);
+
+/*
+ * Whether work stealing is in use, so a mode should use workq_mine() rather
+ * than node numbers.
+ */
+extern int workq_active(void);
+
+/*
+ * Returns non-zero if unit is ours, or 0 if it's another process' (or
+ * another node's, with --node).  Units must be asked about in increasing
+ * order, but there may be gaps.
+ */
+extern int workq_mine(uint64_t unit);
+
+/*
+ * To be called from the cracking mode's fix_state(): what the mode is about
+ * to save is in the unit we last took, so those before it are done.
+ */
+extern void workq_fix_state(void);
+
+/*
+ * Save and restore the units we took and haven't finished, as an appended
+ * block of the crash recovery file (see recovery.c).
+ */
+#define WORKQ_REC_TAG			"wq-v1"
+extern void workq_save_state(FILE *file);
+extern int workq_restore_state(FILE *file);
+
+#endif